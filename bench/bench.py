@@ -0,0 +1,161 @@
+#!/usr/bin/env python3
+
+#
+# Runs html2xhtml repeatedly over every document of a corpus (see
+# gencorpus.py) and reports, for each document, throughput (MB/s and
+# documents/s), peak RSS and the time spent in every phase of the
+# conversion, as reported by html2xhtml --stats=json.
+#
+# Results are written as JSON lines (one object per document) so
+# that runs from different commits can be compared with --compare.
+#
+# Usage: bench.py [--h2x <binary>] [--corpus <dir>] [--runs <n>]
+#                 [--output <file.jsonl>] [--compare <old.jsonl>]
+#                 [-- <html2xhtml options>]
+#
+
+import argparse
+import json
+import os
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+
+PHASES = ("preload", "parse", "write", "encode")
+
+
+def git_commit():
+    try:
+        return subprocess.check_output(
+            ["git", "rev-parse", "--short", "HEAD"],
+            stderr=subprocess.DEVNULL,
+            cwd=os.path.dirname(os.path.abspath(__file__))).decode().strip()
+    except (OSError, subprocess.CalledProcessError):
+        return None
+
+
+def run_once(h2x, path, options):
+    """Runs a conversion. Returns (wall time, peak RSS in KB, stats)."""
+    with open(path, "rb") as f_in, \
+            open(os.devnull, "wb") as f_out, \
+            tempfile.TemporaryFile() as f_err:
+        start = time.perf_counter()
+        proc = subprocess.Popen([h2x, "--stats=json"] + options,
+                                stdin=f_in, stdout=f_out, stderr=f_err)
+        _, status, rusage = os.wait4(proc.pid, 0)
+        wall = time.perf_counter() - start
+        proc.returncode = os.waitstatus_to_exitcode(status)
+        f_err.seek(0)
+        messages = f_err.read().decode("utf-8", "replace")
+    if proc.returncode != 0:
+        raise RuntimeError("html2xhtml failed on %s:\n%s" % (path, messages))
+    stats = None
+    for line in messages.splitlines():
+        if line.startswith("{"):
+            stats = json.loads(line)
+    return wall, rusage.ru_maxrss, stats
+
+
+def bench_document(h2x, path, runs, warmup, options):
+    for _ in range(warmup):
+        run_once(h2x, path, options)
+    walls = []
+    rss = 0
+    phases = {phase: {"wall": [], "cpu": []} for phase in PHASES}
+    counters = None
+    for _ in range(runs):
+        wall, maxrss, stats = run_once(h2x, path, options)
+        walls.append(wall)
+        rss = max(rss, maxrss)
+        if stats:
+            for phase in PHASES:
+                for clock in ("wall", "cpu"):
+                    phases[phase][clock].append(stats["time"][phase][clock])
+            counters = stats
+    size = os.path.getsize(path)
+    wall = statistics.median(walls)
+    result = {
+        "document": os.path.basename(path),
+        "bytes": size,
+        "runs": runs,
+        "wall_median": round(wall, 6),
+        "wall_min": round(min(walls), 6),
+        "wall_stdev": round(statistics.stdev(walls), 6) if runs > 1 else 0,
+        "mb_per_s": round(size / wall / 1e6, 3),
+        "docs_per_s": round(1 / wall, 3),
+        "peak_rss_kb": rss,
+    }
+    if counters:
+        result["phases"] = {
+            phase: {clock: round(statistics.median(values), 6)
+                    for clock, values in phases[phase].items()}
+            for phase in PHASES}
+        result["bytes_out"] = counters["bytes_out"]
+        result["arena_blocks"] = counters["arena_blocks"]
+    return result
+
+
+def compare(old_file, results):
+    old = {}
+    with open(old_file) as f:
+        for line in f:
+            entry = json.loads(line)
+            old[entry["document"]] = entry
+    print("%-28s %10s %10s %8s" % ("document", "old MB/s", "new MB/s",
+                                    "change"))
+    for entry in results:
+        prev = old.get(entry["document"])
+        if not prev:
+            continue
+        change = (entry["mb_per_s"] / prev["mb_per_s"] - 1) * 100
+        print("%-28s %10.3f %10.3f %+7.1f%%" % (
+            entry["document"], prev["mb_per_s"], entry["mb_per_s"], change))
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Benchmark html2xhtml over a corpus of documents.")
+    parser.add_argument("--h2x", default=os.path.join(
+        os.path.dirname(os.path.abspath(__file__)), "..", "src", "html2xhtml"))
+    parser.add_argument("--corpus", default="corpus")
+    parser.add_argument("--runs", type=int, default=5)
+    parser.add_argument("--warmup", type=int, default=1)
+    parser.add_argument("--label", help="label stored with the results")
+    parser.add_argument("--output", help="append the results to this file")
+    parser.add_argument("--compare", metavar="OLD",
+                        help="compare throughput with a previous results file")
+    parser.add_argument("options", nargs="*",
+                        help="extra html2xhtml options (after --)")
+    args = parser.parse_args()
+
+    documents = sorted(os.path.join(args.corpus, name)
+                       for name in os.listdir(args.corpus)
+                       if name.endswith(".html"))
+    if not documents:
+        sys.exit("No documents in %s (run gencorpus.py first)" % args.corpus)
+
+    commit = git_commit()
+    results = []
+    out = open(args.output, "a") if args.output else sys.stdout
+    try:
+        for path in documents:
+            result = bench_document(args.h2x, path, args.runs, args.warmup,
+                                    args.options)
+            result["commit"] = commit
+            result["label"] = args.label
+            result["options"] = args.options
+            results.append(result)
+            out.write(json.dumps(result, sort_keys=True) + "\n")
+            out.flush()
+    finally:
+        if args.output:
+            out.close()
+
+    if args.compare:
+        compare(args.compare, results)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,268 @@
+#!/usr/bin/env python3
+
+#
+# Generates a corpus of synthetic HTML documents for the benchmarks.
+#
+# Usage: gencorpus.py [-o <dir>] [--size <KB>] [--seed <n>]
+#                     [<profile>[:<param>=<value>,...] ...]
+#
+# Without profiles, one document per profile is generated with its
+# default parameters. Run with --list to see the profiles and their
+# parameters.
+#
+
+import argparse
+import os
+import random
+import sys
+
+WORDS = ("lorem ipsum dolor sit amet consectetur adipiscing elit sed do "
+         "eiusmod tempor incididunt ut labore et dolore magna aliqua enim "
+         "ad minim veniam quis nostrud exercitation ullamco laboris nisi "
+         "aliquip ex ea commodo consequat duis aute irure in reprehenderit "
+         "voluptate velit esse cillum fugiat nulla pariatur").split()
+
+LATIN1_WORDS = ("canci\xf3n ni\xf1o a\xf1o coraz\xf3n pa\xeds m\xe1s "
+                "tambi\xe9n \xfaltimo se\xf1or caf\xe9 cr\xe8me br\xfbl\xe9e "
+                "\xe0 gar\xe7on na\xefve \xdcber Stra\xdfe").split()
+
+ENTITIES = ("&amp;", "&lt;", "&gt;", "&quot;", "&eacute;", "&ntilde;",
+            "&copy;", "&nbsp;", "&euro;", "&alpha;", "&#233;", "&#8364;",
+            "&#x20AC;", "&#x3b1;", "&hellip;", "&mdash;")
+
+
+def words(rnd, n, vocabulary=WORDS):
+    return " ".join(rnd.choice(vocabulary) for _ in range(n))
+
+
+def head(title, charset="utf-8"):
+    return ('<!DOCTYPE HTML PUBLIC "-//W3C//DTD HTML 4.01 Transitional//EN">\n'
+            '<html>\n<head>\n<meta http-equiv="Content-Type" '
+            'content="text/html; charset=%s">\n<title>%s</title>\n'
+            '</head>\n<body>\n' % (charset, title))
+
+
+def tail():
+    return "</body>\n</html>\n"
+
+
+def gen_deep(rnd, size, depth=200):
+    """Deeply nested block and inline elements."""
+    out = [head("deep")]
+    total = 0
+    while total < size:
+        parts = []
+        for i in range(depth):
+            parts.append('<div class="d%d">' % i if i % 2 == 0 else "<span>")
+            parts.append(words(rnd, 2))
+        for i in reversed(range(depth)):
+            parts.append("</div>\n" if i % 2 == 0 else "</span>")
+        block = "".join(parts)
+        out.append(block)
+        total += len(block)
+    out.append(tail())
+    return "".join(out)
+
+
+def gen_unclosed(rnd, size, depth=100000):
+    """Inline elements left open, nested 'depth' levels deep."""
+    out = [head("unclosed"), "<p>"]
+    total = 0
+    while total < size:
+        for i in range(depth):
+            part = ('<font size="%d">' % (i % 7 + 1) if i % 2 == 0
+                    else "<span>") + rnd.choice(WORDS) + " "
+            out.append(part)
+            total += len(part)
+            if total >= size:
+                break
+        # only the end of the paragraph closes them
+        out.append("</p>\n<p>")
+    out.append("</p>\n" + tail())
+    return "".join(out)
+
+
+def gen_wide_table(rnd, size, cols=60):
+    """Tables with many columns per row."""
+    out = [head("wide table"), '<table border="1">\n']
+    total = 0
+    while total < size:
+        row = "<tr>" + "".join("<td>%s</td>" % words(rnd, 1)
+                               for _ in range(cols)) + "</tr>\n"
+        out.append(row)
+        total += len(row)
+    out.append("</table>\n" + tail())
+    return "".join(out)
+
+
+def gen_long_text(rnd, size, para=20000):
+    """Few elements with long runs of text."""
+    out = [head("long text")]
+    total = 0
+    while total < size:
+        text = "<p>" + words(rnd, para // 6) + "</p>\n"
+        out.append(text)
+        total += len(text)
+    out.append(tail())
+    return "".join(out)
+
+
+def gen_attributes(rnd, size, atts=12):
+    """Elements with many attributes, quoted and unquoted."""
+    names = ("id", "class", "title", "style", "lang", "dir", "onclick",
+             "onmouseover", "align", "width", "height", "border",
+             "foo", "data-x")
+    out = [head("attributes")]
+    total = 0
+    n = 0
+    while total < size:
+        parts = []
+        for name in rnd.sample(names, min(atts, len(names))):
+            value = "v%d" % n if name == "id" else words(rnd, 2)
+            n += 1
+            if rnd.random() < 0.3 and " " not in value:
+                parts.append("%s=%s" % (name, value))
+            else:
+                parts.append('%s="%s"' % (name, value))
+        elm = "<div %s><img src=\"a%d.png\" alt=a width=10 height=10 " \
+              "border=0></div>\n" % (" ".join(parts), n)
+        out.append(elm)
+        total += len(elm)
+    out.append(tail())
+    return "".join(out)
+
+
+def gen_entities(rnd, size, density=0.5):
+    """Text with a high proportion of entity and character references."""
+    out = [head("entities")]
+    total = 0
+    while total < size:
+        items = [rnd.choice(ENTITIES) if rnd.random() < density
+                 else rnd.choice(WORDS) for _ in range(200)]
+        text = "<p>" + " ".join(items) + " & < ></p>\n"
+        out.append(text)
+        total += len(text)
+    out.append(tail())
+    return "".join(out)
+
+
+def gen_broken(rnd, size, errors=1.0):
+    """Markup that needs heavy repair: misnesting, missing containers,
+    unknown elements, duplicate ids, bad attributes and comments."""
+    fragments = (
+        lambda: "<li>%s" % words(rnd, 3),
+        lambda: "<td>%s<td>%s" % (words(rnd, 1), words(rnd, 1)),
+        lambda: "<b><i>%s</b></i>" % words(rnd, 3),
+        lambda: "<p>%s<div>%s</p></div>" % (words(rnd, 2), words(rnd, 2)),
+        lambda: "<ul>%s<li>%s</ul>" % (words(rnd, 2), words(rnd, 2)),
+        lambda: "<table>%s<tr><td>%s</table>" % (words(rnd, 1),
+                                                 words(rnd, 1)),
+        lambda: "<foo bar=baz>%s</foo>" % words(rnd, 2),
+        lambda: '<a id="dup" href=x.html name=dup>%s' % words(rnd, 2),
+        lambda: "<p align=middle nowrap>%s" % words(rnd, 3),
+        lambda: "<!-- %s -- %s -->" % (words(rnd, 2), words(rnd, 2)),
+        lambda: "</span></div>%s" % words(rnd, 2),
+        lambda: "<font color=red size=+1>%s" % words(rnd, 2),
+    )
+    # no doctype, html, head or body: they have to be inserted
+    out = ["<title>broken</title>\n"]
+    total = 0
+    while total < size:
+        if rnd.random() < errors:
+            frag = rnd.choice(fragments)() + "\n"
+        else:
+            frag = "<p>%s</p>\n" % words(rnd, 5)
+        out.append(frag)
+        total += len(frag)
+    return "".join(out)
+
+
+def gen_latin1(rnd, size, para=60):
+    """Text in ISO-8859-1."""
+    out = [head("latin1", "iso-8859-1")]
+    total = 0
+    vocabulary = WORDS + LATIN1_WORDS
+    while total < size:
+        text = "<p>%s</p>\n" % words(rnd, para, vocabulary)
+        out.append(text)
+        total += len(text)
+    out.append(tail())
+    return "".join(out)
+
+
+def gen_utf16(rnd, size, para=60):
+    """Text in UTF-16 (with byte order mark)."""
+    out = [head("utf16", "utf-16")]
+    total = 0
+    vocabulary = WORDS + LATIN1_WORDS + ["αβγ",
+                                         "日本語", "€"]
+    while total < size:
+        text = "<p>%s</p>\n" % words(rnd, para, vocabulary)
+        out.append(text)
+        total += 2 * len(text)
+    out.append(tail())
+    return "".join(out)
+
+
+# name: (generator, encoding)
+PROFILES = {
+    "deep": (gen_deep, "utf-8"),
+    "unclosed": (gen_unclosed, "utf-8"),
+    "wide-table": (gen_wide_table, "utf-8"),
+    "long-text": (gen_long_text, "utf-8"),
+    "attributes": (gen_attributes, "utf-8"),
+    "entities": (gen_entities, "utf-8"),
+    "broken": (gen_broken, "utf-8"),
+    "latin1": (gen_latin1, "iso-8859-1"),
+    "utf16": (gen_utf16, "utf-16"),
+}
+
+
+def parse_profile(spec):
+    name, _, params = spec.partition(":")
+    if name not in PROFILES:
+        sys.exit("Unknown profile: %s (use --list)" % name)
+    kwargs = {}
+    for param in filter(None, params.split(",")):
+        key, _, value = param.partition("=")
+        kwargs[key] = float(value) if "." in value else int(value)
+    return name, kwargs
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Generate synthetic HTML documents for benchmarking.")
+    parser.add_argument("-o", "--output-dir", default="corpus")
+    parser.add_argument("--size", type=int, default=1024,
+                        help="approximate size of each document in KB")
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--list", action="store_true",
+                        help="list the profiles and exit")
+    parser.add_argument("profiles", nargs="*")
+    args = parser.parse_args()
+
+    if args.list:
+        for name, (gen, encoding) in sorted(PROFILES.items()):
+            defaults = gen.__defaults__ or ()
+            params = gen.__code__.co_varnames[2:2 + len(defaults)]
+            print("%-12s %s (%s) [%s]" % (
+                name, gen.__doc__.split("\n")[0], encoding,
+                ", ".join("%s=%s" % p for p in zip(params, defaults))))
+        return
+
+    os.makedirs(args.output_dir, exist_ok=True)
+    for spec in args.profiles or sorted(PROFILES):
+        name, kwargs = parse_profile(spec)
+        gen, encoding = PROFILES[name]
+        # the same seed always generates the same document
+        rnd = random.Random("%d:%s" % (args.seed, spec))
+        data = gen(rnd, args.size * 1024, **kwargs).encode(encoding)
+        file_name = spec.replace(":", "-").replace(",", "-") \
+                        .replace("=", "") + ".html"
+        with open(os.path.join(args.output_dir, file_name), "wb") as f:
+            f.write(data)
+        print("%s: %d bytes" % (file_name, len(data)))
+
+
+if __name__ == "__main__":
+    main()
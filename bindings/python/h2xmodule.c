@@ -0,0 +1,330 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Jesus Arias Fisteus                             *
+ *   jaf@it.uc3m.es                                                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/*
+ * h2xmodule.c
+ *
+ * CPython extension module "html2xhtml": converts documents in
+ * the calling process through the API of h2x.h, instead of running
+ * the html2xhtml program or calling the web service.
+ *
+ * The converter keeps its state in global variables, so
+ * conversions are serialized by a lock. The GIL is released
+ * while the lock is waited for and during the conversion, so that
+ * other Python threads keep running; for several conversions in
+ * parallel, use processes (e.g. multiprocessing).
+ *
+ * Unrecoverable errors of the converter invoke exit_on_error(),
+ * which here jumps back to convert() and raises html2xhtml.Error.
+ *
+ */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <pythread.h>
+
+#include <setjmp.h>
+#include <string.h>
+
+#include "h2x.h"
+#include "params.h"
+#include "charset.h"
+#include "compress.h"
+#include "dtd_util.h"
+#include "mensajes.h"
+
+static PyObject *h2x_error;
+static PyThread_type_lock h2x_lock;
+
+/* where exit_on_error() returns to, and its message */
+static jmp_buf error_jump;
+static char error_msg[256];
+
+/* the options of convert() */
+typedef struct {
+  int doctype;
+  charset_t *charset_in;
+  charset_t *charset_out;
+  int line_length;
+  int tab_length;
+  int preserve_space_comments;
+  int protect_cdata;
+  int compact_block_elements;
+  int compact_empty_elm_tags;
+  int empty_elm_tags_always;
+  int dos_eol;
+  int no_reflow;
+  int generate_snippet;
+  int binary;
+  int ncr_fallback;
+  char *system_dtd_prefix;
+  int compress;
+  int compress_level;
+} options_t;
+
+static int convert_document(const options_t *opt, const char *input,
+                            size_t len, char **output, size_t *output_len);
+
+
+PyDoc_STRVAR(convert_doc,
+"convert(data, doctype=None, input_charset=None, output_charset=None,\n"
+"        line_length=80, tab_length=2, preserve_space_comments=False,\n"
+"        protect_cdata=True, compact_block_elements=False,\n"
+"        compact_empty_elm_tags=False, empty_elm_tags_always=False,\n"
+"        dos_eol=False, no_reflow=False, generate_snippet=False,\n"
+"        binary=False, system_dtd_prefix=None,\n"
+"        ncr_fallback=False, compress=None, compress_level=-1) -> bytes\n"
+"\n"
+"Convert the HTML document 'data' (bytes) to XHTML and return the\n"
+"output document. The options are those of the html2xhtml program:\n"
+"'doctype' is one of the keys of DOCTYPES (detected from the input\n"
+"by default), the charsets default to the one detected in the input,\n"
+"and 'binary' returns the tree in the binary format of h2xbin.h.\n"
+"With 'compress' ('gzip' or 'zstd') the output is compressed, with\n"
+"'compress_level' (-1 for the default level of the format);\n"
+"compressed input is always detected and decompressed.\n"
+"Warnings are written to stderr. Raises html2xhtml.Error if the\n"
+"document cannot be converted.");
+
+static PyObject *convert(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+  static char *keywords[] = {
+    "data", "doctype", "input_charset", "output_charset",
+    "line_length", "tab_length", "preserve_space_comments",
+    "protect_cdata", "compact_block_elements", "compact_empty_elm_tags",
+    "empty_elm_tags_always", "dos_eol", "no_reflow", "generate_snippet",
+    "binary", "system_dtd_prefix", "ncr_fallback", "compress",
+    "compress_level", NULL
+  };
+  Py_buffer data;
+  const char *doctype = NULL;
+  const char *charset_in = NULL;
+  const char *charset_out = NULL;
+  const char *compress = NULL;
+  options_t opt;
+  char *output = NULL;
+  size_t output_len = 0;
+  int result;
+  PyObject *ret;
+
+  memset(&opt, 0, sizeof(opt));
+  opt.line_length = 80;
+  opt.tab_length = 2;
+  opt.protect_cdata = 1;
+  opt.compress_level = -1;
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "y*|zzziipppppppppzpzi",
+                                   keywords, &data, &doctype,
+                                   &charset_in, &charset_out,
+                                   &opt.line_length, &opt.tab_length,
+                                   &opt.preserve_space_comments,
+                                   &opt.protect_cdata,
+                                   &opt.compact_block_elements,
+                                   &opt.compact_empty_elm_tags,
+                                   &opt.empty_elm_tags_always,
+                                   &opt.dos_eol, &opt.no_reflow,
+                                   &opt.generate_snippet, &opt.binary,
+                                   &opt.system_dtd_prefix,
+                                   &opt.ncr_fallback, &compress,
+                                   &opt.compress_level))
+    return NULL;
+
+  /* the same checks as the command line program */
+  opt.doctype = doctype ? dtd_get_dtd_index(doctype) : -1;
+  if (doctype && opt.doctype < 0) {
+    PyErr_Format(PyExc_ValueError, "unknown doctype key: %s", doctype);
+    goto error;
+  }
+  opt.charset_in = charset_in ? charset_lookup_alias(charset_in) : NULL;
+  opt.charset_out = charset_out ? charset_lookup_alias(charset_out) : NULL;
+  if ((charset_in && !opt.charset_in) || (charset_out && !opt.charset_out)) {
+    PyErr_Format(PyExc_ValueError, "unsupported character set: %s",
+                 charset_in && !opt.charset_in ? charset_in : charset_out);
+    goto error;
+  }
+  if (!compress || !strcmp(compress, "none"))
+    opt.compress = COMPRESS_NONE;
+  else if (!strcmp(compress, "gzip"))
+    opt.compress = COMPRESS_GZIP;
+  else if (!strcmp(compress, "zstd"))
+    opt.compress = COMPRESS_ZSTD;
+  else {
+    PyErr_Format(PyExc_ValueError, "unknown compression format: %s",
+                 compress);
+    goto error;
+  }
+  if (!compress_available(opt.compress)) {
+    PyErr_Format(PyExc_ValueError, "compression format not available: %s",
+                 compress);
+    goto error;
+  }
+  if (opt.line_length < 40 || opt.tab_length < 0 || opt.tab_length > 16) {
+    PyErr_SetString(PyExc_ValueError,
+                    "line_length must be >= 40 and tab_length in 0..16");
+    goto error;
+  }
+
+  Py_BEGIN_ALLOW_THREADS
+  PyThread_acquire_lock(h2x_lock, WAIT_LOCK);
+  result = convert_document(&opt, (const char *) data.buf, data.len,
+                            &output, &output_len);
+  PyThread_release_lock(h2x_lock);
+  Py_END_ALLOW_THREADS
+
+  PyBuffer_Release(&data);
+  if (result < 0) {
+    PyErr_SetString(h2x_error, error_msg);
+    return NULL;
+  }
+  if (!output)
+    return PyErr_NoMemory();
+
+  ret = PyBytes_FromStringAndSize(output, output_len);
+  free(output);
+  return ret;
+
+ error:
+  PyBuffer_Release(&data);
+  return NULL;
+}
+
+/*
+ * Runs a conversion with the lock held and the GIL released: it
+ * must not use the Python API. The output is left in a buffer
+ * allocated with malloc(), or null if there is not enough memory.
+ * Returns 0, or -1 with the message in error_msg.
+ *
+ */
+static int convert_document(const options_t *opt, const char *input,
+                            size_t len, char **output, size_t *output_len)
+{
+  h2x_ctx_t *volatile ctx = NULL;
+  const char *out;
+
+  if (setjmp(error_jump)) {
+    /* the conversion was aborted: leave the converter ready */
+    charset_close();
+    if (ctx)
+      h2x_free(ctx);
+    return -1;
+  }
+
+  params_set_defaults();
+  param_doctype = opt->doctype;
+  param_charset_in = opt->charset_in;
+  param_charset_out = opt->charset_out;
+  param_chars_per_line = opt->line_length;
+  param_tab_len = opt->tab_length;
+  param_pre_comments = opt->preserve_space_comments;
+  param_protect_cdata = opt->protect_cdata;
+  param_compact_block_elms = opt->compact_block_elements;
+  param_compact_empty_elm_tags = opt->compact_empty_elm_tags;
+  param_empty_tags = opt->empty_elm_tags_always;
+  param_crlf_eol = opt->dos_eol;
+  param_no_reflow = opt->no_reflow;
+  param_generate_snippet = opt->generate_snippet;
+  param_binary_output = opt->binary;
+  param_system_dtd_prefix = opt->system_dtd_prefix;
+  param_ncr_fallback = opt->ncr_fallback;
+  param_compress = opt->compress;
+  param_compress_level = opt->compress_level;
+
+  ctx = h2x_new(NULL);
+  if (!ctx) {
+    strcpy(error_msg, "Could not start the conversion");
+    return -1;
+  }
+  if (h2x_convert(ctx, input, len)) {
+    h2x_free(ctx);
+    strcpy(error_msg, "Unrecoverable parse error");
+    return -1;
+  }
+
+  out = h2x_output(ctx, output_len);
+  *output = (char *) malloc(*output_len ? *output_len : 1);
+  if (*output)
+    memcpy(*output, out, *output_len);
+  h2x_free(ctx);
+
+  return 0;
+}
+
+/*
+ * Error handler of the converter (see mensajes.h)
+ *
+ */
+void exit_on_error(char *msg)
+{
+  snprintf(error_msg, sizeof(error_msg), "%s [line %d]",
+           msg, parser_num_linea);
+  longjmp(error_jump, 1);
+}
+
+static PyMethodDef h2x_methods[] = {
+  {"convert", (PyCFunction) convert, METH_VARARGS | METH_KEYWORDS,
+   convert_doc},
+  {NULL, NULL, 0, NULL}
+};
+
+PyDoc_STRVAR(module_doc,
+"In-process binding of the html2xhtml converter.");
+
+static struct PyModuleDef h2x_module = {
+  PyModuleDef_HEAD_INIT, "html2xhtml", module_doc, -1, h2x_methods
+};
+
+PyMODINIT_FUNC PyInit_html2xhtml(void)
+{
+  PyObject *m;
+  PyObject *keys;
+  int i;
+
+  h2x_lock = PyThread_allocate_lock();
+  if (!h2x_lock)
+    return PyErr_NoMemory();
+
+  m = PyModule_Create(&h2x_module);
+  if (!m)
+    return NULL;
+
+  h2x_error = PyErr_NewException("html2xhtml.Error", NULL, NULL);
+  Py_XINCREF(h2x_error);
+  if (PyModule_AddObject(m, "Error", h2x_error) < 0)
+    goto error;
+
+  keys = PyTuple_New(XHTML_NUM_DTDS);
+  if (!keys)
+    goto error;
+  for (i = 0; i < XHTML_NUM_DTDS; i++)
+    PyTuple_SET_ITEM(keys, i, PyUnicode_FromString(dtd_key[i]));
+  if (PyModule_AddObject(m, "DOCTYPES", keys) < 0) {
+    Py_DECREF(keys);
+    goto error;
+  }
+  if (PyModule_AddStringConstant(m, "VERSION", VERSION) < 0)
+    goto error;
+
+  return m;
+
+ error:
+  Py_XDECREF(h2x_error);
+  Py_DECREF(m);
+  return NULL;
+}
@@ -0,0 +1,70 @@
+#
+# Build script of the in-process Python binding of html2xhtml.
+#
+# The converter must have been configured and built first (it needs
+# config.h and the sources generated from html.l and htmlgr.y):
+#
+#   ./configure && make
+#   cd bindings/python
+#   python3 setup.py build_ext --inplace
+#   python3 -m unittest -v test_html2xhtml
+#
+# Its sources are compiled into the module, because the libh2x
+# convenience library is not built as position-independent code.
+# H2X_BUILD_DIR may point to the build directory when it is not
+# the source directory.
+#
+
+import os
+import re
+from setuptools import setup, Extension
+
+here = os.path.dirname(os.path.abspath(__file__))
+top_srcdir = os.path.normpath(os.path.join(here, '..', '..'))
+top_builddir = os.environ.get('H2X_BUILD_DIR', top_srcdir)
+
+
+def converter_sources():
+    """The sources of libh2x, as listed in src/Makefile.am."""
+    with open(os.path.join(top_srcdir, 'src', 'Makefile.am')) as f:
+        makefile = f.read().replace('\\\n', ' ')
+    names = re.search(r'^libh2x_la_SOURCES\s*=(.*)$', makefile, re.M)
+    sources = []
+    for name in names.group(1).split():
+        name = re.sub(r'\.[ly]$', '.c', name)
+        builddir_name = os.path.join(top_builddir, 'src', name)
+        if os.path.exists(builddir_name):
+            sources.append(builddir_name)
+        else:
+            sources.append(os.path.join(top_srcdir, 'src', name))
+    return sources
+
+
+def configured_libraries():
+    """The optional libraries found by configure (see config.h)."""
+    libraries = ['pthread']
+    with open(os.path.join(top_builddir, 'config.h')) as f:
+        config = f.read()
+    for macro, library in (('HAVE_LIBZ', 'z'), ('HAVE_LIBZSTD', 'zstd')):
+        if re.search(r'^#define %s 1$' % macro, config, re.M):
+            libraries.append(library)
+    return libraries
+
+
+setup(
+    name='html2xhtml',
+    version='1.4',
+    description='In-process binding of the html2xhtml converter',
+    ext_modules=[
+        Extension(
+            'html2xhtml',
+            sources=['h2xmodule.c'] + converter_sources(),
+            include_dirs=[os.path.join(top_builddir, 'src'),
+                          os.path.join(top_srcdir, 'src'),
+                          top_builddir],
+            define_macros=[('HAVE_CONFIG_H', None)],
+            extra_compile_args=['-std=c99'],
+            libraries=configured_libraries(),
+        ),
+    ],
+)
@@ -0,0 +1,140 @@
+#
+# Tests of the in-process Python binding of html2xhtml. They do not
+# need network access nor the html2xhtml program. Run them after
+# building the module (see setup.py):
+#
+#   python3 -m unittest -v test_html2xhtml
+#
+
+import gzip
+import struct
+import threading
+import unittest
+
+import html2xhtml
+
+DOCUMENT = (b'<html><head><title>Test</title></head>\n'
+            b'<body><p align=center>Caf\xe9 &amp; <b>bar<p>next</body>')
+
+
+class ConvertTest(unittest.TestCase):
+
+    def test_converts_to_xhtml(self):
+        out = html2xhtml.convert(DOCUMENT, doctype='transitional')
+        self.assertIsInstance(out, bytes)
+        self.assertTrue(out.startswith(b'<?xml version="1.0"'))
+        self.assertIn(b'XHTML 1.0 Transitional', out)
+        self.assertIn(b'<p align="center">', out)
+        self.assertIn(b'<b>bar</b>', out)
+
+    def test_doctypes(self):
+        self.assertIn('strict', html2xhtml.DOCTYPES)
+        for key in html2xhtml.DOCTYPES:
+            out = html2xhtml.convert(DOCUMENT, doctype=key)
+            self.assertTrue(out.startswith(b'<?xml'), key)
+
+    def test_accepts_buffers(self):
+        self.assertEqual(html2xhtml.convert(bytearray(DOCUMENT)),
+                         html2xhtml.convert(DOCUMENT))
+        self.assertEqual(html2xhtml.convert(memoryview(DOCUMENT)),
+                         html2xhtml.convert(DOCUMENT))
+
+    def test_charsets(self):
+        out = html2xhtml.convert(DOCUMENT, input_charset='iso-8859-1',
+                                 output_charset='utf-8')
+        self.assertIn(b'encoding="utf-8"', out.lower())
+        self.assertIn('Café'.encode('utf-8'), out)
+
+    def test_ncr_fallback(self):
+        data = '<p>\u20ac 10</p>'.encode('utf-8')
+        out = html2xhtml.convert(data, input_charset='utf-8',
+                                 output_charset='iso-8859-1',
+                                 ncr_fallback=True)
+        self.assertIn(b'&#8364; 10', out)
+
+    def test_options(self):
+        out = html2xhtml.convert(DOCUMENT, generate_snippet=True)
+        self.assertFalse(out.startswith(b'<?xml'))
+        self.assertNotIn(b'<body', out)
+        out = html2xhtml.convert(DOCUMENT, dos_eol=True)
+        self.assertIn(b'\r\n', out)
+        out = html2xhtml.convert(DOCUMENT, no_reflow=True, tab_length=8)
+        self.assertNotIn(b'\n        <', out)
+
+    def test_compressed_streams(self):
+        out = html2xhtml.convert(DOCUMENT)
+        self.assertEqual(html2xhtml.convert(gzip.compress(DOCUMENT)), out)
+        compressed = html2xhtml.convert(DOCUMENT, compress='gzip',
+                                        compress_level=9)
+        self.assertEqual(gzip.decompress(compressed), out)
+        stored = html2xhtml.convert(DOCUMENT, compress='gzip',
+                                    compress_level=0)
+        self.assertEqual(gzip.decompress(stored), out)
+        self.assertGreater(len(stored), len(out))
+        with self.assertRaises(ValueError):
+            html2xhtml.convert(DOCUMENT, compress='lzma')
+
+    def test_binary_output(self):
+        out = html2xhtml.convert(DOCUMENT, doctype='strict', binary=True)
+        self.assertEqual(out[:4], b'H2XB')
+        self.assertEqual(struct.unpack('<H', out[4:6])[0], 1)
+        self.assertEqual(out[9:9 + out[8]], b'strict')
+        self.assertEqual(out[-1:], b'\x00')
+
+    def test_error(self):
+        # too short to detect its charset
+        with self.assertRaises(html2xhtml.Error):
+            html2xhtml.convert(b'<p>')
+        # the converter is still usable
+        self.assertIn(b'<html', html2xhtml.convert(DOCUMENT))
+
+    def test_bad_arguments(self):
+        with self.assertRaises(TypeError):
+            html2xhtml.convert('text, not bytes')
+        with self.assertRaises(ValueError):
+            html2xhtml.convert(DOCUMENT, doctype='no-such-doctype')
+        with self.assertRaises(ValueError):
+            html2xhtml.convert(DOCUMENT, output_charset='no-such-charset')
+        with self.assertRaises(ValueError):
+            html2xhtml.convert(DOCUMENT, line_length=10)
+
+    def test_threads(self):
+        documents = [b'<html><body>' + b'<p>paragraph <i>%d' % i * i
+                     for i in range(1, 30)]
+        expected = [html2xhtml.convert(d) for d in documents]
+        results = {}
+
+        def worker(first):
+            for i in range(first, len(documents), 4):
+                results[i] = html2xhtml.convert(documents[i])
+
+        threads = [threading.Thread(target=worker, args=(i,))
+                   for i in range(4)]
+        for t in threads:
+            t.start()
+        for t in threads:
+            t.join()
+        self.assertEqual([results[i] for i in range(len(documents))],
+                         expected)
+
+    def test_releases_gil(self):
+        # other threads run while a long document is being converted
+        document = b'<html><body>' + b'<p>paragraph <b>bold</b>\n' * 5000
+        done = threading.Event()
+        ticks = 0
+
+        def worker():
+            html2xhtml.convert(document)
+            done.set()
+
+        thread = threading.Thread(target=worker)
+        thread.start()
+        while not done.is_set():
+            ticks += 1
+            done.wait(0.001)
+        thread.join()
+        self.assertGreater(ticks, 10)
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -479,6 +479,7 @@ class ElmDecl {
 class DTDDeclHandler implements DeclHandler {
 
     private Vector<String> entities = new Vector<String>();
+    private Vector<Integer> entityCodes = new Vector<Integer>();
     private Vector<ElmDecl> elements = new Vector<ElmDecl>();
     private Vector<AttDecl> attributes = new Vector<AttDecl>();
     private int dtd = 0;
@@ -579,10 +580,30 @@ class DTDDeclHandler implements DeclHandler {
 //      System.err.println("internalEntityDecl: ");
 //      System.err.println("   "+name+": "+value+" ["+"]");
 
-        /* store only the name of the entity */
+        /* store the name of the entity and the character it stands for */
         if (name.charAt(0) != '%')
-          if (entities.indexOf(name) == -1)
+          if (entities.indexOf(name) == -1) {
             entities.add(name);
+            entityCodes.add(new Integer(entityCode(value)));
+          }
+    }
+
+    /**
+     * Returns the character of the replacement text of an entity,
+     * which is either the character itself or, for the entities that
+     * stand for markup characters (e.g. lt), a character reference.
+     * Returns 0 if the entity is not a single character.
+     */
+    private static int entityCode(String value) {
+        if (value.startsWith("&#x") && value.endsWith(";"))
+            return Integer.parseInt(value.substring(3, value.length() - 1),
+                                    16);
+        if (value.startsWith("&#") && value.endsWith(";"))
+            return Integer.parseInt(value.substring(2, value.length() - 1));
+        if (value.length() > 0
+            && value.length() == Character.charCount(value.codePointAt(0)))
+            return value.codePointAt(0);
+        return 0;
     }
 
     public void externalEntityDecl(String name, String publicId,
@@ -721,6 +742,7 @@ class DTDDeclHandler implements DeclHandler {
 
         boolean comma = false;
         int[] hashTable = new int[256];
+        int[] order = new int[entities.size()];
 
         for (int k = 0, pos = 0; k < 256; k++) {
             hashTable[k] = pos;
@@ -729,6 +751,7 @@ class DTDDeclHandler implements DeclHandler {
                     if (comma) out.println(",");
                     else out.println("");
                     comma = true;
+                    order[pos] = i;
                     pos++;
                     out.print ("    \"" + entities.elementAt(i) + "\"  /*" +
                                hashValue[i] + '*' + "/");
@@ -738,6 +761,19 @@ class DTDDeclHandler implements DeclHandler {
         out.println("");
         out.println("};");
 
+        // print the characters, in the order of ent_list
+        out.println("/* characters of the entities (0 if not a character) */");
+        out.print("int ent_code[" + entities.size() + "]= {");
+        for (int i = 0; i < entities.size(); i++) {
+            if ((i & 0x7) == 0) out.println("");
+            String ns = String.valueOf(entityCodes.elementAt(order[i]));
+            while (ns.length() < 5) ns = " " + ns;
+
+            if (i == 0) out.print(" " + ns);
+            else out.print("," + ns);
+        }
+        out.println("};\n");
+
         // print the hash table
         out.println("/* hash table for entities */");
         out.print("int ent_hash[257]= {");
@@ -880,7 +916,8 @@ class DTDDeclHandler implements DeclHandler {
         out.println("extern unsigned char att_buffer[];\n");
 
         out.println("extern int ent_hash[257];");
-        out.println("extern char ent_list[][" + entMaxLen + "];\n");
+        out.println("extern char ent_list[][" + entMaxLen + "];");
+        out.println("extern int ent_code[];\n");
 
         /* key elements and attributes */
         for (int i = 0; i < listKeyElms.length; i++)
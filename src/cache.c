@@ -0,0 +1,501 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Jesus Arias Fisteus                             *
+ *   jaf@it.uc3m.es                                                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/*
+ * cache.c
+ * 
+ * Content-addressed on-disk cache of conversions (see cache.h).
+ *
+ * Every entry is a file named after the hexadecimal SHA-256 key
+ * of the conversion, with the ".h2x" extension, in the directory
+ * param_cache_dir. It contains a header (see entry_header_t)
+ * followed by the output bytes.
+ *
+ * Entries are written to a temporary file that is then renamed,
+ * so that other processes never see partial entries. Reading an
+ * entry updates its modification time, which is used to evict
+ * the least recently used entries when the total size of the
+ * cache exceeds param_cache_size.
+ *
+ */
+
+/* included first to define _GNU_SOURCE if necessary */
+#include "xchar.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <utime.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "cache.h"
+#include "params.h"
+#include "mensajes.h"
+#include "dtd.h"
+
+#define CACHE_MAGIC     "h2xcach2"
+#define CACHE_EXT       ".h2x"
+#define CACHE_TMP       "tmp."
+#define KEY_HEX_LEN     64
+
+/* temporary files older than this (seconds) are considered stale */
+#define CACHE_TMP_MAX_AGE 3600
+
+typedef struct {
+  char magic[8];
+  int num_warning;
+  int num_inform;
+  unsigned long code_count[MSG_NUM_CODES];
+  unsigned long long output_len;
+} entry_header_t;
+
+typedef struct {
+  char *name;
+  time_t mtime;
+  off_t size;
+} cache_entry_t;
+
+/* SHA-256 state */
+typedef struct {
+  unsigned int h[8];
+  unsigned char block[64];
+  size_t block_len;
+  unsigned long long total_len;
+} sha256_t;
+
+static char key_hex[KEY_HEX_LEN + 1];
+
+static char *entry_path(const char *name);
+static void cache_evict(void);
+static int compare_entries(const void *e1, const void *e2);
+static void sha256_init(sha256_t *s);
+static void sha256_update(sha256_t *s, const void *data, size_t len);
+static void sha256_final(sha256_t *s, unsigned char digest[32]);
+static void sha256_block(sha256_t *s, const unsigned char *p);
+static void hash_int(sha256_t *s, int value);
+static void hash_str(sha256_t *s, const char *str);
+
+void cache_set_key(const char *input, size_t len)
+{
+  sha256_t s;
+  unsigned char digest[32];
+  int i;
+
+  sha256_init(&s);
+
+  /* the version of the program and of the DTDs */
+  hash_str(&s, VERSION);
+  hash_str(&s, DTD_SNAPSHOT_DATE);
+
+  /* every parameter that affects the output */
+  hash_int(&s, param_strict);
+  hash_int(&s, param_doctype);
+  hash_int(&s, param_chars_per_line);
+  hash_int(&s, param_tab_len);
+  hash_int(&s, param_pre_comments);
+  hash_int(&s, param_protect_cdata);
+  hash_int(&s, param_cgi_html_output);
+  hash_int(&s, param_compact_block_elms);
+  hash_int(&s, param_compact_empty_elm_tags);
+  hash_int(&s, param_empty_tags);
+  hash_int(&s, param_crlf_eol);
+  hash_int(&s, param_generate_snippet);
+  hash_int(&s, param_no_reflow);
+  hash_int(&s, param_binary_output);
+  hash_int(&s, param_ncr_fallback);
+  hash_int(&s, param_compress);
+  hash_int(&s, param_compress_level);
+  hash_str(&s, param_charset_in ? param_charset_in->preferred_name : NULL);
+  hash_str(&s, param_charset_out ? param_charset_out->preferred_name : NULL);
+  hash_str(&s, param_system_dtd_prefix);
+
+  /* the input document */
+  sha256_update(&s, input, len);
+  sha256_final(&s, digest);
+
+  for (i = 0; i < 32; i++)
+    sprintf(&key_hex[2 * i], "%02x", digest[i]);
+}
+
+int cache_lookup(FILE *output)
+{
+  FILE *f;
+  entry_header_t header;
+  char *path;
+  char buf[8192];
+  unsigned long long left;
+  size_t n;
+
+  path = entry_path(key_hex);
+  f = fopen(path, "rb");
+  if (!f)
+    return 0;
+
+  if (fread(&header, sizeof(header), 1, f) != 1
+      || memcmp(header.magic, CACHE_MAGIC, sizeof(header.magic))) {
+    fclose(f);
+    return 0;
+  }
+
+  /* check that the entry is complete before writing anything */
+  if (fseek(f, 0, SEEK_END) 
+      || (unsigned long long) ftell(f) != sizeof(header) + header.output_len
+      || fseek(f, sizeof(header), SEEK_SET)) {
+    fclose(f);
+    return 0;
+  }
+
+  for (left = header.output_len; left > 0; left -= n) {
+    n = left < sizeof(buf) ? left : sizeof(buf);
+    if (fread(buf, 1, n, f) != n) {
+      fclose(f);
+      EXIT("Error reading an entry of the cache");
+    }
+    if (fwrite(buf, 1, n, output) != n) {
+      perror("fwrite()");
+      fclose(f);
+      EXIT("Error writing a data block to the output");
+    }
+  }
+  fclose(f);
+
+  /* mark it as recently used */
+  utime(path, NULL);
+
+  num_warning = header.num_warning;
+  num_inform = header.num_inform;
+  messages_set_counts(header.code_count);
+
+  return 1;
+}
+
+void cache_store(const char *output, size_t len)
+{
+  static int tmp_count = 0;
+  entry_header_t header;
+  char tmp_name[64];
+  char *tmp_path;
+  char *path;
+  FILE *f;
+  int fd;
+
+  /* do not store entries that could not fit in the cache */
+  if (sizeof(header) + len > param_cache_size)
+    return;
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+  header.num_warning = num_warning;
+  header.num_inform = num_inform;
+  messages_get_counts(header.code_count);
+  header.output_len = len;
+
+  sprintf(tmp_name, CACHE_TMP "%ld.%d", (long) getpid(), tmp_count++);
+  tmp_path = strdup(entry_path(tmp_name));
+  if (!tmp_path)
+    return;
+
+  fd = open(tmp_path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+  f = fd >= 0 ? fdopen(fd, "wb") : NULL;
+  if (!f) {
+    if (fd >= 0)
+      close(fd);
+    WARNING(MSG_CACHE, "Could not create a cache entry");
+    free(tmp_path);
+    return;
+  }
+
+  if (fwrite(&header, sizeof(header), 1, f) != 1
+      || fwrite(output, 1, len, f) != len) {
+    fclose(f);
+    unlink(tmp_path);
+    WARNING(MSG_CACHE, "Could not write a cache entry");
+    free(tmp_path);
+    return;
+  }
+
+  path = entry_path(key_hex);
+  if (fclose(f) || rename(tmp_path, path)) {
+    unlink(tmp_path);
+    WARNING(MSG_CACHE, "Could not write a cache entry");
+  }
+  free(tmp_path);
+
+  cache_evict();
+}
+
+
+/*
+ * -------------------------------------------------------------------
+ * internal functions
+ * -------------------------------------------------------------------
+ *
+ */
+
+/*
+ * Returns the path of the given entry name (the key, or the name of
+ * a temporary file). The result is overwritten in the next call.
+ *
+ */
+static char *entry_path(const char *name)
+{
+  static char *path = NULL;
+  static size_t path_size = 0;
+  size_t len;
+
+  len = strlen(param_cache_dir) + strlen(name) + strlen(CACHE_EXT) + 2;
+  if (len > path_size) {
+    free(path);
+    path = (char *) malloc(len);
+    if (!path)
+      EXIT("Not enough memory");
+    path_size = len;
+  }
+
+  if (strncmp(name, CACHE_TMP, strlen(CACHE_TMP)))
+    sprintf(path, "%s/%s%s", param_cache_dir, name, CACHE_EXT);
+  else
+    sprintf(path, "%s/%s", param_cache_dir, name);
+
+  return path;
+}
+
+/*
+ * Removes the least recently used entries until the size of
+ * the cache is not over param_cache_size, as well as stale
+ * temporary files left by processes that did not finish.
+ *
+ */
+static void cache_evict(void)
+{
+  DIR *dir;
+  struct dirent *d;
+  struct stat st;
+  cache_entry_t *entries = NULL;
+  cache_entry_t *new_entries;
+  size_t num_entries = 0;
+  size_t max_entries = 0;
+  unsigned long long total = 0;
+  size_t name_len;
+  size_t ext_len = strlen(CACHE_EXT);
+  time_t now = time(NULL);
+  size_t i;
+
+  dir = opendir(param_cache_dir);
+  if (!dir)
+    return;
+
+  while ((d = readdir(dir)) != NULL) {
+    name_len = strlen(d->d_name);
+
+    if (!strncmp(d->d_name, CACHE_TMP, strlen(CACHE_TMP))) {
+      if (!stat(entry_path(d->d_name), &st)
+          && now - st.st_mtime > CACHE_TMP_MAX_AGE)
+        unlink(entry_path(d->d_name));
+      continue;
+    }
+
+    if (name_len != KEY_HEX_LEN + ext_len
+        || strcmp(&d->d_name[KEY_HEX_LEN], CACHE_EXT))
+      continue;
+
+    /* entry_path appends the extension to the key */
+    d->d_name[KEY_HEX_LEN] = 0;
+    if (stat(entry_path(d->d_name), &st))
+      continue;
+
+    if (num_entries == max_entries) {
+      max_entries = max_entries ? 2 * max_entries : 256;
+      new_entries = (cache_entry_t *) 
+        realloc(entries, max_entries * sizeof(cache_entry_t));
+      if (!new_entries)
+        break;
+      entries = new_entries;
+    }
+    entries[num_entries].name = strdup(d->d_name);
+    if (!entries[num_entries].name)
+      break;
+    entries[num_entries].mtime = st.st_mtime;
+    entries[num_entries].size = st.st_size;
+    total += st.st_size;
+    num_entries++;
+  }
+  closedir(dir);
+
+  if (total > param_cache_size) {
+    /* the least recently used first */
+    qsort(entries, num_entries, sizeof(cache_entry_t), compare_entries);
+    for (i = 0; i < num_entries && total > param_cache_size; i++) {
+      unlink(entry_path(entries[i].name));
+      total -= entries[i].size;
+    }
+  }
+
+  for (i = 0; i < num_entries; i++)
+    free(entries[i].name);
+  free(entries);
+}
+
+static int compare_entries(const void *e1, const void *e2)
+{
+  time_t t1 = ((const cache_entry_t *) e1)->mtime;
+  time_t t2 = ((const cache_entry_t *) e2)->mtime;
+
+  return t1 < t2 ? -1 : (t1 > t2 ? 1 : 0);
+}
+
+static void hash_int(sha256_t *s, int value)
+{
+  unsigned char buf[4];
+
+  buf[0] = (unsigned char) (value >> 24);
+  buf[1] = (unsigned char) (value >> 16);
+  buf[2] = (unsigned char) (value >> 8);
+  buf[3] = (unsigned char) value;
+  sha256_update(s, buf, 4);
+}
+
+/* the terminating 0 is hashed too, so that strings are delimited */
+static void hash_str(sha256_t *s, const char *str)
+{
+  if (str)
+    sha256_update(s, str, strlen(str) + 1);
+  else
+    sha256_update(s, "\xff", 1);
+}
+
+
+/*
+ * SHA-256 (FIPS 180-4)
+ *
+ */
+
+static const unsigned int sha256_k[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+  0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+  0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+  0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+  0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+  0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+  0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+  0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+  0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void sha256_init(sha256_t *s)
+{
+  s->h[0] = 0x6a09e667;
+  s->h[1] = 0xbb67ae85;
+  s->h[2] = 0x3c6ef372;
+  s->h[3] = 0xa54ff53a;
+  s->h[4] = 0x510e527f;
+  s->h[5] = 0x9b05688c;
+  s->h[6] = 0x1f83d9ab;
+  s->h[7] = 0x5be0cd19;
+  s->block_len = 0;
+  s->total_len = 0;
+}
+
+static void sha256_update(sha256_t *s, const void *data, size_t len)
+{
+  const unsigned char *p = (const unsigned char *) data;
+  size_t n;
+
+  s->total_len += len;
+
+  if (s->block_len > 0) {
+    n = 64 - s->block_len;
+    if (n > len)
+      n = len;
+    memcpy(&s->block[s->block_len], p, n);
+    s->block_len += n;
+    p += n;
+    len -= n;
+    if (s->block_len < 64)
+      return;
+    sha256_block(s, s->block);
+    s->block_len = 0;
+  }
+
+  for ( ; len >= 64; p += 64, len -= 64)
+    sha256_block(s, p);
+
+  memcpy(s->block, p, len);
+  s->block_len = len;
+}
+
+static void sha256_final(sha256_t *s, unsigned char digest[32])
+{
+  unsigned long long bits = s->total_len * 8;
+  int i;
+
+  s->block[s->block_len++] = 0x80;
+  if (s->block_len > 56) {
+    memset(&s->block[s->block_len], 0, 64 - s->block_len);
+    sha256_block(s, s->block);
+    s->block_len = 0;
+  }
+  memset(&s->block[s->block_len], 0, 56 - s->block_len);
+  for (i = 0; i < 8; i++)
+    s->block[56 + i] = (unsigned char) (bits >> (56 - 8 * i));
+  sha256_block(s, s->block);
+
+  for (i = 0; i < 32; i++)
+    digest[i] = (unsigned char) (s->h[i / 4] >> (24 - 8 * (i % 4)));
+}
+
+static void sha256_block(sha256_t *s, const unsigned char *p)
+{
+  unsigned int w[64];
+  unsigned int a, b, c, d, e, f, g, h, t1, t2;
+  int i;
+
+  for (i = 0; i < 16; i++)
+    w[i] = ((unsigned int) p[4 * i] << 24) | ((unsigned int) p[4 * i + 1] << 16)
+      | ((unsigned int) p[4 * i + 2] << 8) | (unsigned int) p[4 * i + 3];
+  for (i = 16; i < 64; i++)
+    w[i] = (ROTR(w[i - 2], 17) ^ ROTR(w[i - 2], 19) ^ (w[i - 2] >> 10))
+      + w[i - 7]
+      + (ROTR(w[i - 15], 7) ^ ROTR(w[i - 15], 18) ^ (w[i - 15] >> 3))
+      + w[i - 16];
+
+  a = s->h[0]; b = s->h[1]; c = s->h[2]; d = s->h[3];
+  e = s->h[4]; f = s->h[5]; g = s->h[6]; h = s->h[7];
+
+  for (i = 0; i < 64; i++) {
+    t1 = h + (ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25)) + ((e & f) ^ (~e & g))
+      + sha256_k[i] + w[i];
+    t2 = (ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+    h = g; g = f; f = e; e = d + t1;
+    d = c; c = b; b = a; a = t1 + t2;
+  }
+
+  s->h[0] += a; s->h[1] += b; s->h[2] += c; s->h[3] += d;
+  s->h[4] += e; s->h[5] += f; s->h[6] += g; s->h[7] += h;
+}
@@ -0,0 +1,63 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Jesus Arias Fisteus                             *
+ *   jaf@it.uc3m.es                                                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/*
+ * cache.h
+ * 
+ * Content-addressed on-disk cache of conversions. Entries are
+ * keyed by a hash of the input bytes and of every parameter
+ * that affects the output (see params.h). Each entry stores
+ * the final output and the number of warnings of each kind
+ * it produced.
+ *
+ */
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdio.h>
+
+/*
+ * Computes the key of the conversion of the 'len' bytes at
+ * 'input' with the current parameters. Must be invoked after
+ * the parameters have been set and before cache_lookup()
+ * and cache_store().
+ *
+ */
+void cache_set_key(const char *input, size_t len);
+
+/*
+ * Looks for the current key in the cache. If found, writes the
+ * stored output to 'output', restores the warning counters and
+ * returns 1. Otherwise, returns 0.
+ *
+ */
+int cache_lookup(FILE *output);
+
+/*
+ * Stores in the cache the output of the conversion of the current
+ * key, along with the current warning counters. Afterwards, the
+ * oldest entries are evicted if the cache is over its size limit.
+ * Errors are not fatal: the entry is not stored.
+ *
+ */
+void cache_store(const char *output, size_t len);
+
+#endif
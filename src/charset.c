@@ -35,11 +35,14 @@
 #include <errno.h>
 #include <string.h>
 #include <ctype.h>
+#include <stdint.h>
 
 #include "charset.h"
+#include "compress.h"
 #include "mensajes.h"
 #include "tree.h"
 #include "params.h"
+#include "stats.h"
 
 static iconv_t cd;
 static FILE *file;
@@ -48,8 +51,406 @@ static char *bufferpos;
 static size_t avail;
 static enum {closed, finished, eof, input, output, preload} state = closed;
 
+/* encoder of the output: iconv, or a native one (see encode_8bit
+ * and encode_utf) */
+static enum {enc_iconv, enc_latin1, enc_ascii, enc_utf} encoder = enc_iconv;
+
+/* decoder of the input: iconv, or a native one (see decode_utf) */
+static enum {dec_iconv, dec_utf} decoder = dec_iconv;
+
+/* state of the native UTF-16 and UTF-32 / UCS-4 coders */
+static size_t utf_unit;         /* bytes per code unit: 2 or 4 */
+static int utf_big_endian;
+static int utf_read_bom;        /* the input may begin with a BOM */
+static int utf_ascii_offset;    /* position of the low byte in a unit */
+static uint64_t utf_ascii_mask; /* non-ASCII bits of 8 input bytes */
+
+/* input from memory instead of from file (see charset_set_input_memory) */
+static const char *mem_input = NULL;
+static size_t mem_input_len;
+static size_t mem_input_pos;
+
+/* input from a reader function (see charset_set_input_reader) */
+static size_t (*input_reader)(char *buf, size_t max) = NULL;
+
+/* compressed input, detected in charset_init_preload: its raw bytes
+ * are read into zbuffer and decompressed into buffer */
+static compress_stream_t *zin = NULL;
+static char zbuffer[CHARSET_BUFFER_SIZE];
+static const char *zbufferpos;
+static size_t zavail;
+static int zin_ended;   /* the compressed stream is complete */
+static int zin_pending; /* the decompressor may have more output */
+
+/* compressed output (see param_compress and charset_end_output) */
+static compress_stream_t *zout = NULL;
+static char zoutbuffer[CHARSET_BUFFER_SIZE];
+
+/* copy of the output (see charset_capture_output) */
+static int capture_on = 0;
+static char *capture_buffer = NULL;
+static size_t capture_len;
+static size_t capture_size;
+
 static void read_block(void);
 static void read_interactive(void);
+static void read_memory(void);
+static void read_reader(void);
+static void read_compressed(void);
+static size_t read_raw(char *buf, size_t max);
+static void write_output(const char *buf, size_t len);
+static void write_file(const char *buf, size_t len);
+static size_t encode_8bit(const char *buf, size_t num);
+static int utf8_decode(const unsigned char *in, size_t num, unsigned int *c);
+static size_t unrepresentable_char(unsigned int c, char *out);
+static int utf_select(const charset_t *charset);
+static void utf_set_byte_order(int big_endian);
+static size_t decode_utf(char *outbuf, size_t num);
+static size_t encode_utf(const char *buf, size_t num);
+/*
+ * Native encoder from the internal UTF-8 into ISO-8859-1 or
+ * US-ASCII, which are the usual 8 bit output charsets. It does
+ * what iconv would do, but the characters that cannot be
+ * represented cost no more than the others.
+ * Returns the number of bytes of 'buf' converted: an incomplete
+ * character at the end is left for the next call.
+ */
+static size_t encode_8bit(const char *buf, size_t num)
+{
+  const unsigned char *in = (const unsigned char *) buf;
+  unsigned int max = encoder == enc_latin1 ? 0xff : 0x7f;
+  unsigned int c;
+  size_t i = 0;
+  size_t out = 0;
+  int len;
+
+  while (i < num) {
+    if (out + 16 > CHARSET_BUFFER_SIZE) {
+      write_output(buffer, out);
+      out = 0;
+    }
+    if (in[i] < 0x80) {
+      /* copy a run of ASCII characters */
+      do {
+        buffer[out++] = in[i++];
+      } while (i < num && in[i] < 0x80 && out < CHARSET_BUFFER_SIZE);
+      continue;
+    }
+    len = utf8_decode(&in[i], num - i, &c);
+    if (!len)
+      break;
+    i += len;
+    if (c <= max)
+      buffer[out++] = (char) c;
+    else
+      out += unrepresentable_char(c, &buffer[out]);
+  }
+
+  write_output(buffer, out);
+  return i;
+}
+
+/*
+ * Decodes the UTF-8 character at 'in' into 'c'. Returns its length,
+ * or 0 if it is not complete in the 'num' bytes. Invalid bytes are
+ * decoded one by one as U+FFFD, and a sequence that is overlong
+ * or encodes a surrogate or a value above U+10FFFF as a single one.
+ */
+static int utf8_decode(const unsigned char *in, size_t num, unsigned int *c)
+{
+  /* the smallest value of each length, below which it is overlong */
+  static const unsigned int utf8_min[5] = {0, 0, 0x80, 0x800, 0x10000};
+  int len;
+  int i;
+
+  if (in[0] < 0x80) {
+    *c = in[0];
+    return 1;
+  } else if ((in[0] & 0xE0) == 0xC0) {
+    *c = in[0] & 0x1F;
+    len = 2;
+  } else if ((in[0] & 0xF0) == 0xE0) {
+    *c = in[0] & 0x0F;
+    len = 3;
+  } else if ((in[0] & 0xF8) == 0xF0) {
+    *c = in[0] & 0x07;
+    len = 4;
+  } else {
+    *c = 0xFFFD;
+    return 1;
+  }
+
+  if (num < (size_t) len)
+    return 0;
+  for (i = 1; i < len; i++) {
+    if ((in[i] & 0xC0) != 0x80) {
+      *c = 0xFFFD;
+      return 1;
+    }
+    *c = (*c << 6) | (in[i] & 0x3F);
+  }
+  if (*c < utf8_min[len] || *c > 0x10FFFF || (*c >= 0xD800 && *c <= 0xDFFF))
+    *c = 0xFFFD;
+
+  return len;
+}
+
+/*
+ * Writes into 'out' the replacement of a character that cannot be
+ * represented in the output charset: a numeric character
+ * reference with --ncr-fallback, or nothing (the character is
+ * skipped with a warning). Returns its length (at most 12 bytes).
+ */
+static size_t unrepresentable_char(unsigned int c, char *out)
+{
+  if (param_ncr_fallback)
+    return sprintf(out, "&#%u;", c);
+
+  WARNING(MSG_UNCONVERTIBLE_CHAR,
+          "Skipped a character: cannot be converted to output charset\n\
+Use UTF-8 or UTF-16 output to avoid the problem.");
+  return 0;
+}
+
+/*
+ * Native coders for UTF-16 and UTF-32 / UCS-4, the charsets that
+ * iconv converts slowest. The 'bom' charsets ("utf-16" and
+ * "utf-32") take their byte order from the BOM of the input, and
+ * are little-endian if it is missing, as with GNU iconv; their
+ * output is always little-endian with a BOM. The other ones
+ * neither read nor write a BOM, as iconv does.
+ */
+static const struct {
+  const char *name;
+  size_t unit;
+  int big_endian;
+  int bom;
+} utf_charsets[] = {
+  {"utf-16", 2, 0, 1},
+  {"utf-16be", 2, 1, 0},
+  {"utf-16le", 2, 0, 0},
+  {"utf-32", 4, 0, 1},
+  {"utf-32be", 4, 1, 0},
+  {"utf-32le", 4, 0, 0},
+  {"iso-10646-ucs-4", 4, 1, 0},
+};
+
+#define UTF_CHARSETS_NUM (sizeof(utf_charsets) / sizeof(utf_charsets[0]))
+
+/*
+ * Sets the native coder up for 'charset'. Returns 0 if there is
+ * no native coder for it, or its entry in utf_charsets plus one.
+ */
+static int utf_select(const charset_t *charset)
+{
+  size_t i;
+
+  for (i = 0; i < UTF_CHARSETS_NUM; i++) {
+    if (!strcmp(charset->preferred_name, utf_charsets[i].name)) {
+      utf_unit = utf_charsets[i].unit;
+      utf_read_bom = utf_charsets[i].bom;
+      utf_set_byte_order(utf_charsets[i].big_endian);
+      return (int) i + 1;
+    }
+  }
+
+  return 0;
+}
+
+/*
+ * The fast paths of the coders work on 8 bytes at a time:
+ * utf_ascii_mask has the bits that must be zero in 8 input bytes
+ * for them to be ASCII characters.
+ */
+static void utf_set_byte_order(int big_endian)
+{
+  unsigned char mask[8];
+  int i;
+
+  utf_big_endian = big_endian;
+  utf_ascii_offset = big_endian ? utf_unit - 1 : 0;
+  memset(mask, 0xff, sizeof(mask));
+  for (i = utf_ascii_offset; i < 8; i += utf_unit)
+    mask[i] = 0x80;
+  memcpy(&utf_ascii_mask, mask, sizeof(mask));
+}
+
+static unsigned int utf_get_unit(const unsigned char *in)
+{
+  if (utf_unit == 2) {
+    if (utf_big_endian)
+      return (in[0] << 8) | in[1];
+    else
+      return (in[1] << 8) | in[0];
+  } else {
+    if (utf_big_endian)
+      return ((unsigned int) in[0] << 24) | (in[1] << 16)
+        | (in[2] << 8) | in[3];
+    else
+      return ((unsigned int) in[3] << 24) | (in[2] << 16)
+        | (in[1] << 8) | in[0];
+  }
+}
+
+static void utf_put_unit(unsigned char *out, unsigned int c)
+{
+  int i;
+
+  if (utf_big_endian) {
+    for (i = utf_unit - 1; i >= 0; i--, c >>= 8)
+      out[i] = (unsigned char) c;
+  } else {
+    for (i = 0; i < (int) utf_unit; i++, c >>= 8)
+      out[i] = (unsigned char) c;
+  }
+}
+
+/*
+ * Native decoder from UTF-16 or UTF-32 / UCS-4 into the internal
+ * UTF-8. Converts the input at bufferpos into 'outbuf', while there
+ * is room for at least one more character (4 bytes), and returns
+ * the number of bytes written. An incomplete character at the end of
+ * the input is left at bufferpos. Invalid code units (unpaired
+ * surrogates, values above U+10FFFF) are decoded as U+FFFD.
+ */
+static size_t decode_utf(char *outbuf, size_t num)
+{
+  const unsigned char *in = (const unsigned char *) bufferpos;
+  unsigned char *out = (unsigned char *) outbuf;
+  size_t i = 0;
+  size_t o = 0;
+  size_t len;
+  unsigned int c, c2;
+  uint64_t word;
+  int k;
+
+  if (utf_read_bom && avail >= utf_unit) {
+    /* a BOM sets the byte order and is not part of the document */
+    utf_read_bom = 0;
+    utf_set_byte_order(1);
+    if (utf_get_unit(in) == 0xFEFF) {
+      i = utf_unit;
+    } else {
+      utf_set_byte_order(0);
+      if (utf_get_unit(in) == 0xFEFF)
+        i = utf_unit;
+    }
+  }
+
+  while (avail - i >= utf_unit && num - o >= 4) {
+    /* fast path: 8 bytes of ASCII characters */
+    if (avail - i >= 8) {
+      memcpy(&word, in + i, sizeof(word));
+      if (!(word & utf_ascii_mask)) {
+        for (k = utf_ascii_offset; k < 8; k += utf_unit)
+          out[o++] = in[i + k];
+        i += 8;
+        continue;
+      }
+    }
+
+    c = utf_get_unit(in + i);
+    len = utf_unit;
+    if (c < 0x80) {
+      out[o++] = (unsigned char) c;
+      i += len;
+      continue;
+    }
+    if (c >= 0xD800 && c <= 0xDFFF) {
+      if (utf_unit == 2 && c < 0xDC00) {
+        /* high surrogate: it must be followed by a low one */
+        if (avail - i < 4)
+          break;
+        c2 = utf_get_unit(in + i + 2);
+        if (c2 >= 0xDC00 && c2 <= 0xDFFF) {
+          c = 0x10000 + ((c - 0xD800) << 10) + (c2 - 0xDC00);
+          len = 4;
+        } else {
+          c = 0xFFFD;
+        }
+      } else {
+        c = 0xFFFD;
+      }
+    } else if (c > 0x10FFFF) {
+      c = 0xFFFD;
+    }
+
+    if (c < 0x800) {
+      out[o++] = 0xC0 | (c >> 6);
+      out[o++] = 0x80 | (c & 0x3F);
+    } else if (c < 0x10000) {
+      out[o++] = 0xE0 | (c >> 12);
+      out[o++] = 0x80 | ((c >> 6) & 0x3F);
+      out[o++] = 0x80 | (c & 0x3F);
+    } else {
+      out[o++] = 0xF0 | (c >> 18);
+      out[o++] = 0x80 | ((c >> 12) & 0x3F);
+      out[o++] = 0x80 | ((c >> 6) & 0x3F);
+      out[o++] = 0x80 | (c & 0x3F);
+    }
+    i += len;
+  }
+
+  bufferpos += i;
+  avail -= i;
+  return o;
+}
+
+/*
+ * Native encoder from the internal UTF-8 into UTF-16 or
+ * UTF-32 / UCS-4. Characters above U+FFFF are written as
+ * surrogate pairs in UTF-16. Returns the number of bytes of 'buf'
+ * converted: an incomplete character at the end is left for the
+ * next call.
+ */
+static size_t encode_utf(const char *buf, size_t num)
+{
+  const unsigned char *in = (const unsigned char *) buf;
+  unsigned char *out = (unsigned char *) buffer;
+  unsigned int c;
+  uint64_t word;
+  size_t i = 0;
+  size_t o = 0;
+  int len;
+  int k;
+
+  while (i < num) {
+    if (o + 8 * utf_unit > CHARSET_BUFFER_SIZE) {
+      write_output(buffer, o);
+      o = 0;
+    }
+    /* fast path: 8 bytes of ASCII characters */
+    if (num - i >= 8) {
+      memcpy(&word, in + i, sizeof(word));
+      if (!(word & UINT64_C(0x8080808080808080))) {
+        memset(out + o, 0, 8 * utf_unit);
+        for (k = 0; k < 8; k++)
+          out[o + k * utf_unit + utf_ascii_offset] = in[i + k];
+        o += 8 * utf_unit;
+        i += 8;
+        continue;
+      }
+    }
+
+    len = utf8_decode(&in[i], num - i, &c);
+    if (!len)
+      break;
+    i += len;
+    if (c >= 0x10000 && utf_unit == 2) {
+      c -= 0x10000;
+      utf_put_unit(out + o, 0xD800 | (c >> 10));
+      utf_put_unit(out + o + 2, 0xDC00 | (c & 0x3FF));
+      o += 4;
+    } else {
+      utf_put_unit(out + o, c);
+      o += utf_unit;
+    }
+  }
+
+  write_output(buffer, o);
+  return i;
+}
+
 static void open_iconv(const char *to_charset, const char *from_charset);
 static int compare_aliases(const char* alias1, const char* alias2);
 static charset_t* guess_charset(size_t begin_pos);
@@ -73,11 +474,12 @@ static void detect_boundary(const char *buf, size_t *nread);
 void charset_init_input(const charset_t *charset_in, FILE *input_file)
 {
   if (state != closed) {
-    WARNING("Charset initialized, closing it now");
+    WARNING(MSG_INTERNAL, "Charset initialized, closing it now");
     charset_close();
   }
 
   open_iconv(CHARSET_INTERNAL_ENC, charset_in->iconv_name);
+  decoder = utf_select(charset_in) ? dec_utf : dec_iconv;
   bufferpos = buffer;
   avail = 0;
   file = input_file;
@@ -89,39 +491,68 @@ void charset_init_input(const charset_t *charset_in, FILE *input_file)
 size_t charset_init_output(const charset_t *charset_out, FILE *output_file)
 {
   size_t written = 0;
+  int utf;
 
   if (state != closed) {
-    WARNING("Charset initialized, closing it now");
+    WARNING(MSG_INTERNAL, "Charset initialized, closing it now");
     charset_close();
   }
 
-  if (charset_out == CHARSET_UTF_16) {
-    /* Force UTF16 to be little-endian and write BOM,
-     * because iconv does not write BOM when UTF_16LE or UTF_16BE are set.
-     */
-    charset_out = CHARSET_UTF_16LE;
-    written = fwrite("\xFF\xFE", 1, 2, output_file);
-  }
-
   open_iconv(charset_out->iconv_name, CHARSET_INTERNAL_ENC);
   file = output_file;
   state = output;
 
+  if (!strcmp(charset_out->preferred_name, "iso-8859-1"))
+    encoder = enc_latin1;
+  else if (!strcmp(charset_out->preferred_name, "us-ascii"))
+    encoder = enc_ascii;
+  else if ((utf = utf_select(charset_out)) != 0) {
+    encoder = enc_utf;
+    if (utf_charsets[utf - 1].bom) {
+      /* UTF-16 and UTF-32 are always written little-endian,
+       * with a BOM (utf_select leaves them little-endian).
+       */
+      write_output("\xFF\xFE\0\0", utf_unit);
+      written = utf_unit;
+    }
+  }
+  else
+    encoder = enc_iconv;
+
   DEBUG("charset_init_output() executed");
   return written;
 }
 
 char *charset_init_preload(FILE *input_file, size_t *bytes_read)
 {
+  int format;
+
   if (state != closed) {
-    WARNING("Charset initialized, closing it now");
+    WARNING(MSG_INTERNAL, "Charset initialized, closing it now");
     charset_close();
   }
 
+  /* the compressed output of an aborted conversion, if any */
+  compress_free(zout);
+  zout = NULL;
+
   file = input_file;
   bufferpos = buffer;
   avail = 0;
   read_block();
+
+  format = compress_detect(buffer, avail);
+  if (format != COMPRESS_NONE) {
+    /* what was read is compressed: decompress it from zbuffer */
+    memcpy(zbuffer, buffer, avail);
+    zbufferpos = zbuffer;
+    zavail = avail;
+    zin = compress_new_decoder(format);
+    zin_ended = 0;
+    zin_pending = 0;
+    avail = 0;
+    read_block();
+  }
   *bytes_read = avail;
 
   state = preload;
@@ -135,6 +566,7 @@ void charset_preload_to_input(const charset_t *charset_in, size_t bytes_avail)
   }
 
   open_iconv(CHARSET_INTERNAL_ENC, charset_in->iconv_name);
+  decoder = utf_select(charset_in) ? dec_utf : dec_iconv;
   bufferpos = buffer + avail - bytes_avail;
   avail = bytes_avail;
   state = input;
@@ -142,10 +574,8 @@ void charset_preload_to_input(const charset_t *charset_in, size_t bytes_avail)
 
 void charset_close()
 {
-  size_t wrote;
-
   if (state == input || (state == eof && avail > 0)) {
-    WARNING("Charset closed, but input still available");
+    WARNING(MSG_INTERNAL, "Charset closed, but input still available");
   }
 
   if (state == output) {
@@ -155,18 +585,20 @@ void charset_close()
     iconv (cd, NULL, NULL, &bufferpos, &avail);
     if (avail < CHARSET_BUFFER_SIZE) {
       /* write the output */
-      wrote = fwrite(buffer, 1, CHARSET_BUFFER_SIZE - avail, file);
-      if (wrote < CHARSET_BUFFER_SIZE - avail) {
-        perror("fwrite()");
-        EXIT("Error writing a data block to the output");
-      }
+      write_output(buffer, CHARSET_BUFFER_SIZE - avail);
     }
   }
 
   if (state != closed) { 
-    state = closed;
     if (state != preload)
       iconv_close(cd);
+    state = closed;
+  }
+
+  if (zin) {
+    compress_free(zin);
+    zin = NULL;
+    zavail = 0;
   }
 
 #ifdef WITH_CGI
@@ -181,6 +613,7 @@ void charset_close()
 int charset_read(char *outbuf, size_t num, int interactive)
 {
   size_t nconv;
+  size_t n;
   size_t outbuf_max = num;
   int convert_more;
 
@@ -201,7 +634,30 @@ int charset_read(char *outbuf, size_t num, int interactive)
         read_interactive();
     }
     /* convert the input into de internal charset */
-    if (avail > 0) {
+    if (avail > 0 && decoder == dec_utf) {
+      n = decode_utf(outbuf, outbuf_max);
+      outbuf += n;
+      outbuf_max -= n;
+      if (avail == 0) {
+        /* all the input converted; read more in the next round */
+        bufferpos = buffer;
+      }
+      if (outbuf_max >= 4) {
+        /* all the input converted, except maybe an incomplete
+         * character, which is kept for the next round
+         */
+        if (state != eof) {
+          memmove (buffer, bufferpos, avail);
+          bufferpos = buffer;
+          convert_more = 1;
+        } else if (avail > 0) {
+          WARNING(MSG_DISCARDED_BYTES, "Some bytes discarded at the end of the input");
+          avail = 0;
+        }
+      }
+    }
+    else if (avail > 0) {
+      stats_count_iconv();
       nconv = iconv(cd, &bufferpos, &avail, &outbuf, &outbuf_max);
       if (nconv == (size_t) -1) {
         if (errno == EINVAL) {
@@ -214,7 +670,7 @@ int charset_read(char *outbuf, size_t num, int interactive)
             bufferpos = buffer;
             convert_more = 1;
           } else {
-            WARNING("Some bytes discarded at the end of the input");
+            WARNING(MSG_DISCARDED_BYTES, "Some bytes discarded at the end of the input");
             avail = 0;
           }
         }
@@ -237,7 +693,7 @@ int charset_read(char *outbuf, size_t num, int interactive)
         else if (errno != E2BIG) {
           /* It is a real problem. Stop the conversion. */
           perror("inconv");
-          if (fclose(file) != 0)
+          if (file && fclose(file) != 0)
             perror ("fclose");
           EXIT("Error while converting the input into the internal charset");
         }
@@ -265,11 +721,14 @@ int charset_read(char *outbuf, size_t num, int interactive)
 
 size_t charset_write(char *buf, size_t num)
 {
-  int convert_again = 1;
   char *bufpos = buf;
   size_t n = num;
   size_t nconv;
-  int wrote;
+  char ncr[16];
+  char *ncr_pos;
+  size_t ncr_len;
+  unsigned int c;
+  int len;
 
   DEBUG("in charset_write()");
   EPRINTF1("    write %d bytes\n", num);
@@ -277,65 +736,117 @@ size_t charset_write(char *buf, size_t num)
   if (state != output)
     return 0;
 
-  while (convert_again) {
-    convert_again = 0;
-    bufferpos = buffer;
-    avail = CHARSET_BUFFER_SIZE;
+  stats_phase_begin(STATS_ENCODE);
+  if (encoder == enc_utf) {
+    n = num - encode_utf(buf, num);
+    stats_phase_end(STATS_ENCODE);
+    return num - n;
+  }
+  if (encoder != enc_iconv) {
+    n = num - encode_8bit(buf, num);
+    stats_phase_end(STATS_ENCODE);
+    return num - n;
+  }
 
+  bufferpos = buffer;
+  avail = CHARSET_BUFFER_SIZE;
+  while (n > 0) {
+    stats_count_iconv();
     nconv = iconv(cd, &bufpos, &n, &bufferpos, &avail);
-    if (nconv == (size_t) -1) {
-      if (errno == EINVAL) {
-        /* Some bytes in the input were not converted.
-         * The caller has to feed them again later.
-         */
-
-      } 
-      else if (errno == E2BIG) {
-        /* The output buffer is full; no problem, just 
-         * write and convert again
-         */
-        convert_again = 1;
-      }
-      else if (errno == EILSEQ) {
-        /* UTF-8 character that cannot be represented in
-         * the output charset. Skip the character and continue.
-         */
-        bufpos++;
-        n--;
-        while (n > 0 && (char)(bufpos[0] & 0xC0) == (char)0x80) {
-          bufpos++;
-          n--;
-        }
-        WARNING("Skipped a character: cannot be converted to output charset\n\
-Use UTF-8 or UTF-16 output to avoid the problem.");
-        convert_again = 1;
-      }
-      else {
-        /* It is a real problem. Stop the conversion. */
-        perror("inconv");
-        if (fclose(file) != 0)
-          perror ("fclose");
-        EXIT("Error while converting into the output charset");
+    if (nconv != (size_t) -1 || errno == EINVAL) {
+      /* Done, or some bytes in the input were not converted.
+       * The caller has to feed them again later.
+       */
+      break;
+    } 
+    else if (errno == E2BIG) {
+      /* The output buffer is full; no problem, just 
+       * write and convert again
+       */
+      write_output(buffer, CHARSET_BUFFER_SIZE - avail);
+      bufferpos = buffer;
+      avail = CHARSET_BUFFER_SIZE;
+    }
+    else if (errno == EILSEQ) {
+      /* UTF-8 character that cannot be represented in
+       * the output charset: replace it (see unrepresentable_char)
+       * and go on converting into the same output buffer.
+       */
+      len = utf8_decode((unsigned char *) bufpos, n, &c);
+      if (!len)
+        break;
+      bufpos += len;
+      n -= len;
+      ncr_len = unrepresentable_char(c, ncr);
+      ncr_pos = ncr;
+      while (ncr_len > 0
+             && iconv(cd, &ncr_pos, &ncr_len, &bufferpos, &avail)
+             == (size_t) -1) {
+        if (errno != E2BIG)
+          EXIT("Error while converting into the output charset");
+        write_output(buffer, CHARSET_BUFFER_SIZE - avail);
+        bufferpos = buffer;
+        avail = CHARSET_BUFFER_SIZE;
       }
     }
-
-    /* write the output */
-    wrote = fwrite(buffer, 1, CHARSET_BUFFER_SIZE - avail, file);
-    if (wrote < CHARSET_BUFFER_SIZE - avail) {
-      perror("fwrite()");
-      EXIT("Error writing a data block to the output");
+    else {
+      /* It is a real problem. Stop the conversion. */
+      perror("inconv");
+      if (fclose(file) != 0)
+        perror ("fclose");
+      EXIT("Error while converting into the output charset");
     }
   }
 
+  /* write the output */
+  write_output(buffer, CHARSET_BUFFER_SIZE - avail);
+  stats_phase_end(STATS_ENCODE);
+
   /* Return the number of bytes of the internal encoding wrote.
    * The caller must feed later the bytes not wrote. 
    */
   return num - n;
 }
 
+void charset_write_raw(FILE *output_file, const char *buf, size_t num)
+{
+  if (state != closed)
+    EXIT("Charset in use, cannot write raw data");
+
+  file = output_file;
+  write_output(buf, num);
+}
+
+void charset_end_output(FILE *output_file)
+{
+  const char *in = NULL;
+  size_t in_len = 0;
+  char *out;
+  size_t out_len;
+  int ended;
+
+  if (param_compress == COMPRESS_NONE)
+    return;
+  if (state != closed)
+    EXIT("Charset in use, cannot end the output");
+
+  file = output_file;
+  if (!zout)
+    zout = compress_new_encoder(param_compress, param_compress_level);
+  do {
+    out = zoutbuffer;
+    out_len = sizeof(zoutbuffer);
+    ended = compress_run(zout, &in, &in_len, &out, &out_len, 1);
+    write_file(zoutbuffer, out - zoutbuffer);
+  } while (!ended);
+
+  compress_free(zout);
+  zout = NULL;
+}
+
 void charset_auto_detect(size_t bytes_avail) {
   if (state != preload) {
-    WARNING("Charset must be in preview mode in order to autodetect encoding");
+    WARNING(MSG_INTERNAL, "Charset must be in preview mode in order to autodetect encoding");
     return;
   }
 
@@ -702,7 +1213,7 @@ charset_t* read_charset_decl(int ini, int step, int mode, charset_t* defaults)
                         charset_decl += 8;
                         charset = charset_lookup_alias(charset_decl);
                         if (!charset) {
-                          WARNING("Unknown charset in meta/@ContentType");
+                          WARNING(MSG_UNKNOWN_CHARSET, "Unknown charset in meta/@ContentType");
                         }
                       }
                     }
@@ -795,11 +1306,48 @@ int compare_aliases(const char* alias1, const char* alias2)
   return 0;
 }
 
+void charset_set_input_memory(const char *data, size_t len)
+{
+  mem_input = data;
+  mem_input_len = len;
+  mem_input_pos = 0;
+}
+
+void charset_set_input_reader(size_t (*reader)(char *buf, size_t max))
+{
+  input_reader = reader;
+}
+
+void charset_capture_output(int on)
+{
+  capture_on = on;
+  capture_len = 0;
+}
+
+char *charset_captured_output(size_t *len)
+{
+  *len = capture_len;
+  return capture_buffer;
+}
+
 static void read_block()
 {
   size_t nread;
   int read_again = 1;
 
+  if (zin) {
+    read_compressed();
+    return;
+  }
+  if (mem_input) {
+    read_memory();
+    return;
+  }
+  if (input_reader) {
+    read_reader();
+    return;
+  }
+
 #ifdef WITH_CGI
   if (stop_string && stop_matched > 0) {
     /* refill the buffer with the partially matched data */
@@ -852,6 +1400,7 @@ static void read_block()
 #endif
 
   avail += nread;
+  stats_add_bytes_in(nread);
 }
 
 static void read_interactive()
@@ -860,6 +1409,19 @@ static void read_interactive()
   int n;
   size_t max_size;
 
+  if (zin) {
+    read_compressed();
+    return;
+  }
+  if (mem_input) {
+    read_memory();
+    return;
+  }
+  if (input_reader) {
+    read_reader();
+    return;
+  }
+
   max_size = sizeof(buffer) - avail;
 
   for (n = 0; n < max_size && (c = getc(file)) != EOF && c != '\n'; ++n)
@@ -876,6 +1438,148 @@ static void read_interactive()
   }
 
   avail += n;
+  stats_add_bytes_in(n);
+}
+
+static void read_memory()
+{
+  size_t n;
+
+  n = sizeof(buffer) - avail;
+  if (n > mem_input_len - mem_input_pos)
+    n = mem_input_len - mem_input_pos;
+
+  memcpy(buffer + avail, mem_input + mem_input_pos, n);
+  mem_input_pos += n;
+  avail += n;
+  stats_add_bytes_in(n);
+
+  if (mem_input_pos == mem_input_len)
+    state = eof;
+}
+
+static void read_reader()
+{
+  size_t n;
+
+  n = input_reader(buffer + avail, sizeof(buffer) - avail);
+  if (n == 0)
+    state = eof;
+
+  avail += n;
+  stats_add_bytes_in(n);
+}
+
+/*
+ * Decompresses the input into the buffer, until some data is
+ * available or the compressed input ends.
+ */
+static void read_compressed()
+{
+  char *out = buffer + avail;
+  size_t out_len = sizeof(buffer) - avail;
+
+  while (out == buffer + avail && out_len > 0) {
+    if (!zavail && !zin_pending) {
+      zavail = read_raw(zbuffer, sizeof(zbuffer));
+      zbufferpos = zbuffer;
+      if (!zavail) {
+        if (!zin_ended)
+          WARNING(MSG_DISCARDED_BYTES, "The compressed input is truncated");
+        state = eof;
+        break;
+      }
+    }
+    if (zin_ended && compress_detect(zbufferpos, zavail) == COMPRESS_NONE) {
+      /* not another stream, as the padding of some archivers */
+      WARNING(MSG_DISCARDED_BYTES, "Some bytes discarded after the compressed input");
+      zavail = 0;
+      continue;
+    }
+    zin_ended = compress_run(zin, &zbufferpos, &zavail, &out, &out_len, 0);
+    zin_pending = !out_len;
+  }
+
+  avail = out - buffer;
+}
+
+/*
+ * Reads at most 'max' bytes of the input, without decompressing
+ * them. Returns 0 at the end of the input.
+ */
+static size_t read_raw(char *buf, size_t max)
+{
+  size_t n;
+
+  if (mem_input) {
+    n = mem_input_len - mem_input_pos;
+    if (n > max)
+      n = max;
+    memcpy(buf, mem_input + mem_input_pos, n);
+    mem_input_pos += n;
+  } else if (input_reader) {
+    n = input_reader(buf, max);
+  } else {
+    while (!(n = fread(buf, 1, max, file)) && ferror(file)) {
+      if (errno != EINTR) {
+        perror("read");
+        EXIT("Error reading the input");
+      }
+      /* interrupted: read again */
+      clearerr(file);
+    }
+  }
+
+  stats_add_bytes_in(n);
+  return n;
+}
+
+/*
+ * Writes the output, compressed if param_compress is set
+ */
+static void write_output(const char *buf, size_t len)
+{
+  char *out;
+  size_t out_len;
+
+  if (param_compress == COMPRESS_NONE) {
+    write_file(buf, len);
+    return;
+  }
+
+  if (!zout)
+    zout = compress_new_encoder(param_compress, param_compress_level);
+  while (len > 0) {
+    out = zoutbuffer;
+    out_len = sizeof(zoutbuffer);
+    compress_run(zout, &buf, &len, &out, &out_len, 0);
+    write_file(zoutbuffer, out - zoutbuffer);
+  }
+}
+
+static void write_file(const char *buf, size_t len)
+{
+  char *new_buffer;
+
+  stats_add_bytes_out(len);
+  if (file && fwrite(buf, 1, len, file) < len) {
+    perror("fwrite()");
+    EXIT("Error writing a data block to the output");
+  }
+
+  if (capture_on) {
+    if (capture_len + len > capture_size) {
+      capture_size = capture_size ? capture_size : 65536;
+      while (capture_len + len > capture_size)
+        capture_size *= 2;
+      new_buffer = (char *) realloc(capture_buffer, capture_size);
+      if (!new_buffer)
+        EXIT("Not enough memory to capture the output");
+      capture_buffer = new_buffer;
+    }
+    memcpy(capture_buffer + capture_len, buf, len);
+    capture_len += len;
+  }
 }
 
 static void open_iconv(const char *to_charset, const char *from_charset)
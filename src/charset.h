@@ -63,6 +63,8 @@ size_t charset_init_output(const charset_t *charset_out, FILE *output_file);
 /*
  * Set/reset preload mode. Loads a data block from input_file
  * and returns a pointer to the buffer where data is stored.
+ * If the input is compressed (see compress.h), it is
+ * decompressed from now on.
  * The parameter 'bytes_read' is set to the number of bytes read.
  * State can be changed later to input with 'charset_preload_to_input'. 
  */
@@ -74,6 +76,37 @@ char *charset_init_preload(FILE *input_file, size_t *bytes_read);
  */
 void charset_preload_to_input(const charset_t *charset_in, size_t bytes_avail);
 
+/*
+ * Read the input from the 'len' bytes at 'data' instead of from
+ * the input file. Must be invoked before charset_init_preload or
+ * charset_init_input. The data must be kept in memory by the caller.
+ * Use a null pointer to read again from the input file.
+ */
+void charset_set_input_memory(const char *data, size_t len);
+
+/*
+ * Read the input through 'reader' instead of from the input file.
+ * The reader stores up to 'max' bytes in 'buf', waiting if needed
+ * until 'max' bytes are available or the input ends, and returns
+ * the number of bytes stored (0 at the end of the input). Must be
+ * invoked before charset_init_preload or charset_init_input.
+ * Use a null pointer to read again from the input file.
+ */
+void charset_set_input_reader(size_t (*reader)(char *buf, size_t max));
+
+/*
+ * Start (on = 1) or stop (on = 0) keeping a copy of all the bytes
+ * written to the output file, which may be null in output mode
+ * if only the copy is needed. Starting it discards the previous copy.
+ */
+void charset_capture_output(int on);
+
+/*
+ * Return the bytes captured so far and set 'len' to their
+ * number. The buffer belongs to this module.
+ */
+char *charset_captured_output(size_t *len);
+
 /*
  * Close the current charset converter
  */
@@ -92,6 +125,21 @@ int charset_read(char *outbuf, size_t num, int interactive);
  */
 size_t charset_write(char *buf, size_t num);
 
+/*
+ * Write 'num' bytes from 'buf' to 'output_file' without any
+ * conversion, as binary data (also to the copy of
+ * charset_capture_output). The converter must be closed.
+ */
+void charset_write_raw(FILE *output_file, const char *buf, size_t num);
+
+/*
+ * End the output stream written to 'output_file', which is
+ * compressed when param_compress is set: write the last bytes of
+ * the compressed stream. Must be invoked once the whole document
+ * has been written, with the converter closed.
+ */
+void charset_end_output(FILE *output_file);
+
 /*
  * Try to detect the input character encoding, if not set
  * by the user. Sets the output encoding to the input encoding,
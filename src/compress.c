@@ -0,0 +1,271 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Jesus Arias Fisteus                             *
+ *   jaf@it.uc3m.es                                                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/*
+ * compress.c
+ *
+ * Compressed streams (see compress.h). gzip streams are handled
+ * with zlib and zstd streams with libzstd, when they are available
+ * at build time.
+ *
+ */
+
+/* included first to define _GNU_SOURCE if necessary */
+#include "xchar.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_LIBZ
+#include <zlib.h>
+#endif
+#ifdef HAVE_LIBZSTD
+#include <zstd.h>
+#endif
+
+#include "compress.h"
+#include "mensajes.h"
+
+struct compress_stream {
+  int format;
+  int encoder;
+  int ended;
+#ifdef HAVE_LIBZ
+  z_stream z;
+#endif
+#ifdef HAVE_LIBZSTD
+  ZSTD_CCtx *zc;
+  ZSTD_DCtx *zd;
+#endif
+};
+
+static compress_stream_t *new_stream(int format, int encoder);
+
+int compress_detect(const char *buf, size_t len)
+{
+  const unsigned char *b = (const unsigned char *) buf;
+
+  if (len >= 2 && b[0] == 0x1f && b[1] == 0x8b)
+    return COMPRESS_GZIP;
+  if (len >= 4 && b[0] == 0x28 && b[1] == 0xb5 && b[2] == 0x2f
+      && b[3] == 0xfd)
+    return COMPRESS_ZSTD;
+
+  return COMPRESS_NONE;
+}
+
+int compress_available(int format)
+{
+  switch (format) {
+  case COMPRESS_NONE:
+    return 1;
+#ifdef HAVE_LIBZ
+  case COMPRESS_GZIP:
+    return 1;
+#endif
+#ifdef HAVE_LIBZSTD
+  case COMPRESS_ZSTD:
+    return 1;
+#endif
+  default:
+    return 0;
+  }
+}
+
+const char *compress_name(int format)
+{
+  switch (format) {
+  case COMPRESS_GZIP:
+    return "gzip";
+  case COMPRESS_ZSTD:
+    return "zstd";
+  default:
+    return "none";
+  }
+}
+
+compress_stream_t *compress_new_decoder(int format)
+{
+  compress_stream_t *s;
+
+  s = new_stream(format, 0);
+#ifdef HAVE_LIBZ
+  if (format == COMPRESS_GZIP) {
+    /* 16: gzip header and trailer instead of zlib ones */
+    if (inflateInit2(&s->z, 16 + MAX_WBITS) != Z_OK)
+      EXIT("Could not initialize the gzip decompressor");
+  }
+#endif
+#ifdef HAVE_LIBZSTD
+  if (format == COMPRESS_ZSTD) {
+    s->zd = ZSTD_createDCtx();
+    if (!s->zd)
+      EXIT("Could not initialize the zstd decompressor");
+  }
+#endif
+
+  return s;
+}
+
+compress_stream_t *compress_new_encoder(int format, int level)
+{
+  compress_stream_t *s;
+
+  s = new_stream(format, 1);
+#ifdef HAVE_LIBZ
+  if (format == COMPRESS_GZIP) {
+    if (level < 0 || level > 9)
+      level = Z_DEFAULT_COMPRESSION;
+    if (deflateInit2(&s->z, level, Z_DEFLATED, 16 + MAX_WBITS, 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK)
+      EXIT("Could not initialize the gzip compressor");
+  }
+#endif
+#ifdef HAVE_LIBZSTD
+  if (format == COMPRESS_ZSTD) {
+    if (level <= 0 || level > ZSTD_maxCLevel())
+      level = 0;
+    s->zc = ZSTD_createCCtx();
+    if (!s->zc
+        || ZSTD_isError(ZSTD_CCtx_setParameter(s->zc,
+                                               ZSTD_c_compressionLevel,
+                                               level)))
+      EXIT("Could not initialize the zstd compressor");
+  }
+#endif
+
+  return s;
+}
+
+int compress_run(compress_stream_t *s, const char **in, size_t *in_len,
+                 char **out, size_t *out_len, int end)
+{
+#ifdef HAVE_LIBZ
+  int ret;
+#endif
+#ifdef HAVE_LIBZSTD
+  ZSTD_inBuffer zin;
+  ZSTD_outBuffer zout;
+  size_t r;
+#endif
+
+  if (!s->encoder && s->ended && *in_len > 0) {
+    /* another stream after the end of the previous one */
+#ifdef HAVE_LIBZ
+    if (s->format == COMPRESS_GZIP)
+      inflateReset(&s->z);
+#endif
+    s->ended = 0;
+  }
+
+#ifdef HAVE_LIBZ
+  if (s->format == COMPRESS_GZIP) {
+    s->z.next_in = (Bytef *) *in;
+    s->z.avail_in = (uInt) *in_len;
+    s->z.next_out = (Bytef *) *out;
+    s->z.avail_out = (uInt) *out_len;
+    if (s->encoder)
+      ret = deflate(&s->z, end ? Z_FINISH : Z_NO_FLUSH);
+    else
+      ret = inflate(&s->z, Z_NO_FLUSH);
+    if (ret == Z_STREAM_END)
+      s->ended = 1;
+    else if (ret != Z_OK && ret != Z_BUF_ERROR)
+      EXIT(s->encoder ? "Error while compressing the output"
+           : "Error while decompressing the input: bad gzip data");
+    *in_len -= (const char *) s->z.next_in - *in;
+    *in = (const char *) s->z.next_in;
+    *out_len -= (char *) s->z.next_out - *out;
+    *out = (char *) s->z.next_out;
+  }
+#endif
+#ifdef HAVE_LIBZSTD
+  if (s->format == COMPRESS_ZSTD) {
+    zin.src = *in;
+    zin.size = *in_len;
+    zin.pos = 0;
+    zout.dst = *out;
+    zout.size = *out_len;
+    zout.pos = 0;
+    if (s->encoder)
+      r = ZSTD_compressStream2(s->zc, &zout, &zin,
+                               end ? ZSTD_e_end : ZSTD_e_continue);
+    else
+      r = ZSTD_decompressStream(s->zd, &zout, &zin);
+    if (ZSTD_isError(r))
+      EXIT(s->encoder ? "Error while compressing the output"
+           : "Error while decompressing the input: bad zstd data");
+    /* 0: the frame is complete and flushed */
+    s->ended = (!s->encoder || end) && r == 0;
+    *in += zin.pos;
+    *in_len -= zin.pos;
+    *out += zout.pos;
+    *out_len -= zout.pos;
+  }
+#endif
+
+  return s->ended;
+}
+
+void compress_free(compress_stream_t *s)
+{
+  if (!s)
+    return;
+
+#ifdef HAVE_LIBZ
+  if (s->format == COMPRESS_GZIP) {
+    if (s->encoder)
+      deflateEnd(&s->z);
+    else
+      inflateEnd(&s->z);
+  }
+#endif
+#ifdef HAVE_LIBZSTD
+  if (s->format == COMPRESS_ZSTD) {
+    ZSTD_freeCCtx(s->zc);
+    ZSTD_freeDCtx(s->zd);
+  }
+#endif
+
+  free(s);
+}
+
+static compress_stream_t *new_stream(int format, int encoder)
+{
+  compress_stream_t *s;
+
+  if (format == COMPRESS_NONE)
+    EXIT("Not a compressed stream");
+  if (!compress_available(format)) {
+    if (format == COMPRESS_ZSTD) {
+      EXIT("html2xhtml was built without zstd support");
+    } else {
+      EXIT("html2xhtml was built without gzip support");
+    }
+  }
+
+  s = (compress_stream_t *) calloc(1, sizeof(compress_stream_t));
+  if (!s)
+    EXIT("Not enough memory for a compressed stream");
+  s->format = format;
+  s->encoder = encoder;
+
+  return s;
+}
@@ -0,0 +1,90 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Jesus Arias Fisteus                             *
+ *   jaf@it.uc3m.es                                                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/*
+ * compress.h
+ *
+ * Compressed streams, so that documents can be read and written
+ * compressed with gzip or zstd without external processes.
+ * Compressed input is detected and decompressed by charset.c,
+ * which also compresses the output when param_compress is set.
+ *
+ */
+
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <stdlib.h>
+
+/* formats of compressed streams */
+#define COMPRESS_NONE 0
+#define COMPRESS_GZIP 1
+#define COMPRESS_ZSTD 2
+
+typedef struct compress_stream compress_stream_t;
+
+/*
+ * Returns the format of the compressed stream that begins with
+ * the 'len' bytes at 'buf', or COMPRESS_NONE if it is not
+ * compressed.
+ */
+int compress_detect(const char *buf, size_t len);
+
+/*
+ * Returns 1 if streams in 'format' can be read and written, or 0
+ * if html2xhtml was built without the library that handles them.
+ */
+int compress_available(int format);
+
+/*
+ * Returns the name of 'format' ("gzip" or "zstd").
+ */
+const char *compress_name(int format);
+
+/*
+ * Create a decompressor, or a compressor with the given level
+ * (0, i.e. no compression, to 9 for gzip, 1 to 19 for zstd, -1
+ * for the default of the format), of streams in 'format'.
+ */
+compress_stream_t *compress_new_decoder(int format);
+compress_stream_t *compress_new_encoder(int format, int level);
+
+/*
+ * Decompresses or compresses the '*in_len' bytes at '*in' into the
+ * '*out_len' bytes at '*out', and moves the four forward past the
+ * bytes consumed and produced. When 'end' is set, there is no more
+ * input and the compressor finishes the stream.
+ *
+ * Returns 1 when the stream is complete: the compressor has
+ * written all of it, or the decompressor has reached the end of the
+ * compressed data (if more input comes, it is decompressed as a new
+ * stream, as in concatenated gzip files). It does not return 1
+ * while some output is pending: call it again while it fills
+ * '*out_len'.
+ */
+int compress_run(compress_stream_t *s, const char **in, size_t *in_len,
+                 char **out, size_t *out_len, int end);
+
+/*
+ * Frees the stream
+ */
+void compress_free(compress_stream_t *s);
+
+#endif
@@ -263,6 +263,41 @@ char ent_list[254][25]= {
     "ecirc"  /*252*/,
     "eacute"  /*255*/
 };
+/* characters of the entities (0 if not a character) */
+int ent_code[254]= {
+   238, 8211,  183,  175,  246,  931, 8195,  176
+,  244,   34,  251,  218,  914,  160,  229,  926
+, 8836,  953, 8226, 8240,  210,  710,  191,  928
+, 8218,  201, 8970,  353, 9830, 8230,  214,  963
+, 8773, 8838, 8472, 9002,  922,  166, 8260,  921
+,  243,  171, 8801, 8855, 8704, 8713,  927, 8501
+,  187,  236,  913, 8746,  252, 8834,  352,  937
+,  167,  180,  224,  161,  215,  245, 8222,  917
+,  954, 8721, 8709, 8835,  235, 8756,  934,   39
+, 8220,  211, 8656,  978, 8719, 9674,  732,  959
+, 8221,  933,  164, 8465,  204, 8659,  945,  220
+, 8243,  969,  231, 8733,  192, 8482,  213,  977
+,  949, 8776,  253,  248,  203, 8722,  966, 8968
+,  919, 8207,  169, 8592, 8969,  208,  247, 8804
+,  965,  237, 8595, 9827,  920, 8242, 8212,  199
+,  225,  935,  915,  932,   60, 8853, 8224,  221
+, 8250,  163,  216,  189, 8658,  188,  951, 8629
+,  174,  227,  916,  240,    0,  205,  982,  952
+, 8476,  402,  185,  193,  178,  967,  170,  179
+,  936,  947, 8206,  162,  956,  964,  241, 8225
+,  186, 8657, 8727, 8594,  249, 8201,  195, 8800
+,  948, 8204,  177,  255, 8715,  232,  223,  173
+,  181, 8711,   38,  968, 8734, 8194,  955,  957
+,  924,  209,  239, 8593, 8205,  190, 8712,  217
+, 8249, 8745,  172,  228,  168,  222, 8743, 8764
+, 8839,  194,  950,  929, 8660, 8736, 8971,  376
+,  202, 8805,  182,  200,  206,  962,  165, 8254
+, 8744, 8216,  184,  198,  212,  230,  923,  925
+, 8217,  207,  219, 9829,   62, 8364, 9001, 9824
+,  250, 8730, 8747,  946,  197,  958,  196, 8706
+, 8869,  338,  339,  242, 8901,  254, 8707,  226
+,  918,  960,  961, 8596,  234,  233};
+
 /* hash table for entities */
 int ent_hash[257]= {
    0,  2,  3,  3,  4,  4,  7,  9,  9,  9, 10, 10, 10, 11, 11, 11
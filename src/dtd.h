@@ -35,6 +35,7 @@ extern unsigned char att_buffer[];
 
 extern int ent_hash[257];
 extern char ent_list[][25];
+extern int ent_code[];
 
 #define ELMID_HTML 0
 #define ELMID_HEAD 1
@@ -34,6 +34,7 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "xchar.h"
@@ -52,7 +53,7 @@ extern int ent_hash[];
 static int is_child_valid(int *rule_ptr, int elements[], int num);
 static int search_par_close(int rule_ptr);
 static int hash_value(const char *cad);
-static int dtd_ref_is_valid(xchar *ref);
+static int dtd_ref_is_valid(const xchar *ref);
 
 static int isXmlChar(xchar ch);
 static int isXmlNameChar(xchar ch);
@@ -61,6 +62,36 @@ static int makeXmlCdata(xchar *value);
 static int makeXmlId(xchar *value);
 static int makeXmlNmtoken(xchar *value);
 static int makeXmlNames(xchar *value, int atttype);
+static void init_xml_char_class(void);
+static int enum_match(int att_type, const xchar *value);
+static int enum_compile(int att_type);
+static int enum_cmp(const void *a, const void *b);
+static size_t utf8_encode(unsigned int c, char *out);
+
+/* clases de los caracteres (un bit por cada predicado isXml...),
+ * para comprobar los valores sin una llamada por carcter */
+#define XML_CHAR      0x01
+#define XML_LETTER    0x02
+#define XML_NAMECHAR  0x04
+static unsigned char xml_char_class[256];
+static int xml_char_class_ready= 0;
+#define XML_IS(ch, clase) (xml_char_class[(unsigned char)(ch)] & (clase))
+
+/* listas de valores enumerados ya compiladas: cada una es un tramo
+ * ordenado de enum_values, que se busca con bsearch()
+ * (enum_slot[att_type] es 1 + su ndice en enum_tables, o 0) */
+typedef struct {
+  int first;
+  int num;
+} enum_table_t;
+
+static enum_table_t enum_tables[att_buffer_num / 4 + 1];
+static int enum_tables_num= 0;
+static short enum_slot[att_buffer_num];
+static const char *enum_values[att_buffer_num / 2];
+static int enum_values_num= 0;
+static char enum_chars[att_buffer_num];
+static int enum_chars_num= 0;
 
 
 /*
@@ -130,14 +161,16 @@ int dtd_elm_search(const char *elm_name)
  */
 int dtd_ent_search(const char *ent_name)
 {
-  char *ent;
+  char ent[ENT_NAME_LEN];
   int hash;
   int indice;
   int i;
   
-  /* duplica la cadena y se queda con 'nombre' */
-  ent= tree_strdup(&ent_name[1]);
-  for (i = 0; ent[i] != ';'; i++);
+  /* copia 'nombre'; si no cabe, no es ninguna de las entidades */
+  for (i = 0; ent_name[i+1] != ';'; i++) {
+    if (i == ENT_NAME_LEN - 1 || !ent_name[i+1]) return -1;
+    ent[i]= ent_name[i+1];
+  }
   ent[i]=0;
 
   /* bsqueda con tabla hash */
@@ -145,12 +178,112 @@ int dtd_ent_search(const char *ent_name)
   for (indice=-1, i=ent_hash[hash]; (i<ent_hash[hash+1]) && (indice==-1); i++)
     if (!strcmp(ent,ent_list[i])) indice= i;
 
-/*   free(ent); */
   return indice;
 }
 
 
 
+/*
+ * copia en 'out' los 'len' bytes de 'text' (UTF-8) sustituyendo
+ * las referencias a caracteres y a entidades por sus caracteres
+ *
+ * devuelve el nmero de bytes escritos
+ *
+ */
+size_t dtd_decode_refs(const xchar *text, size_t len, char *out)
+{
+  size_t i, j, k, first;
+  unsigned int c;
+  int ent;
+  int base;
+
+  for (i= 0, j= 0; i < len; ) {
+    if (text[i] != '&') {
+      out[j++]= text[i++];
+      continue;
+    }
+
+    /* busca el ';' que cierra la referencia */
+    for (k= i + 1; k < len && k - i <= ENT_NAME_LEN && text[k] != ';'; k++)
+      ;
+    if (k == len || text[k] != ';' || k == i + 1) {
+      out[j++]= text[i++];
+      continue;
+    }
+
+    if (text[i+1] == '#') {
+      /* referencia a carcter */
+      base= (text[i+2] == 'x' || text[i+2] == 'X') ? 16 : 10;
+      first= i + (base == 16 ? 3 : 2);
+      c= 0;
+      for (k= first; text[k] != ';'; k++) {
+        if (text[k] >= '0' && text[k] <= '9')
+          c= c * base + (text[k] - '0');
+        else if (base == 16 && text[k] >= 'a' && text[k] <= 'f')
+          c= c * base + (text[k] - 'a' + 10);
+        else if (base == 16 && text[k] >= 'A' && text[k] <= 'F')
+          c= c * base + (text[k] - 'A' + 10);
+        else
+          break;
+        if (c > 0x10FFFF) c= 0x110000;
+      }
+      if (text[k] != ';' || k == first) {
+        out[j++]= text[i++];
+        continue;
+      }
+      /* los que no son caracteres de XML se sustituyen por U+FFFD */
+      if ((c < 0x20 && c != 0x9 && c != 0xA && c != 0xD)
+          || (c >= 0xD800 && c <= 0xDFFF) || c == 0xFFFE || c == 0xFFFF
+          || c > 0x10FFFF)
+        c= 0xFFFD;
+    } else {
+      /* referencia a entidad; las desconocidas se copian como estn */
+      ent= dtd_ent_search(&text[i]);
+      if (ent < 0 || !ent_code[ent]) {
+        out[j++]= text[i++];
+        continue;
+      }
+      c= ent_code[ent];
+    }
+
+    /* el carcter no ocupa ms que la referencia */
+    j+= utf8_encode(c, &out[j]);
+    i= k + 1;
+  }
+
+  return j;
+}
+
+
+
+/*
+ * escribe el carcter 'c' en UTF-8 y devuelve su nmero de bytes
+ *
+ */
+static size_t utf8_encode(unsigned int c, char *out)
+{
+  if (c < 0x80) {
+    out[0]= (char) c;
+    return 1;
+  } else if (c < 0x800) {
+    out[0]= (char) (0xC0 | (c >> 6));
+    out[1]= (char) (0x80 | (c & 0x3F));
+    return 2;
+  } else if (c < 0x10000) {
+    out[0]= (char) (0xE0 | (c >> 12));
+    out[1]= (char) (0x80 | ((c >> 6) & 0x3F));
+    out[2]= (char) (0x80 | (c & 0x3F));
+    return 3;
+  }
+  out[0]= (char) (0xF0 | (c >> 18));
+  out[1]= (char) (0x80 | ((c >> 12) & 0x3F));
+  out[2]= (char) (0x80 | ((c >> 6) & 0x3F));
+  out[3]= (char) (0x80 | (c & 0x3F));
+  return 4;
+}
+
+
+
 
 /*
  * busca un atributo por nombre en la lista de atributos,
@@ -242,8 +375,6 @@ int  dtd_att_is_valid(int att_id, xchar *value)
 int  dtd_att_is_valid_by_type(int att_type, defaultDecl_t default_decl,
                               int defaults, xchar *value)
 {
-  char *valores;
-  char str[256];
   int valid;
 
   /* 
@@ -251,34 +382,10 @@ int  dtd_att_is_valid_by_type(int att_type, defaultDecl_t default_decl,
    * y se comprueba si est entre ellos
    *
    */
+  if (!xml_char_class_ready) init_xml_char_class();
+
   if (att_type>=0) {
-    int i,k;
-
-    valores= dtd_att_read_buffer(att_type);
-
-    /* valores[0] es '(' */
-    i= 1;
-    valid=0;
-    while (valores[i]) {
-      for (k=0; (valores[i]!='|') && (valores[i]!=')'); i++,k++) 
-        str[k]= valores[i];
-      str[k]= 0; /* termina la cadena */
-      i++; /* salta el '|'o ')'*/
-
-      /* comprueba este valor */
-      if (!strcmp(str,value)) {
-        valid=1;
-        break;
-      } else {
-        xchar lowercase[128];
-        xtolower(lowercase,value,128);
-        if (!strcmp(str,lowercase)) {
-          valid=2;
-          break;
-        }
-      }
-    } /* while */
-    
+    valid= enum_match(att_type, value);
     if (valid != 1) return valid;
   } /* if */
   else {
@@ -349,28 +456,15 @@ int  dtd_att_is_valid_by_type(int att_type, defaultDecl_t default_decl,
  */
 int dtd_att_val_search_errors(const xchar *value)
 {
-  int i;
-  xchar *v= tree_strdup(value);
-  
-  for (i=0; v[i]; i++) {
-    if (v[i]=='<') {/*free(v);*/return i;}
-    else if (v[i]=='&') {
-      int k;
-      for (k=i+1; v[k]; k++)
-        if (v[k]==';') {
-          xchar tmp= v[k+1];
-          v[k+1]= 0;
-          if (!dtd_ref_is_valid(&v[i])) {/*free(v);*/return i;}
-          else {
-            v[k+1]= tmp;
-            break;
-          }
-        }
-      if (!v[k]) {/*free(v);*/return i;}
-    }
-  } /* for */
-  
-/*   free(v); */
+  const xchar *p;
+
+  /* strcspn() salta de una vez los tramos sin '<' ni '&' */
+  for (p= value; *(p+= strcspn(p, "<&")); p++) {
+    if (*p=='<') return p - value;
+    /* '&' debe empezar una referencia terminada en ';' */
+    if (!strchr(p, ';') || !dtd_ref_is_valid(p)) return p - value;
+  }
+
   return -1;
 }
 
@@ -737,14 +831,15 @@ static int hash_value(const char *cad)
 
 /**
  * comprueba que una referencia sea vlida
- * llega como '&aacute;' o '&#333;'
+ * llega como '&aacute;' o '&#333;', seguida o no de ms texto
+ * (se mira slo hasta el primer ';', que debe existir)
  *
  * devuelve 1 si es vlida o 0 si no
  *
  */
-static int dtd_ref_is_valid(xchar *ref)
+static int dtd_ref_is_valid(const xchar *ref)
 {
-  if ((ref[0]!='&')||(ref[strlen(ref)-1]!=';')) return 0;
+  if (ref[0]!='&') return 0;
 
   if (ref[1]=='#') {
     /* referencia a carcter */
@@ -781,7 +876,7 @@ static int makeXmlCdata(xchar *value)
   
   /* verifica si cumple: Char* */
   for (i=0; value[i];i++) 
-     if (!isXmlChar(value[i])) value[i]='_';
+     if (!XML_IS(value[i], XML_CHAR)) value[i]='_';
   
   return 1;
 }
@@ -818,12 +913,12 @@ static int makeXmlId(xchar *value)
 #endif  
 
   /* primer carcter: Letter | '_' | ':' */
-  if ((value[0]!='_')&&(value[0]!=':')&&(!isXmlLetter(value[0])))
+  if ((value[0]!='_')&&(value[0]!=':')&&(!XML_IS(value[0], XML_LETTER)))
     return 0;
   
   /* el resto: NameChar* */
   for (i=1; value[i];i++) 
-    if (!isXmlNameChar(value[i])) return 0;
+    if (!XML_IS(value[i], XML_NAMECHAR)) return 0;
 
 
 
@@ -846,7 +941,7 @@ static int makeXmlNmtoken(xchar *value)
 
   /* NameChar* */
   for (i=0; value[i];i++) 
-    if (!isXmlNameChar(value[i])) value[i]='_';
+    if (!XML_IS(value[i], XML_NAMECHAR)) value[i]='_';
   
   return 1;
 }
@@ -905,6 +1000,109 @@ static int makeXmlNames(xchar *value, int atttype)
 
 
 
+/*
+ * busca el valor en la lista enumerada att_type
+ *
+ * devuelve 1 si est tal cual, 2 si est tras pasarlo a
+ * minsculas o 0 si no est
+ *
+ */
+static int enum_match(int att_type, const xchar *value)
+{
+  enum_table_t *t;
+  xchar lowercase[128];
+  const char *key;
+
+  if (att_type >= att_buffer_num) return 0;
+  if (!enum_slot[att_type] && !enum_compile(att_type)) return 0;
+  t= &enum_tables[enum_slot[att_type] - 1];
+
+  key= value;
+  if (bsearch(&key, &enum_values[t->first], t->num,
+              sizeof(enum_values[0]), enum_cmp))
+    return 1;
+
+  xtolower(lowercase,value,128);
+  if (!strcmp(lowercase,value)) return 0;
+  key= lowercase;
+  if (bsearch(&key, &enum_values[t->first], t->num,
+              sizeof(enum_values[0]), enum_cmp))
+    return 2;
+
+  return 0;
+}
+
+
+
+/*
+ * compila la lista enumerada que empieza en att_buffer[att_type],
+ * como "(valor1|valor2|...)", en una tabla ordenada
+ *
+ * devuelve 0 si no cabe en las tablas (no debera ocurrir)
+ *
+ */
+static int enum_compile(int att_type)
+{
+  enum_table_t *t;
+  char *valores;
+  int i;
+
+  valores= dtd_att_read_buffer(att_type);
+  if (!valores || valores[0]!='(') return 0;
+  if (enum_tables_num == sizeof(enum_tables)/sizeof(enum_tables[0])
+      || enum_chars_num + (int) strlen(valores) > att_buffer_num)
+    return 0;
+
+  t= &enum_tables[enum_tables_num];
+  t->first= enum_values_num;
+
+  /* valores[0] es '(' */
+  for (i= 1; valores[i]; i++) {
+    if (enum_values_num == sizeof(enum_values)/sizeof(enum_values[0])) {
+      enum_values_num= t->first;
+      return 0;
+    }
+    enum_values[enum_values_num++]= &enum_chars[enum_chars_num];
+    for (; (valores[i]!='|') && (valores[i]!=')'); i++)
+      enum_chars[enum_chars_num++]= valores[i];
+    enum_chars[enum_chars_num++]= 0;
+  }
+
+  t->num= enum_values_num - t->first;
+  qsort(&enum_values[t->first], t->num, sizeof(enum_values[0]), enum_cmp);
+  enum_slot[att_type]= ++enum_tables_num;
+
+  return 1;
+}
+
+
+
+static int enum_cmp(const void *a, const void *b)
+{
+  return strcmp(*(const char * const *) a, *(const char * const *) b);
+}
+
+
+
+/*
+ * rellena la tabla de clases de caracteres a partir de
+ * los predicados isXml...
+ *
+ */
+static void init_xml_char_class(void)
+{
+  int c;
+
+  for (c= 0; c < 256; c++) {
+    xml_char_class[c]= 0;
+    if (isXmlChar((xchar) c)) xml_char_class[c]|= XML_CHAR;
+    if (isXmlLetter((xchar) c)) xml_char_class[c]|= XML_LETTER;
+    if (isXmlNameChar((xchar) c)) xml_char_class[c]|= XML_NAMECHAR;
+  }
+  xml_char_class_ready= 1;
+}
+
+
 /*
  * comprueba si el carcter es Char segn XML
  *
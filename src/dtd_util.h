@@ -88,6 +88,23 @@ int dtd_elm_search(const char *elm_name);
 int dtd_ent_search(const char *ent_name);
 
 
+/*
+ * copia en 'out' los 'len' bytes de 'text' (UTF-8) sustituyendo
+ * las referencias a caracteres y a entidades por sus caracteres
+ * en UTF-8. Las referencias a entidades desconocidas se copian
+ * como estn, y las de caracteres que no son vlidos en XML se
+ * sustituyen por U+FFFD.
+ *
+ * el texto decodificado nunca es ms largo que 'text', por lo que
+ * basta con que 'out' tenga sitio para 'len' bytes; puede ser
+ * el propio 'text'
+ *
+ * devuelve el nmero de bytes escritos en 'out'
+ *
+ */
+size_t dtd_decode_refs(const xchar *text, size_t len, char *out);
+
+
 
 /*
  * devuelve un puntero al primer atributo coincidente
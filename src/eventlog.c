@@ -0,0 +1,235 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Jesus Arias Fisteus                             *
+ *   jaf@it.uc3m.es                                                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/*
+ * eventlog.c
+ * 
+ * Replayable log of SAX-like events (see eventlog.h).
+ *
+ * Every event is stored in a single growable buffer as:
+ *   - the type of event (one byte),
+ *   - the line number of the input in which it was found (int),
+ *   - its text data (for the events that have it), as an int with
+ *     its length followed by the text and a terminating 0,
+ *   - its attributes (start element and processing instructions),
+ *     as an int with their number followed by the name and value
+ *     of every attribute, stored like text data.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "eventlog.h"
+#include "procesador.h"
+#include "mensajes.h"
+#include "tree.h"
+
+/* as in the parser (see htmlgr.y) */
+#define MAX_EVENT_ATTRIBUTES 256
+
+int eventlog_recording = 0;
+
+static char *log_buffer = NULL;
+static size_t log_len = 0;
+static size_t log_size = 0;
+
+static void log_reserve(size_t len);
+static void log_put_int(int value);
+static void log_put_text(const xchar *text, int len);
+static int log_get_int(size_t *pos);
+static const xchar *log_get_text(size_t *pos, int *len);
+
+void eventlog_start(void)
+{
+  log_len = 0;
+  eventlog_recording = 1;
+}
+
+void eventlog_stop(void)
+{
+  eventlog_recording = 0;
+}
+
+void eventlog_record(event_type_t type, const xchar *data, int len,
+                     xchar **atts)
+{
+  int i;
+
+  log_reserve(1);
+  log_buffer[log_len++] = (char) type;
+  log_put_int(parser_num_linea);
+
+  switch (type) {
+  case EV_START_ELEMENT:
+  case EV_XML_PI:
+    log_put_text(data, -1);
+    for (i = 0; atts && atts[i]; i++);
+    log_put_int(i);
+    for (i = 0; atts && atts[i]; i++)
+      log_put_text(atts[i], -1);
+    break;
+  case EV_WHITESPACE:
+    break;
+  default:
+    log_put_text(data, len);
+    break;
+  }
+}
+
+void eventlog_replay(void)
+{
+  size_t pos;
+  event_type_t type;
+  const xchar *data;
+  int len;
+  int num_atts;
+  xchar *atts[MAX_EVENT_ATTRIBUTES + 1];
+  int i;
+
+  for (pos = 0; pos < log_len; ) {
+    type = (event_type_t) log_buffer[pos++];
+    parser_num_linea = log_get_int(&pos);
+
+    switch (type) {
+    case EV_START_ELEMENT:
+    case EV_XML_PI:
+      data = log_get_text(&pos, &len);
+      num_atts = log_get_int(&pos);
+      /* the converter may modify attribute values in place, 
+       * so that they are copied to the tree memory, as the lexer does */
+      for (i = 0; i < num_atts; i++) {
+        const xchar *att = log_get_text(&pos, &len);
+        if (i < MAX_EVENT_ATTRIBUTES)
+          atts[i] = tree_strdup(att);
+      }
+      atts[i < MAX_EVENT_ATTRIBUTES ? i : MAX_EVENT_ATTRIBUTES] = NULL;
+      if (type == EV_START_ELEMENT)
+        saxStartElement(data, atts);
+      else
+        saxXmlProcessingInstruction(data, atts);
+      break;
+    case EV_END_ELEMENT:
+      saxEndElement(log_get_text(&pos, &len));
+      break;
+    case EV_REFERENCE:
+      saxReference(log_get_text(&pos, &len));
+      break;
+    case EV_CHARACTERS:
+      data = log_get_text(&pos, &len);
+      saxCharacters(data, len);
+      break;
+    case EV_CDATA_SECTION:
+      data = log_get_text(&pos, &len);
+      saxCDataSection(data, len);
+      break;
+    case EV_WHITESPACE:
+      saxWhiteSpace();
+      break;
+    case EV_COMMENT:
+      saxComment(log_get_text(&pos, &len));
+      break;
+    case EV_DOCTYPE:
+      saxDoctype(log_get_text(&pos, &len));
+      break;
+    default:
+      EXIT("Corrupted event log");
+    }
+  }
+}
+
+size_t eventlog_size(void)
+{
+  return log_len;
+}
+
+void eventlog_free(void)
+{
+  free(log_buffer);
+  log_buffer = NULL;
+  log_len = 0;
+  log_size = 0;
+  eventlog_recording = 0;
+}
+
+
+/*
+ * -------------------------------------------------------------------
+ * internal functions
+ * -------------------------------------------------------------------
+ *
+ */
+
+static void log_reserve(size_t len)
+{
+  char *new_buffer;
+  size_t new_size;
+
+  if (log_len + len <= log_size)
+    return;
+
+  new_size = log_size ? log_size : 65536;
+  while (new_size < log_len + len)
+    new_size *= 2;
+
+  new_buffer = (char *) realloc(log_buffer, new_size);
+  if (!new_buffer)
+    EXIT("Not enough memory for the event log");
+  log_buffer = new_buffer;
+  log_size = new_size;
+}
+
+static void log_put_int(int value)
+{
+  log_reserve(sizeof(int));
+  memcpy(&log_buffer[log_len], &value, sizeof(int));
+  log_len += sizeof(int);
+}
+
+static void log_put_text(const xchar *text, int len)
+{
+  if (len < 0)
+    len = text ? strlen(text) : 0;
+  log_put_int(len);
+  log_reserve(len + 1);
+  if (len)
+    memcpy(&log_buffer[log_len], text, len);
+  log_buffer[log_len + len] = 0;
+  log_len += len + 1;
+}
+
+static int log_get_int(size_t *pos)
+{
+  int value;
+
+  memcpy(&value, &log_buffer[*pos], sizeof(int));
+  *pos += sizeof(int);
+  return value;
+}
+
+static const xchar *log_get_text(size_t *pos, int *len)
+{
+  const xchar *text;
+
+  *len = log_get_int(pos);
+  text = &log_buffer[*pos];
+  *pos += *len + 1;
+  return text;
+}
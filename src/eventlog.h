@@ -0,0 +1,95 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Jesus Arias Fisteus                             *
+ *   jaf@it.uc3m.es                                                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/*
+ * eventlog.h
+ * 
+ * Replayable log of the SAX-like events that the parser sends
+ * to the converter (see procesador.h). It allows the input
+ * document to be tokenized and parsed only once and then
+ * converted several times, e.g. once per output doctype.
+ *
+ */
+
+#ifndef EVENTLOG_H
+#define EVENTLOG_H
+
+#include "xchar.h"
+
+/* types of event */
+typedef enum {
+  EV_START_ELEMENT,
+  EV_END_ELEMENT,
+  EV_REFERENCE,
+  EV_CHARACTERS,
+  EV_CDATA_SECTION,
+  EV_WHITESPACE,
+  EV_COMMENT,
+  EV_DOCTYPE,
+  EV_XML_PI
+} event_type_t;
+
+/* while not 0, the sax* functions record events instead of 
+ * processing them */
+extern int eventlog_recording;
+
+/*
+ * Starts recording events. Any previously recorded event
+ * is discarded.
+ *
+ */
+void eventlog_start(void);
+
+/*
+ * Stops recording events.
+ *
+ */
+void eventlog_stop(void);
+
+/*
+ * Appends an event to the log. 'data' and 'len' are used by events
+ * with text (len < 0 means that data is a null-terminated string),
+ * and 'atts' by the start element and processing instruction events.
+ *
+ */
+void eventlog_record(event_type_t type, const xchar *data, int len,
+                     xchar **atts);
+
+/*
+ * Sends the recorded events to the sax* functions of the
+ * converter, in the same order they were recorded. It may be
+ * invoked several times.
+ *
+ */
+void eventlog_replay(void);
+
+/*
+ * Returns the number of bytes used by the log.
+ *
+ */
+size_t eventlog_size(void);
+
+/*
+ * Frees the memory used by the log.
+ *
+ */
+void eventlog_free(void);
+
+#endif
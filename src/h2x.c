@@ -0,0 +1,452 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Jesus Arias Fisteus                             *
+ *   jaf@it.uc3m.es                                                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/*
+ * h2x.c
+ * 
+ * Push API of the converter (see h2x.h).
+ *
+ * The parser pulls its input through charset_read(), so the bytes
+ * given to h2x_feed() are queued in the context and a parser
+ * thread reads them with the reader function read_fed_input(),
+ * which waits while there is not enough input queued. Thus, the
+ * parser, the charset decoder (which already keeps incomplete
+ * multibyte sequences for the next read) and the tree builder
+ * work while the caller waits for more input.
+ *
+ * Without threads, the input is just queued and converted by
+ * h2x_finish(). The same happens with the input of h2x_convert(),
+ * which is read directly from the caller's buffer.
+ *
+ * The events of h2x_set_handler() are generated by walk_document()
+ * from the tree, in the same order in which write_document() in
+ * procesador.c would write the nodes.
+ *
+ */
+
+/* included first to define _GNU_SOURCE if necessary */
+#include "xchar.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+#include "h2x.h"
+#include "procesador.h"
+#include "charset.h"
+#include "params.h"
+#include "mensajes.h"
+#include "tree.h"
+#include "dtd.h"
+#include "dtd_util.h"
+
+/* parser Yacc / lex */
+int yyparse(void);
+void parser_set_input(FILE *input);  /* in html.l */
+
+#define QUEUE_MIN_SIZE 65536
+
+struct h2x_ctx {
+  FILE *output;
+  const h2x_handler_t *handler;
+  void *user_data;
+  const char *input;    /* whole input (h2x_convert), or null */
+  size_t input_len;
+  char *queue;          /* input fed and not read yet by the parser */
+  size_t queue_pos;
+  size_t queue_len;
+  size_t queue_size;
+  int finished;         /* no more input (h2x_finish or h2x_free) */
+  int parse_result;     /* result of yyparse() */
+  charset_t *charset_in;   /* params changed by the conversion */
+  charset_t *charset_out;
+  char *decoded;        /* text and attribute values for the handler */
+  size_t decoded_size;
+#ifdef HAVE_PTHREAD_H
+  int thread_running;
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t input_ready;
+#endif
+};
+
+#ifdef HAVE_PTHREAD_H
+#define LOCK(ctx)       pthread_mutex_lock(&(ctx)->lock)
+#define UNLOCK(ctx)     pthread_mutex_unlock(&(ctx)->lock)
+#define WAIT_INPUT(ctx) pthread_cond_wait(&(ctx)->input_ready, &(ctx)->lock)
+#define SIGNAL_INPUT(ctx) pthread_cond_signal(&(ctx)->input_ready)
+#else
+#define LOCK(ctx)
+#define UNLOCK(ctx)
+#define WAIT_INPUT(ctx)
+#define SIGNAL_INPUT(ctx)
+#endif
+
+/* the conversion in progress */
+static h2x_ctx_t *active = NULL;
+
+static void *parse_input(void *arg);
+static size_t read_fed_input(char *buf, size_t max);
+static void end_input(h2x_ctx_t *ctx);
+static int walk_document(h2x_ctx_t *ctx);
+static int walk_start_element(h2x_ctx_t *ctx, tree_node_t *elm);
+static int reserve_decoded(h2x_ctx_t *ctx, size_t size);
+
+
+h2x_ctx_t *h2x_new(FILE *output)
+{
+  h2x_ctx_t *ctx;
+
+  if (active)
+    return NULL;
+
+  ctx = (h2x_ctx_t *) calloc(1, sizeof(h2x_ctx_t));
+  if (!ctx)
+    return NULL;
+
+  ctx->output = output;
+  ctx->charset_in = param_charset_in;
+  ctx->charset_out = param_charset_out;
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_init(&ctx->lock, NULL);
+  pthread_cond_init(&ctx->input_ready, NULL);
+#endif
+
+  tree_init();
+  messages_reset();
+  active = ctx;
+  return ctx;
+}
+
+int h2x_feed(h2x_ctx_t *ctx, const char *bytes, size_t len)
+{
+  size_t size;
+  char *queue;
+
+  if (ctx != active || ctx->finished)
+    return -1;
+
+  LOCK(ctx);
+  if (ctx->queue_len + len > ctx->queue_size) {
+    /* discard the input already read before growing the queue */
+    memmove(ctx->queue, ctx->queue + ctx->queue_pos,
+            ctx->queue_len - ctx->queue_pos);
+    ctx->queue_len -= ctx->queue_pos;
+    ctx->queue_pos = 0;
+  }
+  if (ctx->queue_len + len > ctx->queue_size) {
+    size = ctx->queue_size ? ctx->queue_size : QUEUE_MIN_SIZE;
+    while (ctx->queue_len + len > size)
+      size *= 2;
+    queue = (char *) realloc(ctx->queue, size);
+    if (!queue) {
+      UNLOCK(ctx);
+      return -1;
+    }
+    ctx->queue = queue;
+    ctx->queue_size = size;
+  }
+  memcpy(ctx->queue + ctx->queue_len, bytes, len);
+  ctx->queue_len += len;
+  SIGNAL_INPUT(ctx);
+  UNLOCK(ctx);
+
+#ifdef HAVE_PTHREAD_H
+  /* if the thread cannot be created, h2x_finish() parses the input */
+  if (!ctx->thread_running
+      && !pthread_create(&ctx->thread, NULL, parse_input, ctx))
+    ctx->thread_running = 1;
+#endif
+
+  return 0;
+}
+
+int h2x_convert(h2x_ctx_t *ctx, const char *input, size_t len)
+{
+  if (ctx != active || ctx->finished || ctx->queue_len)
+    return -1;
+
+  /* nothing was fed, so h2x_finish() parses in this thread */
+  ctx->input = input;
+  ctx->input_len = len;
+  return h2x_finish(ctx);
+}
+
+void h2x_set_handler(h2x_ctx_t *ctx, const h2x_handler_t *handler,
+                     void *user_data)
+{
+  ctx->handler = handler;
+  ctx->user_data = user_data;
+}
+
+int h2x_finish(h2x_ctx_t *ctx)
+{
+  if (ctx != active || ctx->finished)
+    return -1;
+
+  end_input(ctx);
+  if (ctx->parse_result || !document)
+    return -1;
+
+  if (ctx->handler)
+    return walk_document(ctx);
+
+  param_outputf = ctx->output;
+  charset_capture_output(ctx->output == NULL);
+  if (writeOutput())
+    return -1;
+  if (ctx->output)
+    fflush(ctx->output);
+
+  return 0;
+}
+
+const char *h2x_output(h2x_ctx_t *ctx, size_t *len)
+{
+  if (ctx->output || ctx->handler || !ctx->finished || ctx->parse_result) {
+    *len = 0;
+    return NULL;
+  }
+
+  return charset_captured_output(len);
+}
+
+void h2x_free(h2x_ctx_t *ctx)
+{
+  if (ctx != active)
+    return;
+
+  if (!ctx->finished)
+    end_input(ctx);
+
+  freeMemory();
+  messages_flush();
+  charset_capture_output(0);
+  param_charset_in = ctx->charset_in;
+  param_charset_out = ctx->charset_out;
+#ifdef HAVE_PTHREAD_H
+  pthread_cond_destroy(&ctx->input_ready);
+  pthread_mutex_destroy(&ctx->lock);
+#endif
+  free(ctx->queue);
+  free(ctx->decoded);
+  free(ctx);
+  active = NULL;
+}
+
+
+/*
+ * Marks the end of the input and waits for the parser to finish,
+ * or runs it now if it has not been started.
+ *
+ */
+static void end_input(h2x_ctx_t *ctx)
+{
+  LOCK(ctx);
+  ctx->finished = 1;
+  SIGNAL_INPUT(ctx);
+  UNLOCK(ctx);
+
+#ifdef HAVE_PTHREAD_H
+  if (ctx->thread_running) {
+    pthread_join(ctx->thread, NULL);
+    ctx->thread_running = 0;
+    return;
+  }
+#endif
+  parse_input(ctx);
+}
+
+/*
+ * Parses the whole input, as main() does with an input file
+ *
+ */
+static void *parse_input(void *arg)
+{
+  h2x_ctx_t *ctx = (h2x_ctx_t *) arg;
+  size_t preload_read;
+
+  if (ctx->input)
+    charset_set_input_memory(ctx->input, ctx->input_len);
+  else
+    charset_set_input_reader(read_fed_input);
+  charset_init_preload(NULL, &preload_read);
+  charset_auto_detect(preload_read);
+  charset_preload_to_input(param_charset_in, preload_read);
+
+  saxStartDocument();
+  parser_set_input(NULL);
+  ctx->parse_result = yyparse();
+
+  charset_close();
+  charset_set_input_memory(NULL, 0);
+  charset_set_input_reader(NULL);
+  saxEndDocument();
+
+  return NULL;
+}
+
+/*
+ * Delivers the events of the document tree to the handler. The
+ * tree is traversed without recursion, as in write_node(). Text
+ * and attribute values are decoded into ctx->decoded first.
+ * Returns 0, or -1 if there is not enough memory.
+ *
+ */
+static int walk_document(h2x_ctx_t *ctx)
+{
+  const h2x_handler_t *h = ctx->handler;
+  tree_node_t *root = document->inicio;
+  tree_node_t *n = root;
+  size_t len;
+
+  if (h->start_document)
+    h->start_document(ctx->user_data, dtd_key[document->xhtml_doctype]);
+
+  while (n) {
+    if (n->tipo == Node_element) {
+      if (walk_start_element(ctx, n))
+        return -1;
+      if (NODE_HIJO(n)) {
+        n = NODE_HIJO(n);
+        continue;
+      }
+      if (h->end_element)
+        h->end_element(ctx->user_data, ELM_ID(n), ELM_PTR(n).name);
+    } else if (n->tipo == Node_chardata) {
+      if (h->characters) {
+        if (reserve_decoded(ctx, NODE_DATA_LEN(n)))
+          return -1;
+        len = dtd_decode_refs(NODE_DATA(n), NODE_DATA_LEN(n), ctx->decoded);
+        h->characters(ctx->user_data, ctx->decoded, len);
+      }
+    } else if (n->tipo == Node_cdata_sec) {
+      if (h->cdata_section)
+        h->cdata_section(ctx->user_data, NODE_DATA(n), NODE_DATA_LEN(n));
+    } else if (n->tipo == Node_comment) {
+      if (h->comment)
+        h->comment(ctx->user_data, NODE_DATA(n), NODE_DATA_LEN(n));
+    }
+
+    /* go up until a node with a next sibling is found */
+    while (n != root && !n->sig) {
+      n = NODE_PADRE(n);
+      if (h->end_element)
+        h->end_element(ctx->user_data, ELM_ID(n), ELM_PTR(n).name);
+    }
+    if (n == root)
+      break;
+    n = NODE_SIG(n);
+  }
+
+  if (h->end_document)
+    h->end_document(ctx->user_data);
+
+  return 0;
+}
+
+static int walk_start_element(h2x_ctx_t *ctx, tree_node_t *elm)
+{
+  att_node_t *nodes[att_data_num];
+  h2x_att_t atts[att_data_num];
+  const xchar *value;
+  size_t size;
+  size_t pos;
+  int num_nodes;
+  int num;
+  int i;
+
+  if (!ctx->handler->start_element)
+    return 0;
+
+  /* as in write_start_tag(), invalid attributes are left out */
+  num_nodes = tree_node_get_atts(elm, nodes);
+  for (i = 0, num = 0, size = 0; i < num_nodes; i++) {
+    if (!nodes[i]->es_valido)
+      continue;
+    nodes[num++] = nodes[i];
+    size += strlen((const char *) tree_index_to_ptr(nodes[i]->valor)) + 1;
+  }
+  if (reserve_decoded(ctx, size))
+    return -1;
+
+  /* the decoded values, NUL-terminated, one after another */
+  for (i = 0, pos = 0; i < num; i++) {
+    value = (const xchar *) tree_index_to_ptr(nodes[i]->valor);
+    atts[i].att_id = nodes[i]->att_id;
+    atts[i].name = att_list[nodes[i]->att_id].name;
+    atts[i].value = ctx->decoded + pos;
+    pos += dtd_decode_refs(value, strlen(value), ctx->decoded + pos);
+    ctx->decoded[pos++] = 0;
+  }
+
+  ctx->handler->start_element(ctx->user_data, ELM_ID(elm),
+                              ELM_PTR(elm).name, atts, num);
+  return 0;
+}
+
+/*
+ * Makes ctx->decoded hold at least 'size' bytes.
+ * Returns 0, or -1 if there is not enough memory.
+ *
+ */
+static int reserve_decoded(h2x_ctx_t *ctx, size_t size)
+{
+  char *buf;
+
+  if (size <= ctx->decoded_size)
+    return 0;
+
+  buf = (char *) realloc(ctx->decoded, size);
+  if (!buf)
+    return -1;
+  ctx->decoded = buf;
+  ctx->decoded_size = size;
+  return 0;
+}
+
+/*
+ * Reader of the input for the charset module: like fread(), it
+ * only returns less than 'max' bytes at the end of the input,
+ * so that the conversion does not depend on the size of
+ * the chunks.
+ *
+ */
+static size_t read_fed_input(char *buf, size_t max)
+{
+  h2x_ctx_t *ctx = active;
+  size_t n;
+
+  LOCK(ctx);
+  while (ctx->queue_len - ctx->queue_pos < max && !ctx->finished)
+    WAIT_INPUT(ctx);
+
+  n = ctx->queue_len - ctx->queue_pos;
+  if (n > max)
+    n = max;
+  memcpy(buf, ctx->queue + ctx->queue_pos, n);
+  ctx->queue_pos += n;
+  UNLOCK(ctx);
+
+  return n;
+}
@@ -0,0 +1,166 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Jesus Arias Fisteus                             *
+ *   jaf@it.uc3m.es                                                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/*
+ * h2x.h
+ * 
+ * Push API of the converter, for programs that receive the input
+ * document in chunks (e.g. from the network) and do not want to
+ * wait for the whole document before converting it. Each chunk is given
+ * to h2x_feed() as it arrives and h2x_finish() completes the
+ * conversion and writes the output:
+ *
+ *   h2x_ctx_t *ctx = h2x_new(output);
+ *   while (...)
+ *     h2x_feed(ctx, bytes, len);
+ *   h2x_finish(ctx);
+ *   h2x_free(ctx);
+ *
+ * The conversion options are the param_* variables (see params.h),
+ * which must be set before h2x_new(). The converter keeps its
+ * state in global variables, so there can be only one conversion
+ * in progress at a time.
+ *
+ * Instead of writing the XHTML output, h2x_finish() can deliver
+ * the repaired document as a sequence of events to the callbacks
+ * set with h2x_set_handler(), so that programs that only need the
+ * elements, attributes and text of the document do not have to
+ * parse the XHTML output again.
+ *
+ * As in the command line program, the embedding program must
+ * define the error handler exit_on_error() (see mensajes.h),
+ * which is invoked on unrecoverable errors and must not return.
+ *
+ */
+
+#ifndef H2X_H
+#define H2X_H
+
+#include <stdio.h>
+
+typedef struct h2x_ctx h2x_ctx_t;
+
+/*
+ * An attribute of an element: its identifier in the DTD tables
+ * (att_list in dtd.h), its name and its value.
+ *
+ */
+typedef struct {
+  int att_id;
+  const char *name;
+  const char *value;
+} h2x_att_t;
+
+/*
+ * Callbacks for the events of the repaired document, which is
+ * valid against the DTD of the output doctype. Elements are
+ * identified by their elm_id in the DTD tables (elm_list in
+ * dtd.h), and their attributes come in document order.
+ *
+ * Text, attribute values, CDATA sections and comments are UTF-8.
+ * In text and attribute values, character and entity references
+ * are replaced by their characters (e.g. "&amp;" by "&" and
+ * "&nbsp;" by U+00A0), so that they can be used without an HTML
+ * entity table; references to unknown entities are kept as they
+ * are. Text is not NUL-terminated; 'len' is its number of bytes.
+ * The strings are only valid during the callback.
+ *
+ * Any callback may be null.
+ *
+ */
+typedef struct {
+  void (*start_document)(void *user_data, const char *doctype_key);
+  void (*start_element)(void *user_data, int elm_id, const char *name,
+                        const h2x_att_t *atts, int num_atts);
+  void (*end_element)(void *user_data, int elm_id, const char *name);
+  void (*characters)(void *user_data, const char *text, size_t len);
+  void (*cdata_section)(void *user_data, const char *text, size_t len);
+  void (*comment)(void *user_data, const char *text, size_t len);
+  void (*end_document)(void *user_data);
+} h2x_handler_t;
+
+/*
+ * Starts a conversion that will write its output to 'output', or
+ * keep it in memory (see h2x_output) if 'output' is null.
+ * Returns null if another conversion is in progress or if there
+ * is not enough memory.
+ *
+ */
+h2x_ctx_t *h2x_new(FILE *output);
+
+/*
+ * Gives the next 'len' bytes of the input document to the
+ * converter. The bytes are copied, so the caller may reuse
+ * 'bytes' afterwards. Chunks may end anywhere, even in the middle
+ * of a tag or of a multibyte character. When threads are
+ * available, they are tokenized and converted in the background
+ * while the caller waits for the next chunk.
+ * Returns 0, or -1 on error.
+ *
+ */
+int h2x_feed(h2x_ctx_t *ctx, const char *bytes, size_t len);
+
+/*
+ * Converts a whole input document that is already in memory, as
+ * h2x_feed() followed by h2x_finish() would do, but without
+ * copying the input and without starting a parser thread: the
+ * conversion runs in the calling thread. 'input' must be kept
+ * until it returns. It cannot be combined with h2x_feed().
+ * Returns 0, or -1 if the input could not be parsed.
+ *
+ */
+int h2x_convert(h2x_ctx_t *ctx, const char *input, size_t len);
+
+/*
+ * Makes h2x_finish() deliver the events of the repaired document
+ * to 'handler' (which is not copied) instead of writing the
+ * output. 'user_data' is passed to every callback.
+ *
+ */
+void h2x_set_handler(h2x_ctx_t *ctx, const h2x_handler_t *handler,
+                     void *user_data);
+
+/*
+ * Signals the end of the input, waits for the conversion to be
+ * completed and writes the output, or delivers its events if
+ * there is a handler.
+ * Returns 0, or -1 if the input could not be parsed or there is
+ * not enough memory.
+ *
+ */
+int h2x_finish(h2x_ctx_t *ctx);
+
+/*
+ * Returns the output kept in memory after h2x_finish() when the
+ * conversion was started with a null output file and without a
+ * handler, and sets 'len' to its number of bytes. The buffer belongs to the converter and
+ * is valid until the next conversion.
+ *
+ */
+const char *h2x_output(h2x_ctx_t *ctx, size_t *len);
+
+/*
+ * Releases the memory of the conversion, which may be finished or
+ * not. Afterwards, a new conversion can be started.
+ *
+ */
+void h2x_free(h2x_ctx_t *ctx);
+
+#endif
@@ -0,0 +1,208 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Jesus Arias Fisteus                             *
+ *   jaf@it.uc3m.es                                                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/*
+ * h2xbin.c
+ *
+ * Reader of the binary format of the document tree (see h2xbin.h).
+ * Every record is checked against the end of the buffer when it
+ * is read, so that truncated or corrupted data is detected
+ * instead of being read past the end.
+ *
+ */
+
+#include <string.h>
+
+#include "h2xbin.h"
+
+#define U16(p) ((unsigned int) (p)[0] | (unsigned int) (p)[1] << 8)
+#define U32(p) ((size_t) U16(p) | (size_t) U16((p) + 2) << 16)
+
+/* there are at least 'n' bytes left */
+#define AVAIL(r, n) ((r)->len - (r)->pos >= (size_t) (n))
+
+static int skip_names(h2xbin_reader_t *r, const unsigned char **names,
+                      int *num);
+static const char *search_name(const unsigned char *names, int num,
+                               int id, size_t *len);
+
+
+int h2xbin_open(h2xbin_reader_t *r, const void *data, size_t len)
+{
+  memset(r, 0, sizeof(h2xbin_reader_t));
+  r->data = (const unsigned char *) data;
+  r->len = len;
+
+  if (!AVAIL(r, 9) || memcmp(r->data, H2XBIN_MAGIC, 4))
+    return -1;
+  r->version = U16(r->data + 4);
+  if (r->version != H2XBIN_VERSION)
+    return -1;
+
+  r->doctype_len = r->data[8];
+  r->pos = 9;
+  if (!AVAIL(r, r->doctype_len))
+    return -1;
+  r->doctype = (const char *) r->data + r->pos;
+  r->pos += r->doctype_len;
+
+  if (skip_names(r, &r->elm_names, &r->num_elm_names) < 0
+      || skip_names(r, &r->att_names, &r->num_att_names) < 0)
+    return -1;
+
+  return 0;
+}
+
+int h2xbin_next(h2xbin_reader_t *r, h2xbin_record_t *rec)
+{
+  const unsigned char *p;
+  int i;
+
+  if (!AVAIL(r, 1))
+    return -1;
+
+  p = r->data + r->pos;
+  rec->kind = p[0];
+  rec->num_atts = 0;
+  rec->atts_left = 0;
+  rec->text = NULL;
+  rec->len = 0;
+
+  switch (rec->kind) {
+  case H2XBIN_END_DOCUMENT:
+    return 0;
+
+  case H2XBIN_START_ELEMENT:
+    if (!AVAIL(r, 5))
+      return -1;
+    rec->id = U16(p + 1);
+    rec->num_atts = U16(p + 3);
+    rec->atts_left = rec->num_atts;
+    r->pos += 5;
+    rec->next_att = r->data + r->pos;
+    /* check the attributes now, so that h2xbin_next_att() cannot fail */
+    for (i = 0; i < rec->num_atts; i++) {
+      if (!AVAIL(r, 6))
+        return -1;
+      p = r->data + r->pos;
+      r->pos += 6;
+      if (!AVAIL(r, U32(p + 2)))
+        return -1;
+      r->pos += U32(p + 2);
+    }
+    return 1;
+
+  case H2XBIN_END_ELEMENT:
+    if (!AVAIL(r, 3))
+      return -1;
+    rec->id = U16(p + 1);
+    r->pos += 3;
+    return 1;
+
+  case H2XBIN_TEXT:
+  case H2XBIN_CDATA:
+  case H2XBIN_COMMENT:
+    if (!AVAIL(r, 5))
+      return -1;
+    rec->len = U32(p + 1);
+    r->pos += 5;
+    if (!AVAIL(r, rec->len))
+      return -1;
+    rec->text = (const char *) r->data + r->pos;
+    r->pos += rec->len;
+    return 1;
+  }
+
+  return -1;
+}
+
+int h2xbin_next_att(h2xbin_record_t *rec, h2xbin_att_t *att)
+{
+  const unsigned char *p = rec->next_att;
+
+  if (rec->atts_left <= 0)
+    return 0;
+
+  att->id = U16(p);
+  att->len = U32(p + 2);
+  att->value = (const char *) p + 6;
+  rec->next_att = p + 6 + att->len;
+  rec->atts_left--;
+
+  return 1;
+}
+
+const char *h2xbin_elm_name(const h2xbin_reader_t *r, int elm_id,
+                            size_t *len)
+{
+  return search_name(r->elm_names, r->num_elm_names, elm_id, len);
+}
+
+const char *h2xbin_att_name(const h2xbin_reader_t *r, int att_id,
+                            size_t *len)
+{
+  return search_name(r->att_names, r->num_att_names, att_id, len);
+}
+
+/*
+ * Checks a name table of the header and leaves the reader after it
+ *
+ */
+static int skip_names(h2xbin_reader_t *r, const unsigned char **names,
+                      int *num)
+{
+  const unsigned char *p;
+  int i;
+
+  if (!AVAIL(r, 2))
+    return -1;
+  *num = U16(r->data + r->pos);
+  r->pos += 2;
+  *names = r->data + r->pos;
+
+  for (i = 0; i < *num; i++) {
+    if (!AVAIL(r, 3))
+      return -1;
+    p = r->data + r->pos;
+    r->pos += 3;
+    if (!AVAIL(r, p[2]))
+      return -1;
+    r->pos += p[2];
+  }
+
+  return 0;
+}
+
+static const char *search_name(const unsigned char *names, int num,
+                               int id, size_t *len)
+{
+  int i;
+
+  for (i = 0; i < num; i++) {
+    if (U16(names) == (unsigned int) id) {
+      *len = names[2];
+      return (const char *) names + 3;
+    }
+    names += 3 + names[2];
+  }
+
+  *len = 0;
+  return NULL;
+}
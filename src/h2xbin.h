@@ -0,0 +1,169 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Jesus Arias Fisteus                             *
+ *   jaf@it.uc3m.es                                                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/*
+ * h2xbin.h
+ *
+ * Binary format of the repaired document tree (option --binary),
+ * and a reader for it.
+ *
+ * The format is intended for programs that process the output of
+ * the converter and would otherwise spend their time parsing the
+ * XHTML again. The document is a sequence of records in document
+ * order, so that it can be scanned sequentially from a memory
+ * buffer or a mmap()ed file. Integers are unsigned and
+ * little-endian, and records are packed, without alignment:
+ *
+ *   header:
+ *     "H2XB"                       magic
+ *     u16 version                  H2XBIN_VERSION
+ *     u16 flags                    0
+ *     u8  len, len bytes           doctype key (e.g. "transitional")
+ *     u16 count, count times:      names of the elements used
+ *       u16 elm_id, u8 len, len bytes
+ *     u16 count, count times:      names of the attributes used
+ *       u16 att_id, u8 len, len bytes
+ *
+ *   records, each one starting with a u8 kind:
+ *     H2XBIN_START_ELEMENT  u16 elm_id, u16 num_atts, num_atts times:
+ *                             u16 att_id, u32 len, len bytes (value)
+ *     H2XBIN_END_ELEMENT    u16 elm_id
+ *     H2XBIN_TEXT           u32 len, len bytes
+ *     H2XBIN_CDATA          u32 len, len bytes
+ *     H2XBIN_COMMENT        u32 len, len bytes
+ *     H2XBIN_END_DOCUMENT   (nothing; it is the last record)
+ *
+ * elm_id and att_id are the identifiers of the DTD tables
+ * (elm_list and att_list in dtd.h), which may change between
+ * versions of html2xhtml; the names in the header allow readers
+ * not to depend on them. Text, CDATA sections, comments and
+ * attribute values are UTF-8, without a terminating NUL. In text
+ * and attribute values, character and entity references are
+ * replaced by their characters (e.g. "&lt;" by "<" and "&eacute;"
+ * by U+00E9), so readers need no HTML entity table; references to
+ * unknown entities are kept as they are, and those to characters
+ * that are not valid in XML become U+FFFD. CDATA sections and
+ * comments are written as they are. Attributes come in document
+ * order.
+ *
+ * The reader does not depend on the rest of the converter, so
+ * that it can be copied into other programs. It does not copy
+ * anything: the strings it returns point into the buffer, which
+ * must be kept while they are used.
+ *
+ *   h2xbin_reader_t r;
+ *   h2xbin_record_t rec;
+ *   h2xbin_att_t att;
+ *
+ *   if (h2xbin_open(&r, data, len) < 0)
+ *     ...
+ *   while (h2xbin_next(&r, &rec) > 0) {
+ *     if (rec.kind == H2XBIN_START_ELEMENT)
+ *       while (h2xbin_next_att(&rec, &att) > 0)
+ *         ...
+ *   }
+ *
+ */
+
+#ifndef H2XBIN_H
+#define H2XBIN_H
+
+#include <stddef.h>
+
+#define H2XBIN_MAGIC   "H2XB"
+#define H2XBIN_VERSION 1
+
+/* kinds of record */
+#define H2XBIN_END_DOCUMENT  0
+#define H2XBIN_START_ELEMENT 1
+#define H2XBIN_END_ELEMENT   2
+#define H2XBIN_TEXT          3
+#define H2XBIN_CDATA         4
+#define H2XBIN_COMMENT       5
+
+typedef struct {
+  const unsigned char *data;
+  size_t len;
+  size_t pos;           /* next record */
+  int version;
+  const char *doctype;
+  size_t doctype_len;
+  const unsigned char *elm_names;  /* name tables of the header */
+  int num_elm_names;
+  const unsigned char *att_names;
+  int num_att_names;
+} h2xbin_reader_t;
+
+/*
+ * A record. 'text' and 'len' are the text of TEXT, CDATA and
+ * COMMENT records; 'id' is the elm_id of START_ELEMENT and
+ * END_ELEMENT records, and 'num_atts' the number of attributes
+ * of START_ELEMENT records.
+ *
+ */
+typedef struct {
+  int kind;
+  int id;
+  int num_atts;
+  const char *text;
+  size_t len;
+  const unsigned char *next_att;   /* used by h2xbin_next_att */
+  int atts_left;
+} h2xbin_record_t;
+
+typedef struct {
+  int id;
+  const char *value;
+  size_t len;
+} h2xbin_att_t;
+
+/*
+ * Starts reading the 'len' bytes at 'data'. Returns 0, or -1 if
+ * they do not start with a valid header of a known version.
+ *
+ */
+int h2xbin_open(h2xbin_reader_t *r, const void *data, size_t len);
+
+/*
+ * Reads the next record into 'rec'. Returns 1, 0 after the
+ * END_DOCUMENT record, or -1 if the data is truncated or not valid.
+ *
+ */
+int h2xbin_next(h2xbin_reader_t *r, h2xbin_record_t *rec);
+
+/*
+ * Reads the next attribute of a START_ELEMENT record into 'att'.
+ * Returns 1, or 0 when there are no more attributes.
+ *
+ */
+int h2xbin_next_att(h2xbin_record_t *rec, h2xbin_att_t *att);
+
+/*
+ * Return the name of an element or attribute identifier found in
+ * the document and set 'len' to its length (the name is not
+ * NUL-terminated), or return null if the id is not in the header.
+ *
+ */
+const char *h2xbin_elm_name(const h2xbin_reader_t *r, int elm_id,
+                            size_t *len);
+const char *h2xbin_att_name(const h2xbin_reader_t *r, int att_id,
+                            size_t *len);
+
+#endif
@@ -32,7 +32,17 @@
 #endif
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <setjmp.h>
+#include <time.h>
+#ifdef HAVE_WORKING_FORK
+#include <unistd.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#endif
 
 #include "procesador.h"
 #include "dtd_names.h"
@@ -43,6 +53,13 @@
 #include "xchar.h"
 #include "params.h"
 #include "charset.h"
+#include "compress.h"
+#include "eventlog.h"
+#include "cache.h"
+#include "stats.h"
+#include "h2x.h"
+#include "warc.h"
+#include "partok.h"
 
 #ifdef WITH_CGI
 #include "cgi.h"
@@ -58,6 +75,49 @@ static void process_parameters(int argc,char **argv);
 static void help(void);
 static void print_doctypes(void);
 static void print_doctype_keys(void);
+static int  parse_input(void);
+static int  convert_multi_target(void);
+static void convert_target(int doctype);
+static char *target_file_name(int doctype);
+static char *expand_file_name(char key, const char *value);
+static int  convert_warc(void);
+static int  convert_record(const char *body, size_t len, const char *charset);
+static void write_record(unsigned long ordinal, const warc_record_t *source,
+                         int status, const char *data, size_t len,
+                         const char *charset);
+static void convert_records(warc_reader_t *reader);
+static void reserve_record_output(size_t size);
+static int  lookup_cache(void);
+static void store_in_cache(void);
+static char *read_input(FILE *input, size_t *len);
+static void set_message_limits(const char *limits);
+
+/* output doctypes in multi-target mode */
+static int targets[XHTML_NUM_DTDS];
+static int num_targets = 0;
+
+/* name of the output file (-o), or name template in multi-target mode */
+static char *output_file_name = NULL;
+
+/* the whole input document, read in advance when the cache is used */
+static char *cached_input = NULL;
+
+/* WARC mode: the input is a WARC file (see convert_warc) */
+static int warc_mode = 0;
+static int num_jobs = 0;             /* 0: one per processor */
+static int warc_compress;            /* compression of the output WARC */
+static int warc_file_per_record;     /* -o contains %n */
+static unsigned long warc_failed;
+static char warc_date[32];           /* date of the conversion records */
+
+/* output of convert_record(), and where exit_on_error() returns to
+   while a record is converted */
+static char *record_output = NULL;
+static size_t record_output_len;
+static size_t record_output_size = 0;
+static char record_charset[64];
+static int in_record = 0;
+static jmp_buf record_jump;
 
 int main(int argc,char **argv)
 {
@@ -83,7 +143,13 @@ int main(int argc,char **argv)
 #ifdef WITH_CGI
   if (!cgi_status)
     process_parameters(argc, argv);
+  if (warc_mode)
+    return convert_warc();
+
+  if (lookup_cache())
+    return 0;
 
+  stats_phase_begin(STATS_PRELOAD);
   preload_buffer = charset_init_preload(param_inputf, &preload_read);
 
   if (cgi_status > 0)
@@ -93,21 +159,32 @@ int main(int argc,char **argv)
   charset_preload_to_input(param_charset_in, preload_read);
   if (cgi_status == CGI_ST_MULTIPART)
     charset_cgi_boundary(boundary, boundary_len);
+  stats_phase_end(STATS_PRELOAD);
 #else
   /* process command line arguments */
   process_parameters(argc, argv); 
+  if (warc_mode)
+    return convert_warc();
+  if (lookup_cache())
+    return 0;
+  stats_phase_begin(STATS_PRELOAD);
   charset_init_preload(param_inputf, &preload_read);
   charset_auto_detect(preload_read);
   charset_preload_to_input(param_charset_in, preload_read);
+  stats_phase_end(STATS_PRELOAD);
 #endif
 
+  if (num_targets)
+    return convert_multi_target();
+
   /* intialize the converter */
+  stats_phase_begin(STATS_PARSE);
   saxStartDocument();
   if (param_inputf != stdin)
     parser_set_input(param_inputf);
 
   /* parse the input file and convert it */
-  yyparse_result = yyparse();
+  yyparse_result = parse_input();
 
   if (yyparse_result) {
     EXIT("Unrecoverable parse error");
@@ -115,12 +192,17 @@ int main(int argc,char **argv)
 
   charset_close();
   saxEndDocument();
+  stats_phase_end(STATS_PARSE);
 
 #ifdef WITH_CGI
   if (!cgi_status) {
     /* write the output */
+    charset_capture_output(cached_input != NULL);
+    stats_phase_begin(STATS_WRITE);
     if (writeOutput()) 
       EXIT("Bad state in writeOutput()");
+    stats_phase_end(STATS_WRITE);
+    store_in_cache();
 
     /* close de output file */
     if (param_outputf != stdout)
@@ -130,8 +212,12 @@ int main(int argc,char **argv)
   }
 #else
   /* write the output */
+  charset_capture_output(cached_input != NULL);
+  stats_phase_begin(STATS_WRITE);
   if (writeOutput()) 
     EXIT("Bad state in writeOutput()");
+  stats_phase_end(STATS_WRITE);
+  store_in_cache();
   
   /* close de output file */
   if (param_outputf != stdout)
@@ -140,6 +226,8 @@ int main(int argc,char **argv)
 
   /* show final messages */
   write_end_messages();
+  if (param_stats)
+    stats_report(stderr, param_stats == 2);
   freeMemory();
 
   return 0;
@@ -156,11 +244,18 @@ static void process_parameters(int argc, char **argv)
     } else if (!strcmp(argv[i], "-t") && ((i+1) < argc)) {
       param_doctype = dtd_get_dtd_index(argv[++i]);
     } else if (!strcmp(argv[i], "-o") && ((i+1) < argc)) {
-      /* open the output file */
-      param_outputf = fopen(argv[++i], "wb");
-      if (!param_outputf) {
-        perror("fopen");
-        EXIT("Could not open the output file for writing");
+      output_file_name = argv[++i];
+    } else if (!strcmp(argv[i], "--multi-target") && ((i+1) < argc)) {
+      char *key;
+      num_targets = 0;
+      for (key = strtok(argv[++i], ","); key; key = strtok(NULL, ",")) {
+        tmpnum = dtd_get_dtd_index(key);
+        if (tmpnum < 0) {
+          EPRINTF1("Trying to set output doctype: %s\n", key);
+          EXIT("Unknown doctype key");
+        }
+        if (num_targets < XHTML_NUM_DTDS)
+          targets[num_targets++] = tmpnum;
       }
     } else if (!strcmp(argv[i], "-l") && ((i+1) < argc)) {
       tmpnum= atoi(argv[++i]);
@@ -182,6 +277,52 @@ static void process_parameters(int argc, char **argv)
       param_empty_tags = 1;
     } else if (!strcmp(argv[i], "--dos-eol")) {
       param_crlf_eol = 1;
+    } else if (!strcmp(argv[i], "--no-reflow")) {
+      param_no_reflow = 1;
+    } else if (!strcmp(argv[i], "--ncr-fallback")) {
+      param_ncr_fallback = 1;
+    } else if (!strcmp(argv[i], "--binary")) {
+      param_binary_output = 1;
+    } else if (!strcmp(argv[i], "--compress") && ((i+1) < argc)) {
+      i++;
+      if (!strcmp(argv[i], "none"))
+        param_compress = COMPRESS_NONE;
+      else if (!strcmp(argv[i], "gzip"))
+        param_compress = COMPRESS_GZIP;
+      else if (!strcmp(argv[i], "zstd"))
+        param_compress = COMPRESS_ZSTD;
+      else
+        EXIT("Unknown value for --compress");
+      if (!compress_available(param_compress))
+        EXIT("This compression format is not available in this build");
+    } else if (!strcmp(argv[i], "--compress-level") && ((i+1) < argc)) {
+      tmpnum = atoi(argv[++i]);
+      if (tmpnum >= 0 && tmpnum <= 19)
+        param_compress_level = tmpnum;
+    } else if (!strcmp(argv[i], "--warc")) {
+      warc_mode = 1;
+    } else if (!strcmp(argv[i], "--jobs") && ((i+1) < argc)) {
+      tmpnum = atoi(argv[++i]);
+      if (tmpnum > 0)
+        num_jobs = tmpnum;
+    } else if (!strcmp(argv[i], "--messages") && ((i+1) < argc)) {
+      i++;
+      if (!strcmp(argv[i], "none"))
+        param_messages = MESSAGES_NONE;
+      else if (!strcmp(argv[i], "summary"))
+        param_messages = MESSAGES_SUMMARY;
+      else if (!strcmp(argv[i], "text"))
+        param_messages = MESSAGES_TEXT;
+      else if (!strcmp(argv[i], "json"))
+        param_messages = MESSAGES_JSON;
+      else
+        EXIT("Unknown value for --messages");
+    } else if (!strcmp(argv[i], "--message-limit") && ((i+1) < argc)) {
+      set_message_limits(argv[++i]);
+    } else if (!strcmp(argv[i], "--stats")) {
+      param_stats = 1;
+    } else if (!strcmp(argv[i], "--stats=json")) {
+      param_stats = 2;
     } else if (!strcmp(argv[i], "--system-dtd-prefix") && ((i+1) < argc)) {
       param_system_dtd_prefix = argv[++i];
     } else if (!fich && argv[i][0]!='-') {
@@ -217,22 +358,805 @@ static void process_parameters(int argc, char **argv)
       exit(0);
     } else if (!strcmp(argv[i], "--generate-snippet")) {
       param_generate_snippet = 1;
+    } else if (!strcmp(argv[i], "--cache-dir") && ((i+1) < argc)) {
+      param_cache_dir = argv[++i];
+    } else if (!strcmp(argv[i], "--cache-size") && ((i+1) < argc)) {
+      tmpnum = atoi(argv[++i]);
+      if (tmpnum > 0)
+        param_cache_size = (unsigned long) tmpnum * 1024 * 1024;
     } else {
       help();
       exit(1);
     }
   } 
+
+  if (warc_mode && num_targets)
+    EXIT("--warc cannot be combined with --multi-target");
+  if (warc_mode && output_file_name && strstr(output_file_name, "%n")) {
+    /* one file per record: they are opened by write_record() */
+    warc_file_per_record = 1;
+  } else if (num_targets) {
+    if (!output_file_name || !strstr(output_file_name, "%t"))
+      EXIT("--multi-target requires an output file name (-o) containing %t");
+  } else if (output_file_name) {
+    /* open the output file */
+    param_outputf = fopen(output_file_name, "wb");
+    if (!param_outputf) {
+      perror("fopen");
+      EXIT("Could not open the output file for writing");
+    }
+  }
 }
 
-int yyerror(char *e)
+/*
+ * When the conversion cache is enabled, reads the whole input,
+ * which is then parsed from memory, and looks for its conversion
+ * in the cache. If found, writes it and returns 1.
+ *
+ */
+static int lookup_cache(void)
 {
-  /* Let bison's error recovery mechanisms work */
-  WARNING(e);
-  return 0;
+  size_t len;
+
+  if (!param_cache_dir || num_targets)
+    return 0;
+
+  cached_input = read_input(param_inputf, &len);
+  charset_set_input_memory(cached_input, len);
+  cache_set_key(cached_input, len);
+
+  if (!cache_lookup(param_outputf))
+    return 0;
+
+  if (param_outputf != stdout)
+    fclose(param_outputf);
+  write_end_messages();
+  free(cached_input);
+  freeMemory();
+
+  return 1;
+}
+
+/*
+ * Stores the output just written in the cache, if enabled.
+ *
+ */
+static void store_in_cache(void)
+{
+  char *output;
+  size_t len;
+
+  if (!cached_input)
+    return;
+
+  output = charset_captured_output(&len);
+  cache_store(output, len);
+  charset_capture_output(0);
+  charset_set_input_memory(NULL, 0);
+  free(cached_input);
+  cached_input = NULL;
+}
+
+static char *read_input(FILE *input, size_t *len)
+{
+  char *data = NULL;
+  char *new_data;
+  size_t size = 0;
+  size_t nread;
+
+  *len = 0;
+  do {
+    if (*len == size) {
+      size = size ? 2 * size : 65536;
+      new_data = (char *) realloc(data, size);
+      if (!new_data)
+        EXIT("Not enough memory to read the input");
+      data = new_data;
+    }
+    nread = fread(data + *len, 1, size - *len, input);
+    *len += nread;
+  } while (nread > 0);
+
+  if (ferror(input)) {
+    perror("read");
+    EXIT("Error reading the input");
+  }
+
+  return data;
+}
+
+/*
+ * Parses the input. With --jobs, large documents are tokenized
+ * by several processes (see partok.h).
+ *
+ * Returns the result of yyparse().
+ *
+ */
+static int parse_input(void)
+{
+  if (num_jobs > 1)
+    return partok_parse(num_jobs);
+  return yyparse();
+}
+
+/*
+ * Multi-target mode: the input is parsed only once, recording the
+ * parser events in an event log (see eventlog.h). Then, the log
+ * is replayed to build and write a tree for each output doctype.
+ * Each tree is built in a child process, which lets them run
+ * concurrently without sharing the state of the converter.
+ *
+ * Returns the exit status for the program.
+ *
+ */
+static int convert_multi_target(void)
+{
+  int i;
+  int status = 0;
+#ifdef HAVE_WORKING_FORK
+  pid_t pids[XHTML_NUM_DTDS];
+  FILE *messages[XHTML_NUM_DTDS];
+  int child_status;
+  int c;
+#endif
+
+  stats_phase_begin(STATS_PARSE);
+  eventlog_start();
+  if (param_inputf != stdin)
+    parser_set_input(param_inputf);
+  if (parse_input())
+    EXIT("Unrecoverable parse error");
+  eventlog_stop();
+  charset_close();
+  stats_phase_end(STATS_PARSE);
+
+#ifdef HAVE_WORKING_FORK
+  /* the warnings of the parser must not be repeated by each child */
+  messages_flush();
+  fflush(NULL);
+  for (i = 0; i < num_targets; i++) {
+    /* messages of each child are shown after it finishes */
+    messages[i] = tmpfile();
+    pids[i] = fork();
+    if (pids[i] == 0) {
+      if (messages[i])
+        dup2(fileno(messages[i]), fileno(stderr));
+      convert_target(targets[i]);
+      write_end_messages();
+      if (param_stats)
+        stats_report(stderr, param_stats == 2);
+      exit(0);
+    } else if (pids[i] < 0) {
+      perror("fork");
+      convert_target(targets[i]);
+    }
+  }
+
+  for (i = 0; i < num_targets; i++) {
+    if (pids[i] > 0) {
+      if (waitpid(pids[i], &child_status, 0) < 0
+          || !WIFEXITED(child_status) || WEXITSTATUS(child_status) != 0)
+        status = 1;
+    }
+    if (messages[i]) {
+      rewind(messages[i]);
+      if ((c = getc(messages[i])) != EOF) {
+        fprintf(stderr, "Target %s:\n", dtd_key[targets[i]]);
+        do {
+          putc(c, stderr);
+        } while ((c = getc(messages[i])) != EOF);
+      }
+      fclose(messages[i]);
+    }
+  }
+#else
+  for (i = 0; i < num_targets; i++)
+    convert_target(targets[i]);
+  write_end_messages();
+  if (param_stats)
+    stats_report(stderr, param_stats == 2);
+#endif
+
+  eventlog_free();
+  freeMemory();
+
+  return status;
+}
+
+/*
+ * Builds the tree for the given doctype from the event log
+ * and writes it.
+ *
+ */
+static void convert_target(int doctype)
+{
+  param_doctype = doctype;
+  param_outputf = fopen(target_file_name(doctype), "wb");
+  if (!param_outputf) {
+    perror("fopen");
+    EXIT("Could not open the output file for writing");
+  }
+
+  stats_phase_begin(STATS_PARSE);
+  saxStartDocument();
+  eventlog_replay();
+  saxEndDocument();
+  stats_phase_end(STATS_PARSE);
+
+  stats_phase_begin(STATS_WRITE);
+  if (writeOutput()) 
+    EXIT("Bad state in writeOutput()");
+  stats_phase_end(STATS_WRITE);
+  fclose(param_outputf);
+}
+
+/*
+ * WARC mode: converts every HTML document of the responses in the
+ * input WARC file, and writes the conversions as "conversion"
+ * records of an output WARC file, or each one to its own file when
+ * the output file name contains %n, which is replaced by the number
+ * of the record in the input. With fork(), the records are
+ * converted by several child processes, but written in the order
+ * of the input.
+ *
+ * Returns the exit status for the program.
+ *
+ */
+static int convert_warc(void)
+{
+  warc_reader_t *reader;
+  time_t now = time(NULL);
+
+  strftime(warc_date, sizeof(warc_date), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+  warc_compress = param_compress;
+  if (!warc_file_per_record) {
+    /* the WARC writer compresses each record on its own */
+    param_compress = COMPRESS_NONE;
+  }
+  if (!num_jobs) {
+    num_jobs = 1;
+#ifdef HAVE_WORKING_FORK
+    if (sysconf(_SC_NPROCESSORS_ONLN) > 1)
+      num_jobs = (int) sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+  }
+
+  reader = warc_open(param_inputf);
+  convert_records(reader);
+  warc_close(reader);
+
+  if (param_outputf != stdout)
+    fclose(param_outputf);
+  write_end_messages();
+  free(record_output);
+  freeMemory();
+
+  return warc_failed > 0;
+}
+
+/*
+ * Converts the HTML document 'body' of a WARC record, whose HTTP
+ * response declares 'charset' (or "" if it does not), and leaves
+ * its output in record_output. Returns 0, or -1 if the conversion
+ * failed.
+ *
+ */
+static int convert_record(const char *body, size_t len, const char *charset)
+{
+  h2x_ctx_t *volatile ctx = NULL;
+  charset_t *user_charset = param_charset_in;
+  charset_t *volatile charset_in = param_charset_in;
+  const char *output;
+  size_t output_len;
+  volatile int status = 0;
+
+  /* --ics has precedence over the charset of the response, and
+     both over the autodetected one */
+  if (!charset_in && charset[0])
+    charset_in = charset_lookup_alias(charset);
+  record_output_len = 0;
+  record_charset[0] = 0;
+
+  in_record = 1;
+  if (setjmp(record_jump)) {
+    /* the conversion was aborted: leave the converter ready */
+    charset_close();
+    status = -1;
+  } else {
+    ctx = h2x_new(NULL);
+    if (!ctx)
+      EXIT("Not enough memory to convert the record");
+    /* h2x_free() restores the charset of --ics */
+    param_charset_in = charset_in;
+    if (!user_charset && charset[0] && !charset_in)
+      WARNING(MSG_UNKNOWN_CHARSET,
+              "Unknown charset in the HTTP response; autodetecting it");
+    if (h2x_convert(ctx, body, len))
+      EXIT("Unrecoverable parse error");
+
+    output = h2x_output(ctx, &output_len);
+    reserve_record_output(output_len);
+    memcpy(record_output, output, output_len);
+    record_output_len = output_len;
+    if (param_charset_out) {
+      strncpy(record_charset, param_charset_out->preferred_name,
+              sizeof(record_charset) - 1);
+      record_charset[sizeof(record_charset) - 1] = 0;
+    }
+  }
+  in_record = 0;
+
+  if (ctx)
+    h2x_free(ctx);
+  return status;
+}
+
+/*
+ * Writes the conversion of the record number 'ordinal' of the input,
+ * or a warning if it failed.
+ *
+ */
+static void write_record(unsigned long ordinal, const warc_record_t *source,
+                         int status, const char *data, size_t len,
+                         const char *charset)
+{
+  char msg[WARC_URI_SIZE + 64];
+  char content_type[128];
+  FILE *file;
+
+  if (status) {
+    parser_num_linea = 0;
+    snprintf(msg, sizeof(msg), "Record %lu not converted: %s",
+             ordinal, source->target_uri);
+    WARNING(MSG_WARC_RECORD, msg);
+    /* before the next conversion resets the messages */
+    messages_flush();
+    warc_failed++;
+    return;
+  }
+
+  if (warc_file_per_record) {
+    snprintf(msg, sizeof(msg), "%lu", ordinal);
+    file = fopen(expand_file_name('n', msg), "wb");
+    if (!file) {
+      perror("fopen");
+      EXIT("Could not open the output file for writing");
+    }
+    if (fwrite(data, 1, len, file) != len)
+      EXIT("Error writing the output file");
+    fclose(file);
+  } else {
+    if (param_binary_output)
+      strcpy(content_type, "application/octet-stream");
+    else
+      snprintf(content_type, sizeof(content_type),
+               "application/xhtml+xml; charset=%s", charset);
+    warc_write_conversion(param_outputf, source, content_type, warc_date,
+                          data, len, warc_compress, param_compress_level);
+  }
+}
+
+static void reserve_record_output(size_t size)
+{
+  char *output;
+
+  if (size <= record_output_size)
+    return;
+  output = (char *) realloc(record_output, size);
+  if (!output)
+    EXIT("Not enough memory to convert the record");
+  record_output = output;
+  record_output_size = size;
+}
+
+#ifndef HAVE_WORKING_FORK
+
+/*
+ * Converts the records one after another.
+ *
+ */
+static void convert_records(warc_reader_t *reader)
+{
+  warc_record_t *record;
+  unsigned long ordinal = 0;
+  char *body;
+  size_t len;
+  char charset[64];
+  int status;
+
+  record = (warc_record_t *) malloc(sizeof(warc_record_t));
+  if (!record)
+    EXIT("Not enough memory to read the WARC file");
+  while (warc_next(reader, record)) {
+    ordinal++;
+    if (!warc_html_response(record, &body, &len, charset, sizeof(charset)))
+      continue;
+    status = convert_record(body, len, charset);
+    write_record(ordinal, record, status, record_output, record_output_len,
+                 record_charset);
+  }
+  free(record);
+}
+
+#else
+
+
+/* a record sent to a worker process, followed by its body */
+typedef struct {
+  size_t len;
+  char charset[64];
+} warc_job_t;
+
+/* its conversion, followed by the output and the warnings */
+typedef struct {
+  int status;
+  size_t len;
+  size_t messages_len;
+  char charset[64];
+} warc_result_t;
+
+typedef struct {
+  pid_t pid;                /* 0 if not running */
+  int job_fd;
+  int result_fd;
+  int busy;                 /* converting 'source' */
+  unsigned long ordinal;
+  warc_record_t source;
+} warc_worker_t;
+
+static warc_worker_t *workers;
+
+static int  start_worker(int k);
+static void stop_worker(int k);
+static void run_worker(int job_fd, int result_fd);
+static void collect_record(int k);
+static int  read_all(int fd, void *buf, size_t len);
+static int  write_all(int fd, const void *buf, size_t len);
+
+/*
+ * Converts the records with num_jobs worker processes. Record n
+ * goes to worker n % num_jobs, whose previous record is collected
+ * and written first; thus, the conversions are written in order,
+ * and a slow record delays the writing, but not the conversion, of
+ * the next ones.
+ *
+ */
+static void convert_records(warc_reader_t *reader)
+{
+  warc_record_t *record;
+  warc_job_t job;
+  unsigned long ordinal = 0;
+  unsigned long seq = 0;
+  char *body;
+  size_t len;
+  int status;
+  int i, k;
+
+  record = (warc_record_t *) malloc(sizeof(warc_record_t));
+  workers = (warc_worker_t *) calloc(num_jobs, sizeof(warc_worker_t));
+  if (!record || !workers)
+    EXIT("Not enough memory to read the WARC file");
+  /* a worker that dies is detected when its result is read */
+  signal(SIGPIPE, SIG_IGN);
+
+  while (warc_next(reader, record)) {
+    ordinal++;
+    if (!warc_html_response(record, &body, &len, job.charset,
+                            sizeof(job.charset)))
+      continue;
+    k = seq++ % num_jobs;
+    if (workers[k].busy)
+      collect_record(k);
+    if (!workers[k].pid && !start_worker(k)) {
+      /* no more processes: write the pending records and convert
+         this one here */
+      for (i = 1; i < num_jobs; i++)
+        if (workers[(k + i) % num_jobs].busy)
+          collect_record((k + i) % num_jobs);
+      status = convert_record(body, len, job.charset);
+      write_record(ordinal, record, status, record_output,
+                   record_output_len, record_charset);
+      continue;
+    }
+
+    job.len = len;
+    workers[k].busy = 1;
+    workers[k].ordinal = ordinal;
+    workers[k].source = *record;
+    workers[k].source.block = NULL;
+    if (write_all(workers[k].job_fd, &job, sizeof(job)))
+      write_all(workers[k].job_fd, body, len);
+  }
+
+  /* the pending records, from the oldest one */
+  for (i = 0; i < num_jobs; i++) {
+    k = (seq + i) % num_jobs;
+    if (workers[k].busy)
+      collect_record(k);
+  }
+  for (k = 0; k < num_jobs; k++)
+    stop_worker(k);
+
+  free(workers);
+  free(record);
+}
+
+static int start_worker(int k)
+{
+  int job_pipe[2];
+  int result_pipe[2];
+  pid_t pid;
+  int i;
+
+  if (pipe(job_pipe) < 0)
+    return 0;
+  if (pipe(result_pipe) < 0) {
+    close(job_pipe[0]);
+    close(job_pipe[1]);
+    return 0;
+  }
+
+  fflush(NULL);
+  pid = fork();
+  if (pid == 0) {
+    close(job_pipe[1]);
+    close(result_pipe[0]);
+    /* the other workers must see the end of their jobs */
+    for (i = 0; i < num_jobs; i++) {
+      if (workers[i].pid) {
+        close(workers[i].job_fd);
+        close(workers[i].result_fd);
+      }
+    }
+    run_worker(job_pipe[0], result_pipe[1]);
+  }
+
+  close(job_pipe[0]);
+  close(result_pipe[1]);
+  if (pid < 0) {
+    perror("fork");
+    close(job_pipe[1]);
+    close(result_pipe[0]);
+    return 0;
+  }
+  workers[k].pid = pid;
+  workers[k].job_fd = job_pipe[1];
+  workers[k].result_fd = result_pipe[0];
+  return 1;
+}
+
+static void stop_worker(int k)
+{
+  if (!workers[k].pid)
+    return;
+
+  close(workers[k].job_fd);
+  close(workers[k].result_fd);
+  waitpid(workers[k].pid, NULL, 0);
+  workers[k].pid = 0;
+}
+
+/*
+ * Main loop of a worker process: converts the records that arrive
+ * through 'job_fd' and sends their results through 'result_fd'.
+ * Its warnings are written to a temporary file, and sent with the
+ * result of each record.
+ *
+ */
+static void run_worker(int job_fd, int result_fd)
+{
+  FILE *messages = tmpfile();
+  off_t start = 0;
+  off_t end;
+  warc_job_t job;
+  warc_result_t result;
+  char *body = NULL;
+  size_t size = 0;
+
+  if (messages)
+    dup2(fileno(messages), fileno(stderr));
+
+  while (read_all(job_fd, &job, sizeof(job))) {
+    if (job.len + 1 > size) {
+      free(body);
+      size = job.len + 1;
+      body = (char *) malloc(size);
+      if (!body)
+        break;
+    }
+    if (!read_all(job_fd, body, job.len))
+      break;
+
+    memset(&result, 0, sizeof(result));
+    job.charset[sizeof(job.charset) - 1] = 0;
+    result.status = convert_record(body, job.len, job.charset);
+    if (!result.status) {
+      result.len = record_output_len;
+      strcpy(result.charset, record_charset);
+    }
+
+    /* append the warnings to the output */
+    fflush(stderr);
+    end = messages ? lseek(fileno(stderr), 0, SEEK_END) : 0;
+    if (end > start) {
+      result.messages_len = end - start;
+      reserve_record_output(result.len + result.messages_len);
+      lseek(fileno(stderr), start, SEEK_SET);
+      if (!read_all(fileno(stderr), record_output + result.len,
+                    result.messages_len))
+        result.messages_len = 0;
+      start = end;
+    }
+
+    if (!write_all(result_fd, &result, sizeof(result))
+        || !write_all(result_fd, record_output,
+                      result.len + result.messages_len))
+      break;
+  }
+
+  _exit(0);
+}
+
+/*
+ * Reads the result of the record converted by worker 'k' and
+ * writes it. If the worker died, the record is reported as not
+ * converted, and another worker will be started when needed.
+ *
+ */
+static void collect_record(int k)
+{
+  warc_result_t result;
+
+  workers[k].busy = 0;
+  if (!read_all(workers[k].result_fd, &result, sizeof(result))) {
+    stop_worker(k);
+    write_record(workers[k].ordinal, &workers[k].source, -1, NULL, 0, "");
+    return;
+  }
+  reserve_record_output(result.len + result.messages_len);
+  if (!read_all(workers[k].result_fd, record_output,
+                result.len + result.messages_len)) {
+    stop_worker(k);
+    write_record(workers[k].ordinal, &workers[k].source, -1, NULL, 0, "");
+    return;
+  }
+
+  if (result.messages_len) {
+    fprintf(stderr, "Record %lu (%s):\n", workers[k].ordinal,
+            workers[k].source.target_uri);
+    fwrite(record_output + result.len, 1, result.messages_len, stderr);
+  }
+  result.charset[sizeof(result.charset) - 1] = 0;
+  write_record(workers[k].ordinal, &workers[k].source, result.status,
+               record_output, result.len, result.charset);
+}
+
+/*
+ * Read or write exactly 'len' bytes. Return 1, or 0 on error or at
+ * the end of the file.
+ *
+ */
+static int read_all(int fd, void *buf, size_t len)
+{
+  char *p = (char *) buf;
+  ssize_t n;
+
+  while (len > 0) {
+    n = read(fd, p, len);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return 0;
+    p += n;
+    len -= n;
+  }
+  return 1;
+}
+
+static int write_all(int fd, const void *buf, size_t len)
+{
+  const char *p = (const char *) buf;
+  ssize_t n;
+
+  while (len > 0) {
+    n = write(fd, p, len);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return 0;
+    p += n;
+    len -= n;
+  }
+  return 1;
+}
+
+#endif
+
+/*
+ * Sets param_message_limit from a comma-separated list of limits:
+ * "<number>" for every type of warning, or "<type>=<number>"
+ * for one of them.
+ *
+ */
+static void set_message_limits(const char *limits)
+{
+  const char *p = limits;
+  char name[32];
+  size_t len;
+  int code;
+  int i;
+
+  while (*p) {
+    len = strcspn(p, ",=");
+    if (p[len] == '=') {
+      if (len >= sizeof(name))
+        len = sizeof(name) - 1;
+      memcpy(name, p, len);
+      name[len] = 0;
+      code = messages_code(name);
+      if (code < 0) {
+        EPRINTF1("Unknown type of warning: %s\n", name);
+        EXIT("Unknown type of warning in --message-limit");
+      }
+      p += strcspn(p, "=") + 1;
+      param_message_limit[code] = strtoul(p, NULL, 10);
+    } else {
+      for (i = 0; i < MSG_NUM_CODES; i++)
+        param_message_limit[i] = strtoul(p, NULL, 10);
+    }
+    p += strcspn(p, ",");
+    if (*p == ',')
+      p++;
+  }
+}
+
+/*
+ * Returns the output file name for the doctype, replacing
+ * every "%t" in the template with its key.
+ *
+ */
+static char *target_file_name(int doctype)
+{
+  return expand_file_name('t', dtd_key[doctype]);
+}
+
+/*
+ * Returns the output file name template (-o) with every "%<key>"
+ * replaced by 'value'.
+ *
+ */
+static char *expand_file_name(char key, const char *value)
+{
+  static char name[4096];
+  const char *p;
+  size_t len = 0;
+  size_t value_len = strlen(value);
+
+  for (p = output_file_name; *p && len < sizeof(name) - 1; p++) {
+    if (p[0] == '%' && p[1] == key) {
+      if (len + value_len >= sizeof(name) - 1)
+        break;
+      memcpy(&name[len], value, value_len);
+      len += value_len;
+      p++;
+    } else {
+      name[len++] = *p;
+    }
+  }
+  name[len] = 0;
+
+  return name;
 }
 
 void exit_on_error(char *msg)
 {
+  if (in_record) {
+    /* only the conversion of the WARC record fails */
+    messages_flush();
+    fprintf(stderr, "Error [line %d]: %s\n", parser_num_linea, msg);
+    longjmp(record_jump, 1);
+  }
+
 #ifdef WITH_CGI
     /* this function exits the program */
   if (cgi_status) {  
@@ -244,6 +1168,7 @@ void exit_on_error(char *msg)
     fprintf(stderr,"!!%s(%d)[l%d]: %s\n",__FILE__,__LINE__,
             parser_num_linea,msg);
 #else
+    messages_flush();
     fprintf(stderr,"Error [line %d]: %s\n", parser_num_linea, msg);    
 #endif
     write_end_messages();
@@ -263,11 +1188,18 @@ static void help(void)
   fprintf(stderr, "html2xhtml [<input_html_file>] [-t <output_doctype_key>] [-e]\n");
   fprintf(stderr, "           [-o <output_file>]\n");
   fprintf(stderr, "           [--ics <input_charset>] [--ocs <output_charset>]\n");
+  fprintf(stderr, "           [--ncr-fallback]\n");
   fprintf(stderr, "           [-l <line_length>] [-b <tab_length>]\n");
   fprintf(stderr, "           [--preserve-space-comments] [--no-protect-cdata]\n");
   fprintf(stderr, "           [--compact-block-elements] [--empty-elm-tags-always]\n");
-  fprintf(stderr, "           [--compact-empty-elm-tags] [--dos-eol]\n");
-  fprintf(stderr, "           [--generate-snippet]\n");
+  fprintf(stderr, "           [--compact-empty-elm-tags] [--dos-eol] [--no-reflow]\n");
+  fprintf(stderr, "           [--generate-snippet] [--binary] [--stats[=json]]\n");
+  fprintf(stderr, "           [--compress none|gzip|zstd] [--compress-level <level>]\n");
+  fprintf(stderr, "           [--multi-target <doctype_key>[,<doctype_key>...]]\n");
+  fprintf(stderr, "           [--warc] [--jobs <number>]\n");
+  fprintf(stderr, "           [--cache-dir <directory>] [--cache-size <megabytes>]\n");
+  fprintf(stderr, "           [--messages none|summary|text|json]\n");
+  fprintf(stderr, "           [--message-limit [<type>=]<number>[,...]]\n");
   fprintf(stderr, "           [--system-dtd-prefix <dtd_location_prefix>]\n");
   fprintf(stderr, "\n");
   print_doctypes();
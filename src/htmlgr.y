@@ -21,12 +21,6 @@ static void setAttributeData(char *data);
 static char *element_attributes[MAX_ELEMENT_ATTRIBUTES];
 static int num_element_attributes= 0;
 
-/* set the lexer in the script mode */
-void lexer_begin_script(char *nombre);
-
-/* control <pre> elements */
-extern int pre_state;
-
 extern int yylex (void);
  extern int yyerror(char *e);
 
@@ -92,11 +86,9 @@ stag: TOK_STAG_INI attributes TOK_STAG_END {
 /*   freeAttributeData(); */
   num_element_attributes = 0;
 
-  /* set the lexer in script mode (for SCRIPT and STYLE) */
-  if ((!strcasecmp($1,"script")) ||(!strcasecmp($1,"style")))
-    lexer_begin_script($1);
-
-  if (!strcasecmp($1,"pre")) {DEBUG("enter PRE mode");pre_state++;}
+  /* the lexer itself enters the script mode after the start tags
+     of script and style elements and counts the open pre elements
+     (see lexer_end_stag() in html.l) */
 
 /*   free($1); */
 }
@@ -105,7 +97,6 @@ stag: TOK_STAG_INI attributes TOK_STAG_END {
 etag: TOK_ETAG {
   //fprintf(stderr,"ETAG-: %s\n",$1);
   saxEndElement($1);
-  if (!strcasecmp($1,"pre")) {DEBUG("leaving PRE mode");pre_state--;}
 
 /*   free($1); */
 }
@@ -209,3 +200,10 @@ static void setAttributeData(char *data)
 
   element_attributes[num_element_attributes++]= data;
 }
+
+int yyerror(char *e)
+{
+  /* Let bison's error recovery mechanisms work */
+  WARNING(MSG_SYNTAX_ERROR, e);
+  return 0;
+}
@@ -0,0 +1,749 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Jesus Arias Fisteus                             *
+ *   jaf@it.uc3m.es                                                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/*
+ * kernelbench.c
+ *
+ * Microbenchmarks for the internal kernels of the converter:
+ * DTD lookups, content model checks, attribute value repair,
+ * the writer and the charset converters. Every kernel runs
+ * in isolation, without a whole conversion.
+ *
+ * Use:
+ *    kernelbench [-r <repetitions>] [-s <scale>] [--json] [<kernel>...]
+ *    kernelbench -l
+ *
+ * A kernel is selected if its name begins with any of the given
+ * names (e.g. "charset_read" selects it for every charset).
+ * Times are measured with the time stamp counter when available
+ * (cycles) or with a monotonic clock (nanoseconds).
+ *
+ */
+
+/* included first to define _GNU_SOURCE if necessary */
+#include "xchar.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <iconv.h>
+#include <time.h>
+
+#include "dtd.h"
+#include "dtd_names.h"
+#include "dtd_util.h"
+#include "tree.h"
+#include "procesador.h"
+#include "charset.h"
+#include "params.h"
+#include "mensajes.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define TIMER_UNIT "cycles"
+static unsigned long long read_timer(void)
+{
+  _mm_lfence();
+  return __rdtsc();
+}
+#else
+#define TIMER_UNIT "ns"
+static unsigned long long read_timer(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+#endif
+
+#define DOCTYPE XHTML_TRANSITIONAL
+#define MAX_KERNELS 64
+
+/* defined by the lexer in libh2x; set to -1 in main() because the
+   kernels run without any input line to report */
+extern int parser_num_linea;
+
+typedef struct {
+  char name[48];
+  size_t (*setup)(int arg); /* once, before the first repetition;
+                               returns the bytes processed per
+                               operation, or 0 */
+  void (*begin)(int arg);   /* before every repetition (not timed) */
+  void (*run)(int arg, long ops);
+  void (*end)(int arg);     /* after every repetition (not timed) */
+  int arg;
+  long ops;                 /* operations per repetition */
+} kernel_t;
+
+static kernel_t kernels[MAX_KERNELS];
+static int num_kernels = 0;
+
+/* a sink for results, so that the compiler does not remove calls */
+static volatile long sink;
+
+static void add_kernel(const char *name, size_t (*setup)(int),
+                       void (*begin)(int), void (*run)(int, long),
+                       void (*end)(int), int arg, long ops);
+static void run_kernel(kernel_t *k, int reps, int scale, int json);
+static int compare_ull(const void *a, const void *b);
+static void reset_tree(int arg);
+static void usage(void);
+
+
+/*
+ * ==============================================================
+ * DTD kernels
+ * ==============================================================
+ */
+
+static const char *elm_names[elm_data_num + 8];
+static int num_elm_names;
+
+static size_t setup_elm_search(int arg)
+{
+  static const char *unknown[] = {"blink", "marquee", "nobr", "foo",
+                                  "layer", "center2", "spacer", "wbr"};
+  int i;
+
+  (void) arg;
+  for (i = 0; i < elm_data_num; i++)
+    elm_names[i] = elm_list[i].name;
+  for (i = 0; i < 8; i++)
+    elm_names[elm_data_num + i] = unknown[i];
+  num_elm_names = elm_data_num + 8;
+  return 0;
+}
+
+static void run_elm_search(int arg, long ops)
+{
+  long i;
+  int j;
+
+  (void) arg;
+  for (i = 0, j = 0; i < ops; i++) {
+    sink += dtd_elm_search(elm_names[j]);
+    if (++j == num_elm_names)
+      j = 0;
+  }
+}
+
+/* (attribute name, attribute list) pairs for dtd_att_search_list */
+static struct {
+  const char *name;
+  const int *list;
+} att_queries[4096];
+static int num_att_queries;
+
+static size_t setup_att_search(int arg)
+{
+  const int *list;
+  int i, j;
+
+  (void) arg;
+  num_att_queries = 0;
+  for (i = 0; i < elm_data_num; i++) {
+    list = elm_list[i].attlist[DOCTYPE];
+    for (j = 0; j < ELM_ATTLIST_LEN && list[j] >= 0
+           && num_att_queries < 4094; j++) {
+      att_queries[num_att_queries].name = att_list[list[j]].name;
+      att_queries[num_att_queries++].list = list;
+    }
+    /* and some that are not found */
+    if (num_att_queries < 4094) {
+      att_queries[num_att_queries].name = "foo";
+      att_queries[num_att_queries++].list = list;
+    }
+  }
+  return 0;
+}
+
+static void run_att_search(int arg, long ops)
+{
+  long i;
+  int j;
+
+  (void) arg;
+  for (i = 0, j = 0; i < ops; i++) {
+    sink += dtd_att_search_list(att_queries[j].name, att_queries[j].list);
+    if (++j == num_att_queries)
+      j = 0;
+  }
+}
+
+/* entity references as found in the input, e.g. "&amp;" */
+static char ent_refs[ent_data_num + 4][ENT_NAME_LEN + 3];
+static int num_ent_refs;
+
+static size_t setup_ent_search(int arg)
+{
+  int i;
+
+  (void) arg;
+  for (i = 0; i < ent_data_num; i++)
+    sprintf(ent_refs[i], "&%s;", ent_list[i]);
+  strcpy(ent_refs[i++], "&foo;");
+  strcpy(ent_refs[i++], "&nbspx;");
+  strcpy(ent_refs[i++], "&AMP;");
+  strcpy(ent_refs[i++], "&apos;");
+  num_ent_refs = i;
+  return 0;
+}
+
+static void run_ent_search(int arg, long ops)
+{
+  long i;
+  int j;
+
+  (void) arg;
+  for (i = 0, j = 0; i < ops; i++) {
+    sink += dtd_ent_search(ent_refs[j]);
+    if (++j == num_ent_refs)
+      j = 0;
+  }
+}
+
+static void run_can_be_child(int arg, long ops)
+{
+  long i;
+  int child, father;
+
+  (void) arg;
+  for (i = 0, child = 0, father = 0; i < ops; i++) {
+    sink += dtd_can_be_child(child, father, DOCTYPE);
+    if (++child == elm_data_num) {
+      child = 0;
+      if (++father == elm_data_num)
+        father = 0;
+    }
+  }
+}
+
+/* sequences of children checked against real content models */
+#define MAX_CHILDREN 32
+static struct {
+  int rule;
+  int children[MAX_CHILDREN];
+  int num;
+} models[16];
+static int num_models;
+
+static void add_model(const char *father, const char *children, int repeat)
+{
+  char buf[256];
+  char *name;
+  int elm, i;
+
+  elm = dtd_elm_search(father);
+  if (elm < 0 || elm_list[elm].contenttype[DOCTYPE] != CONTTYPE_CHILDREN)
+    return;
+  models[num_models].rule = elm_list[elm].contentspec[DOCTYPE];
+  models[num_models].num = 0;
+  for (i = 0; i < repeat; i++) {
+    strcpy(buf, children);
+    for (name = strtok(buf, " "); name && models[num_models].num < MAX_CHILDREN;
+         name = strtok(NULL, " "))
+      models[num_models].children[models[num_models].num++]
+        = dtd_elm_search(name);
+  }
+  num_models++;
+}
+
+static size_t setup_child_valid(int arg)
+{
+  (void) arg;
+  num_models = 0;
+  add_model("html", "head body", 1);
+  add_model("head", "title meta meta link style script", 1);
+  add_model("table", "caption colgroup thead tbody tbody tbody", 1);
+  add_model("table", "tr", 20);
+  add_model("ul", "li", 30);
+  add_model("dl", "dt dd", 15);
+  add_model("select", "option", 30);
+  add_model("tr", "th td td td td td td td", 2);
+  add_model("table", "tbody caption", 1);   /* not valid */
+  add_model("ul", "", 1);                   /* needs more children */
+  return 0;
+}
+
+static void run_child_valid(int arg, long ops)
+{
+  long i;
+  int j;
+
+  (void) arg;
+  for (i = 0, j = 0; i < ops; i++) {
+    sink += dtd_is_child_valid(models[j].rule, models[j].children,
+                               models[j].num);
+    if (++j == num_models)
+      j = 0;
+  }
+}
+
+
+/*
+ * ==============================================================
+ * attribute value repair
+ * ==============================================================
+ */
+
+static const char *att_values[] = {
+  "main-content",
+  "http://www.example.com/index.php?a=1&amp;b=2",
+  "http://www.example.com/index.php?a=1&b=2&c=3",
+  "Caf&eacute; &amp; cr&egrave;me, &#233;t&#xE9;",
+  "x < y && y > z",
+  "&#12345 &#x1F600 &unknown; &nbsp",
+  "a rather long title attribute with plain text and no references at all",
+  ""
+};
+#define NUM_ATT_VALUES ((int) (sizeof(att_values) / sizeof(att_values[0])))
+
+static void run_fix_att_value(int arg, long ops)
+{
+  char value[128];
+  long i;
+  int j;
+
+  (void) arg;
+  /* the value is modified in place, so it is copied every time */
+  for (i = 0, j = 0; i < ops; i++) {
+    strcpy(value, att_values[j]);
+    sink += (long) check_and_fix_att_value(value);
+    if (++j == NUM_ATT_VALUES)
+      j = 0;
+  }
+}
+
+
+/* attribute values checked against their type in the DTD */
+static const char *att_checks[][3] = {
+  {"div",    "id",      "main-content"},
+  {"div",    "class",   "nav nav-top"},
+  {"a",      "href",    "http://www.example.com/index.php?a=1&amp;b=2"},
+  {"img",    "alt",     "a rather long alternative text with plain words"},
+  {"td",     "align",   "center"},
+  {"td",     "valign",  "Middle"},
+  {"td",     "headers", "h1 h2 h3"},
+  {"td",     "colspan", "2"},
+  {"input",  "type",    "text"},
+  {"input",  "name",    "q"},
+  {"form",   "method",  "POST"},
+  {"area",   "shape",   "rect"},
+  {"script", "type",    "text/javascript"}
+};
+#define NUM_ATT_CHECKS ((int) (sizeof(att_checks) / sizeof(att_checks[0])))
+static int att_check_ids[NUM_ATT_CHECKS];
+
+static size_t setup_att_valid(int arg)
+{
+  int i, elm;
+
+  (void) arg;
+  for (i = 0; i < NUM_ATT_CHECKS; i++) {
+    elm = dtd_elm_search(att_checks[i][0]);
+    att_check_ids[i] = elm < 0 ? -1 :
+      dtd_att_search_list(att_checks[i][1], elm_list[elm].attlist[DOCTYPE]);
+  }
+  return 0;
+}
+
+static void run_att_valid(int arg, long ops)
+{
+  char value[128];
+  long i;
+  int j;
+
+  (void) arg;
+  /* the value may be modified in place, so it is copied every time */
+  for (i = 0, j = 0; i < ops; i++) {
+    if (att_check_ids[j] >= 0) {
+      strcpy(value, att_checks[j][2]);
+      sink += dtd_att_is_valid(att_check_ids[j], value);
+    }
+    if (++j == NUM_ATT_CHECKS)
+      j = 0;
+  }
+}
+
+
+/*
+ * ==============================================================
+ * writer kernels
+ * ==============================================================
+ */
+
+static char *text_sample;
+static int text_sample_len;
+static tree_node_t *text_node;
+
+static size_t setup_text(int arg)
+{
+  static const char *words[] = {
+    "lorem", "ipsum", "dolor", "sit", "amet,", "consectetur", "caf\xc3\xa9",
+    "&amp;", "adipiscing", "elit", "sed", "do", "\xc3\xb1" "and\xc3\xba",
+    "eiusmod", "tempor", "&lt;tag&gt;", "incididunt", "ut", "labore."};
+  int i, len;
+
+  (void) arg;
+  if (text_sample)
+    return text_sample_len;
+  text_sample = malloc(4096 + 32);
+  for (i = 0, len = 0; len < 4096; i++) {
+    len += sprintf(text_sample + len, "%s%s", words[i % 19],
+                   i % 13 == 12 ? "\n" : " ");
+  }
+  text_sample_len = len;
+  return len;
+}
+
+static size_t setup_chardata(int arg)
+{
+  setup_text(arg);
+  text_node = new_tree_node(Node_chardata);
+  tree_set_node_data(text_node, text_sample, text_sample_len);
+  return text_sample_len;
+}
+
+static void begin_writer(int arg)
+{
+  (void) arg;
+  param_outputf = NULL;
+  param_charset_out = charset_lookup_alias("UTF-8");
+  writeBegin();
+}
+
+static void end_writer(int arg)
+{
+  (void) arg;
+  writeEnd();
+}
+
+static void run_plain_data(int arg, long ops)
+{
+  long i;
+
+  (void) arg;
+  for (i = 0; i < ops; i++)
+    sink += writePlainData(text_sample, text_sample_len);
+}
+
+static void run_chardata(int arg, long ops)
+{
+  long i;
+
+  (void) arg;
+  for (i = 0; i < ops; i++)
+    sink += writeChardata(text_node);
+}
+
+
+/*
+ * ==============================================================
+ * charset kernels
+ * ==============================================================
+ */
+
+static const char *charset_names[] = {
+  "UTF-8", "ISO-8859-1", "windows-1252", "UTF-16", "Shift_JIS"
+};
+#define NUM_CHARSETS ((int) (sizeof(charset_names) / sizeof(charset_names[0])))
+
+/* the sample text, encoded in every charset, and back in UTF-8 */
+static char *encoded[NUM_CHARSETS];
+static size_t encoded_len[NUM_CHARSETS];
+static char *decoded[NUM_CHARSETS];
+static size_t decoded_len[NUM_CHARSETS];
+
+static char *convert(const char *to, const char *from,
+                     const char *in, size_t in_len, size_t *out_len)
+{
+  iconv_t cd;
+  char *out, *inp, *outp;
+  size_t in_left, out_left;
+
+  cd = iconv_open(to, from);
+  if (cd == (iconv_t) -1)
+    return NULL;
+  out = malloc(4 * in_len + 16);
+  inp = (char *) in;
+  outp = out;
+  in_left = in_len;
+  out_left = 4 * in_len + 16;
+  while (in_left > 0
+         && iconv(cd, &inp, &in_left, &outp, &out_left) == (size_t) -1) {
+    if (errno != EILSEQ)
+      break;
+    /* not representable: skip the character */
+    do {
+      inp++;
+      in_left--;
+    } while (in_left > 0 && (*inp & 0xC0) == 0x80);
+  }
+  iconv_close(cd);
+  *out_len = outp - out;
+  return out;
+}
+
+static size_t setup_charset(int arg)
+{
+  const charset_t *charset;
+  char *text;
+  int i, len;
+
+  setup_text(arg);
+  charset = charset_lookup_alias(charset_names[arg]);
+  if (!charset)
+    EXIT("Unknown charset");
+
+  /* 64 KB of text */
+  text = malloc(16 * text_sample_len);
+  for (i = 0, len = 0; i < 16; i++, len += text_sample_len)
+    memcpy(text + len, text_sample, text_sample_len);
+
+  encoded[arg] = convert(charset->iconv_name, "UTF-8", text, len,
+                         &encoded_len[arg]);
+  if (encoded[arg])
+    decoded[arg] = convert("UTF-8", charset->iconv_name,
+                           encoded[arg], encoded_len[arg], &decoded_len[arg]);
+  if (!encoded[arg] || !decoded[arg])
+    EXIT("Could not prepare the charset sample");
+  free(text);
+  return encoded_len[arg];
+}
+
+static void run_charset_read(int arg, long ops)
+{
+  char buf[8192];
+  const charset_t *charset;
+  long i;
+
+  charset = charset_lookup_alias(charset_names[arg]);
+  for (i = 0; i < ops; i++) {
+    charset_set_input_memory(encoded[arg], encoded_len[arg]);
+    charset_init_input(charset, NULL);
+    while (charset_read(buf, sizeof(buf), 0) > 0)
+      sink++;
+    charset_close();
+  }
+  charset_set_input_memory(NULL, 0);
+}
+
+static void run_charset_write(int arg, long ops)
+{
+  const charset_t *charset;
+  size_t pos, n;
+  long i;
+
+  charset = charset_lookup_alias(charset_names[arg]);
+  for (i = 0; i < ops; i++) {
+    charset_init_output(charset, NULL);
+    for (pos = 0; pos < decoded_len[arg]; pos += n) {
+      n = decoded_len[arg] - pos;
+      if (n > 8192)
+        n = 8192;
+      n = charset_write(decoded[arg] + pos, n);
+      if (!n)
+        break;
+    }
+    charset_close();
+  }
+}
+
+
+/*
+ * ==============================================================
+ * harness
+ * ==============================================================
+ */
+
+int main(int argc, char **argv)
+{
+  char name[48];
+  int reps = 15;
+  int scale = 1;
+  int json = 0;
+  int list = 0;
+  int selected;
+  int i, j, first_name;
+
+  tree_init();
+  params_set_defaults();
+  parser_num_linea = -1;
+
+  for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+    if (!strcmp(argv[i], "-r") && i + 1 < argc)
+      reps = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-s") && i + 1 < argc)
+      scale = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--json"))
+      json = 1;
+    else if (!strcmp(argv[i], "-l"))
+      list = 1;
+    else
+      usage();
+  }
+  if (reps < 1 || scale < 1)
+    usage();
+  first_name = i;
+
+  add_kernel("dtd_elm_search", setup_elm_search, NULL,
+             run_elm_search, NULL, 0, 200000);
+  add_kernel("dtd_att_search_list", setup_att_search, NULL,
+             run_att_search, NULL, 0, 200000);
+  add_kernel("dtd_ent_search", setup_ent_search, reset_tree,
+             run_ent_search, NULL, 0, 200000);
+  add_kernel("dtd_can_be_child", NULL, NULL,
+             run_can_be_child, NULL, 0, 200000);
+  add_kernel("dtd_is_child_valid", setup_child_valid, NULL,
+             run_child_valid, NULL, 0, 100000);
+  add_kernel("check_and_fix_att_value", NULL, reset_tree,
+             run_fix_att_value, NULL, 0, 200000);
+  add_kernel("dtd_att_is_valid", setup_att_valid, reset_tree,
+             run_att_valid, NULL, 0, 200000);
+  add_kernel("write_plain_data", setup_text, begin_writer,
+             run_plain_data, end_writer, 0, 200);
+  add_kernel("write_chardata", setup_chardata, begin_writer,
+             run_chardata, end_writer, 0, 200);
+  for (j = 0; j < NUM_CHARSETS; j++) {
+    snprintf(name, sizeof(name), "charset_read/%s", charset_names[j]);
+    add_kernel(name, setup_charset, NULL, run_charset_read, NULL, j, 20);
+    snprintf(name, sizeof(name), "charset_write/%s", charset_names[j]);
+    add_kernel(name, setup_charset, NULL, run_charset_write, NULL, j, 20);
+  }
+
+  for (i = 0; i < num_kernels; i++) {
+    for (selected = (first_name == argc), j = first_name; j < argc; j++)
+      if (!strncmp(kernels[i].name, argv[j], strlen(argv[j])))
+        selected = 1;
+    if (!selected)
+      continue;
+    if (list)
+      printf("%s\n", kernels[i].name);
+    else
+      run_kernel(&kernels[i], reps, scale, json);
+  }
+
+  tree_free();
+  return 0;
+}
+
+static void add_kernel(const char *name, size_t (*setup)(int),
+                       void (*begin)(int), void (*run)(int, long),
+                       void (*end)(int), int arg, long ops)
+{
+  kernel_t *k;
+
+  if (num_kernels == MAX_KERNELS)
+    EXIT("Too many kernels");
+
+  k = &kernels[num_kernels++];
+  strncpy(k->name, name, sizeof(k->name) - 1);
+  k->setup = setup;
+  k->begin = begin;
+  k->run = run;
+  k->end = end;
+  k->arg = arg;
+  k->ops = ops;
+}
+
+static void run_kernel(kernel_t *k, int reps, int scale, int json)
+{
+  unsigned long long *times;
+  unsigned long long start;
+  double min, median;
+  long ops;
+  size_t bytes = 0;
+  int i;
+
+  times = malloc(reps * sizeof(unsigned long long));
+  if (!times)
+    EXIT("Out of memory");
+
+  if (k->setup)
+    bytes = k->setup(k->arg);
+
+  ops = k->ops * scale;
+  for (i = 0; i < reps; i++) {
+    if (k->begin)
+      k->begin(k->arg);
+    start = read_timer();
+    k->run(k->arg, ops);
+    times[i] = read_timer() - start;
+    if (k->end)
+      k->end(k->arg);
+  }
+
+  qsort(times, reps, sizeof(unsigned long long), compare_ull);
+  min = (double) times[0] / ops;
+  median = (double) times[reps / 2] / ops;
+
+  if (json) {
+    printf("{\"kernel\":\"%s\",\"unit\":\"%s\",\"reps\":%d,\"ops\":%ld,"
+           "\"min\":%.2f,\"median\":%.2f", k->name, TIMER_UNIT, reps, ops,
+           min, median);
+    if (bytes)
+      printf(",\"bytes\":%lu,\"min_per_byte\":%.4f",
+             (unsigned long) bytes, min / bytes);
+    printf("}\n");
+  } else {
+    printf("%-28s %10.1f %10.1f %s/op", k->name, min, median, TIMER_UNIT);
+    if (bytes)
+      printf("  (%.3f %s/byte)", min / bytes, TIMER_UNIT);
+    printf("\n");
+  }
+  fflush(stdout);
+  free(times);
+}
+
+static int compare_ull(const void *a, const void *b)
+{
+  unsigned long long x = *(const unsigned long long *) a;
+  unsigned long long y = *(const unsigned long long *) b;
+
+  return (x > y) - (x < y);
+}
+
+/*
+ * Some kernels allocate memory from the tree module on every
+ * call. It is released before every repetition.
+ *
+ */
+static void reset_tree(int arg)
+{
+  (void) arg;
+  tree_free();
+  tree_init();
+}
+
+static void usage(void)
+{
+  fprintf(stderr, "Usage: kernelbench [-r <repetitions>] [-s <scale>] "
+          "[--json] [<kernel>...]\n");
+  fprintf(stderr, "       kernelbench -l\n");
+  exit(1);
+}
+
+void exit_on_error(char *msg)
+{
+  fprintf(stderr, "kernelbench: %s\n", msg);
+  exit(1);
+}
@@ -25,10 +25,19 @@
  * 
  * Functions that write messages (debug, errors, warnings, etc.)
  *
+ * Warnings are recorded in a fixed-size buffer (code, line, element
+ * and message) that is written to stderr in one block when it
+ * gets full, at the end of the conversion or before an error
+ * message, instead of writing each one as it happens. Each kind of
+ * warning is counted; after param_message_limit[code] of them,
+ * the next ones are only counted.
+ *
  */
 #include <stdio.h>
+#include <string.h>
 
 #include "mensajes.h"
+#include "params.h"
 
 
 int num_warning = 0;
@@ -36,12 +45,173 @@ int num_inform = 0;
 
 extern unsigned int tree_allocated_memory();
 
+#define MSG_BUFFER_SIZE 256
+#define MSG_TEXT_LEN    160
+
+typedef struct {
+  msg_code_t code;
+  int line;
+  const char *elm;
+  char text[MSG_TEXT_LEN];
+} msg_record_t;
+
+static msg_record_t records[MSG_BUFFER_SIZE];
+static int num_records = 0;
+static unsigned long code_count[MSG_NUM_CODES];
+static unsigned long code_shown[MSG_NUM_CODES];
+
+/* names of the codes, as shown in the summary and JSON output */
+static const char *code_names[MSG_NUM_CODES] = {
+  "internal", "discarded-bytes", "unconvertible-char", "unknown-charset",
+  "syntax-error", "required-attribute", "invalid-content", "id-overflow",
+  "attribute-too-big", "cache", "warc-record"
+};
+
+static size_t format_record(char *out, size_t size, const msg_record_t *rec);
+static size_t json_string(char *out, size_t size, const char *str);
+
+void message_warning(msg_code_t code, const char *elm, const char *msg)
+{
+  msg_record_t *rec;
+
+  num_warning++;
+  code_count[code]++;
+  if (param_messages < MESSAGES_TEXT
+      || (param_message_limit[code]
+          && code_shown[code] >= param_message_limit[code]))
+    return;
+
+  code_shown[code]++;
+  if (num_records == MSG_BUFFER_SIZE)
+    messages_flush();
+  rec = &records[num_records++];
+  rec->code = code;
+  rec->line = parser_num_linea;
+  rec->elm = elm;
+  strncpy(rec->text, msg, MSG_TEXT_LEN - 1);
+  rec->text[MSG_TEXT_LEN - 1] = 0;
+}
+
+void messages_flush(void)
+{
+  char out[8192];
+  size_t len = 0;
+  int i;
+
+  for (i = 0; i < num_records; i++) {
+    if (len + 8 * MSG_TEXT_LEN > sizeof(out)) {
+      fwrite(out, 1, len, stderr);
+      len = 0;
+    }
+    len += format_record(&out[len], sizeof(out) - len, &records[i]);
+  }
+  if (len)
+    fwrite(out, 1, len, stderr);
+  num_records = 0;
+}
+
+void messages_reset(void)
+{
+  num_records = 0;
+  num_warning = 0;
+  num_inform = 0;
+  memset(code_count, 0, sizeof(code_count));
+  memset(code_shown, 0, sizeof(code_shown));
+}
+
+void messages_get_counts(unsigned long counts[MSG_NUM_CODES])
+{
+  memcpy(counts, code_count, sizeof(code_count));
+}
+
+void messages_set_counts(const unsigned long counts[MSG_NUM_CODES])
+{
+  memcpy(code_count, counts, sizeof(code_count));
+  memset(code_shown, 0, sizeof(code_shown));
+}
+
+int messages_code(const char *name)
+{
+  int i;
+
+  for (i = 0; i < MSG_NUM_CODES; i++)
+    if (!strcmp(name, code_names[i]))
+      return i;
+
+  return -1;
+}
+
 void write_end_messages(void)
 {
+  int i;
+
   EPRINTF3("!!TOTAL: warnings(%d) informs(%d) memory(%d B)\n",
            num_warning, num_inform, tree_allocated_memory());
 
-  if (num_warning) 
+  messages_flush();
+  if (param_messages == MESSAGES_NONE)
+    return;
+
+  for (i = 0; i < MSG_NUM_CODES; i++) {
+    if (!code_count[i])
+      continue;
+    if (param_messages == MESSAGES_SUMMARY)
+      fprintf(stderr, "Warnings of type %-20s %lu\n",
+              code_names[i], code_count[i]);
+    else if (param_messages == MESSAGES_JSON)
+      fprintf(stderr, "{\"code\":\"%s\",\"count\":%lu,\"suppressed\":%lu}\n",
+              code_names[i], code_count[i], code_count[i] - code_shown[i]);
+    else if (code_count[i] > code_shown[i])
+      fprintf(stderr, "Warning: %lu more warnings of type %s not shown\n",
+              code_count[i] - code_shown[i], code_names[i]);
+  }
+
+  if (num_warning && param_messages != MESSAGES_JSON) 
     fprintf(stderr, "WARNING: output file might not be valid XHTML or content might have been lost from the input\n");
 }
 
+/*
+ * Writes a record as a line of text or JSON into 'out'
+ *
+ */
+static size_t format_record(char *out, size_t size, const msg_record_t *rec)
+{
+  size_t len;
+
+  if (param_messages == MESSAGES_TEXT)
+    return snprintf(out, size, "Warning [line %d]: %s\n",
+                    rec->line, rec->text);
+
+  len = snprintf(out, size, "{\"code\":\"%s\",\"line\":%d,\"element\":",
+                 code_names[rec->code], rec->line);
+  if (rec->elm)
+    len += json_string(&out[len], size - len, rec->elm);
+  else
+    len += snprintf(&out[len], size - len, "null");
+  len += snprintf(&out[len], size - len, ",\"message\":");
+  len += json_string(&out[len], size - len, rec->text);
+  len += snprintf(&out[len], size - len, "}\n");
+
+  return len;
+}
+
+static size_t json_string(char *out, size_t size, const char *str)
+{
+  size_t len = 0;
+
+  out[len++] = '"';
+  for (; *str && len + 8 < size; str++) {
+    if (*str == '"' || *str == '\\') {
+      out[len++] = '\\';
+      out[len++] = *str;
+    } else if ((unsigned char) *str < 0x20) {
+      len += sprintf(&out[len], "\\u%04x", (unsigned char) *str);
+    } else {
+      out[len++] = *str;
+    }
+  }
+  out[len++] = '"';
+  out[len] = 0;
+
+  return len;
+}
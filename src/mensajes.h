@@ -57,13 +57,49 @@ void exit_on_error(char *msg);
 
 #define EXIT(msg)   {exit_on_error(msg);}
 
+/*
+ * kinds of warning, which are counted and limited separately
+ * (see param_messages and param_message_limit in params.h)
+ *
+ */
+typedef enum {
+  MSG_INTERNAL,            /* misuse of a module */
+  MSG_DISCARDED_BYTES,     /* incomplete character at the end */
+  MSG_UNCONVERTIBLE_CHAR,  /* not representable in the output charset */
+  MSG_UNKNOWN_CHARSET,
+  MSG_SYNTAX_ERROR,
+  MSG_REQUIRED_ATT,        /* required attribute not specified */
+  MSG_INVALID_CONTENT,     /* invalid element content */
+  MSG_ID_OVERFLOW,         /* too many ID attributes */
+  MSG_ATT_TOO_BIG,
+  MSG_CACHE,
+  MSG_WARC_RECORD,         /* WARC record not converted */
+  MSG_NUM_CODES
+} msg_code_t;
+
+/* output of the warnings (param_messages) */
+#define MESSAGES_NONE    0  /* nothing */
+#define MESSAGES_SUMMARY 1  /* number of warnings of each kind */
+#define MESSAGES_TEXT    2  /* one line per warning (default) */
+#define MESSAGES_JSON    3  /* one JSON object per line */
+
+/*
+ * records a warning about the element 'elm' (its name, or NULL).
+ * Warnings are kept in memory and written by blocks, so that
+ * documents with thousands of them do not do a write to stderr
+ * for each one (see messages_flush)
+ *
+ */
+void message_warning(msg_code_t code, const char *elm, const char *msg);
+
 #ifdef MSG_DEBUG
-#define WARNING(msg) {fprintf(stderr,"WARNING(%s,%d)[l%d]: %s\n",__FILE__,\
+#define WARNING(code, msg) {fprintf(stderr,"WARNING(%s,%d)[l%d]: %s\n",__FILE__,\
                       __LINE__,parser_num_linea,msg);\
                       num_warning++;}
+#define WARNING_ELM(code, elm, msg) WARNING(code, msg)
 #else
-#define WARNING(msg) {fprintf(stderr,"Warning [line %d]: %s\n",\
-                      parser_num_linea,msg); num_warning++;}
+#define WARNING(code, msg) {message_warning(code, NULL, msg);}
+#define WARNING_ELM(code, elm, msg) {message_warning(code, elm, msg);}
 #endif
 
 
@@ -118,6 +154,35 @@ void exit_on_error(char *msg);
  */
 void write_end_messages(void);
 
+/*
+ * write the warnings kept in memory (before writing other
+ * messages to stderr, or before a fork)
+ *
+ */
+void messages_flush(void);
+
+/*
+ * discard the warnings and counters of a previous conversion
+ *
+ */
+void messages_reset(void);
+
+/*
+ * copy the number of warnings of each kind into 'counts', or set
+ * them from 'counts' as if none had been shown (used to keep them
+ * in the conversion cache, see cache.c)
+ *
+ */
+void messages_get_counts(unsigned long counts[MSG_NUM_CODES]);
+void messages_set_counts(const unsigned long counts[MSG_NUM_CODES]);
+
+/*
+ * returns the code of the kind of warning named 'name' (as shown
+ * in the summary), or -1
+ *
+ */
+int messages_code(const char *name);
+
 
 
 #endif
@@ -18,6 +18,8 @@
  *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
  ***************************************************************************/
 
+#include <string.h>
+
 #include "params.h"
 
 FILE *param_inputf;
@@ -38,6 +40,16 @@ int   param_empty_tags;
 int   param_crlf_eol;
 int   param_generate_snippet;
 char  *param_system_dtd_prefix;
+int   param_no_reflow;    /* no indentation or line wrapping */
+int   param_binary_output; /* binary tree output (see h2xbin.h) */
+int   param_ncr_fallback; /* &#N; for chars not in the output charset */
+int   param_compress;     /* compressed output (COMPRESS_*) */
+int   param_compress_level; /* -1: default level of the format */
+char  *param_cache_dir;   /* conversion cache (NULL if disabled) */
+unsigned long param_cache_size; /* max. size of the cache (bytes) */
+int   param_stats;        /* 0: no stats, 1: text, 2: JSON */
+int   param_messages;     /* output of warnings (MESSAGES_*) */
+unsigned long param_message_limit[MSG_NUM_CODES];
 
 void params_set_defaults()
 {
@@ -59,4 +71,14 @@ void params_set_defaults()
   param_crlf_eol = 0;
   param_generate_snippet = 0;
   param_system_dtd_prefix = NULL;
+  param_no_reflow = 0;
+  param_binary_output = 0;
+  param_ncr_fallback = 0;
+  param_compress = COMPRESS_NONE;
+  param_compress_level = -1;
+  param_cache_dir = NULL;
+  param_cache_size = 256UL * 1024 * 1024;
+  param_stats = 0;
+  param_messages = MESSAGES_TEXT;
+  memset(param_message_limit, 0, sizeof(param_message_limit));
 }
@@ -30,6 +30,8 @@
 
 #include <stdio.h>
 #include "charset.h"
+#include "compress.h"
+#include "mensajes.h"
 
 extern FILE *param_inputf;
 extern FILE *param_outputf;
@@ -49,6 +51,21 @@ extern int   param_empty_tags;
 extern int   param_crlf_eol;
 extern int   param_generate_snippet;
 extern char  *param_system_dtd_prefix;
+extern int   param_no_reflow;    /* no indentation or line wrapping */
+extern int   param_binary_output; /* binary tree output (see h2xbin.h) */
+extern int   param_ncr_fallback; /* &#N; for chars not in the output charset */
+extern int   param_compress;     /* compressed output (COMPRESS_*) */
+extern int   param_compress_level; /* -1: default level of the format */
+extern char  *param_cache_dir;   /* conversion cache (NULL if disabled) */
+extern unsigned long param_cache_size; /* max. size of the cache (bytes) */
+extern int   param_stats;        /* 0: no stats, 1: text, 2: JSON */
+extern int   param_messages;     /* output of warnings (MESSAGES_*) */
+/* max. warnings shown of each kind (0: no limit) */
+extern unsigned long param_message_limit[MSG_NUM_CODES];
+
+/* Note: parameters that affect the output must be added
+ * to the key of the conversion cache (see cache_set_key in cache.c)
+ */
 
 void params_set_defaults(void);
 
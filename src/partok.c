@@ -0,0 +1,635 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Jesus Arias Fisteus                             *
+ *   jaf@it.uc3m.es                                                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/*
+ * partok.c
+ *
+ * Speculative parallel tokenization of large documents
+ * (see partok.h)
+ *
+ * The input is split in regions. Region 0 is tokenized by this
+ * process when the parser asks for its first token; each of the
+ * rest is tokenized in the meanwhile by a child process, which
+ * starts at a guessed boundary (see guess_boundary) and with the
+ * line number and the number of open pre elements counted up to
+ * it, and stops at the first boundary between tokens, in the
+ * initial state of the lexer, at or after the start of the next
+ * region. The tokens are sent back as a log (see log_token).
+ *
+ * When the parser has consumed a region, the log of the next one
+ * is used only if the child started just where that region really
+ * ended, with the same number of open pre elements; a wrong line
+ * number is just corrected. Otherwise, the region is tokenized
+ * again by this process from the right state.
+ *
+ * The parser and the lexer are not reentrant, and the parser
+ * keeps using its globals, hence the processes instead of threads.
+ *
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <limits.h>
+#ifdef HAVE_WORKING_FORK
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#endif
+
+#include "partok.h"
+#include "charset.h"
+#include "tree.h"
+#include "mensajes.h"
+#include "stats.h"
+#include "htmlgr.h"
+
+int yyparse(void);
+
+/* in html.l */
+extern int parser_num_bytes;
+extern int pre_state;
+extern int (*lexer_token_source)(void);
+void parser_set_input_memory(const char *data, size_t len);
+void lexer_tokenize(int limit, void (*emit)(int token));
+
+/* chunks in which the input is read */
+#define PARTOK_READ_SIZE 65536
+
+/* how far back guess_boundary starts looking at the document */
+#define PARTOK_CONTEXT 65536
+
+/*
+ * tokens of a region: for each one, its number, the line number
+ * after it and the length of its text (-1 if it has no text),
+ * followed by the text and a 0
+ *
+ */
+typedef struct {
+  char *data;
+  size_t len;
+  size_t size;
+} token_log_t;
+
+/* state of the lexer at a boundary between regions */
+typedef struct {
+  int pos;
+  int line;
+  int pre;
+} boundary_t;
+
+typedef struct {
+  boundary_t start;      /* guessed */
+  int pid;               /* child process, or 0 */
+  int fd;                /* pipe from the child */
+} region_t;
+
+/* what a child sends before the log of its region */
+typedef struct {
+  boundary_t end;
+  size_t len;
+} log_header_t;
+
+static char *input = NULL;
+static int input_len;
+static region_t *regions = NULL;
+static int num_regions;
+static int current;            /* region being parsed */
+static boundary_t done;        /* real end of the regions parsed */
+static int line_delta;         /* correction of the lines of the log */
+
+/* the parser may still hold the text of the last tokens of the
+   previous region, so that its log is kept until the next one */
+static token_log_t logs[2];
+static token_log_t *tokens;
+static size_t feed_pos;
+
+static char *read_input(int *len);
+static int  guess_boundary(int pos);
+static void count_prefix(int from, int to, boundary_t *b);
+static int  next_token(void);
+static void next_region(void);
+static void scan_region(void);
+static int  has_text(int token);
+static void log_token(int token);
+static void log_reserve(size_t n);
+static int  log_get_int(void);
+#ifdef HAVE_WORKING_FORK
+static void start_child(int k);
+static void run_child(int k, int fd);
+static void stop_child(region_t *r);
+static int  read_log(region_t *r, log_header_t *h);
+static int  read_all(int fd, void *buf, size_t len);
+static int  write_all(int fd, const void *buf, size_t len);
+#endif
+
+int partok_parse(int jobs)
+{
+  int result;
+  int n, k, pos;
+
+  input = read_input(&input_len);
+
+  n = jobs;
+#ifndef HAVE_WORKING_FORK
+  n = 1;
+#endif
+  if (input_len / PARTOK_MIN_CHUNK < n)
+    n = input_len / PARTOK_MIN_CHUNK;
+  if (n < 2) {
+    /* not worth it: the usual parse */
+    parser_set_input_memory(input, input_len);
+    result = yyparse();
+    free(input);
+    input = NULL;
+    return result;
+  }
+
+  regions = (region_t *) calloc(n, sizeof(region_t));
+  if (!regions)
+    EXIT("Not enough memory to split the input");
+  regions[0].start.line = 1;
+  num_regions = 1;
+  for (k = 1; k < n; k++) {
+    pos = guess_boundary((int) ((double) k * input_len / n));
+    if (pos >= input_len)
+      break;
+    if (pos <= regions[num_regions - 1].start.pos)
+      continue;
+    regions[num_regions].start = regions[num_regions - 1].start;
+    count_prefix(regions[num_regions - 1].start.pos, pos,
+                 &regions[num_regions].start);
+    num_regions++;
+  }
+
+#ifdef HAVE_WORKING_FORK
+  /* the children must not write again what is in the buffers */
+  fflush(NULL);
+  for (k = 1; k < num_regions; k++)
+    start_child(k);
+#endif
+
+  current = -1;
+  done = regions[0].start;
+  tokens = NULL;
+  feed_pos = 0;
+  lexer_token_source = next_token;
+  result = yyparse();
+  lexer_token_source = NULL;
+
+#ifdef HAVE_WORKING_FORK
+  for (k = 0; k < num_regions; k++)
+    if (regions[k].pid > 0)
+      stop_child(&regions[k]);
+#endif
+  free(regions);
+  regions = NULL;
+  for (k = 0; k < 2; k++) {
+    free(logs[k].data);
+    logs[k].data = NULL;
+    logs[k].len = logs[k].size = 0;
+  }
+  free(input);
+  input = NULL;
+
+  return result;
+}
+
+/*
+ * reads the whole input, in the internal charset
+ *
+ */
+static char *read_input(int *len)
+{
+  char *buf = NULL;
+  char *tmp;
+  size_t size = 0;
+  size_t n = 0;
+  int r;
+
+  for (;;) {
+    if (size - n < PARTOK_READ_SIZE + 1) {
+      size = size ? 2 * size : 16 * PARTOK_READ_SIZE;
+      tmp = (char *) realloc(buf, size);
+      if (!tmp)
+        EXIT("Not enough memory to read the input");
+      buf = tmp;
+    }
+    r = charset_read(buf + n, PARTOK_READ_SIZE, 0);
+    if (r <= 0)
+      break;
+    n += r;
+    if (n >= INT_MAX - PARTOK_READ_SIZE)
+      EXIT("The input is too large");
+  }
+  buf[n] = 0;
+  *len = (int) n;
+
+  return buf;
+}
+
+/*
+ * Guesses the first boundary between tokens at or after 'pos': a
+ * '<' that starts a tag, a comment or a declaration outside of
+ * other tags, comments, CDATA sections and scripts. Their limits
+ * are looked for from a while before 'pos', assuming that the
+ * document is there between two tags.
+ *
+ * Returns the position of the '<', or input_len if there is none.
+ *
+ */
+static int guess_boundary(int pos)
+{
+  enum {TEXT, TAG, COMMENT, CDATA, SCRIPT} state = TEXT;
+  const char *p = input + (pos > PARTOK_CONTEXT ? pos - PARTOK_CONTEXT : 0);
+  const char *end = input + input_len;
+  char quote = 0;
+  int script = 0;   /* the tag is the start tag of a script or style */
+  int c;
+
+  for (; p < end; p++) {
+    switch (state) {
+    case TEXT:
+      if (*p != '<')
+        break;
+      c = (unsigned char) p[1];
+      if (p - input >= pos
+          && (c == '/' || c == '!' || ((c | 0x20) >= 'a' && (c | 0x20) <= 'z')))
+        return (int) (p - input);
+      if (!strncmp(p, "<!--", 4)) {
+        state = COMMENT;
+        p += 3;
+      } else if (!strncmp(p, "<![CDATA[", 9)) {
+        state = CDATA;
+        p += 8;
+      } else if (c == '/' || c == '!' || c == '?'
+                 || ((c | 0x20) >= 'a' && (c | 0x20) <= 'z')) {
+        state = TAG;
+        quote = 0;
+        script = !strncasecmp(p + 1, "script", 6)
+          || !strncasecmp(p + 1, "style", 5);
+      }
+      break;
+    case TAG:
+      if (quote) {
+        if (*p == quote)
+          quote = 0;
+      } else if (*p == '"' || *p == '\'') {
+        quote = *p;
+      } else if (*p == '>') {
+        state = script ? SCRIPT : TEXT;
+      }
+      break;
+    case COMMENT:
+      if (!strncmp(p, "-->", 3)) {
+        state = TEXT;
+        p += 2;
+      }
+      break;
+    case CDATA:
+      if (!strncmp(p, "]]>", 3)) {
+        state = TEXT;
+        p += 2;
+      }
+      break;
+    case SCRIPT:
+      if (!strncasecmp(p, "</script", 8) || !strncasecmp(p, "</style", 7)) {
+        state = TAG;
+        quote = 0;
+        script = 0;
+      }
+      break;
+    }
+  }
+
+  return input_len;
+}
+
+/*
+ * adds to the line number and to the number of open pre elements
+ * in 'b' those of the input between 'from' and 'to'
+ *
+ */
+static void count_prefix(int from, int to, boundary_t *b)
+{
+  const char *p = input + from;
+  const char *end = input + to;
+  const char *name;
+
+  while ((p = memchr(p, '\n', end - p))) {
+    b->line++;
+    p++;
+  }
+
+  for (p = input + from; (p = memchr(p, '<', end - p)); p++) {
+    name = p[1] == '/' ? p + 2 : p + 1;
+    if (name + 3 < end && !strncasecmp(name, "pre", 3)
+        && (name[3] == '>' || name[3] == ' ' || name[3] == '\t'
+            || name[3] == '\n' || name[3] == '\r'))
+      b->pre += p[1] == '/' ? -1 : 1;
+  }
+  b->pos = to;
+}
+
+/*
+ * gives the next token to the parser (see lexer_token_source in
+ * html.l), from the log of the current region
+ *
+ */
+static int next_token(void)
+{
+  int token;
+  int text_len;
+
+  while (!tokens || feed_pos >= tokens->len) {
+    if (current + 1 >= num_regions) {
+      parser_num_linea = done.line;
+      return 0;
+    }
+    next_region();
+  }
+
+  token = log_get_int();
+  parser_num_linea = log_get_int() + line_delta;
+  text_len = log_get_int();
+  if (text_len >= 0) {
+    yylval.cad = tokens->data + feed_pos;
+    feed_pos += text_len + 1;
+    /* the lexer gives these in memory of the tree */
+    if (token == TOK_STAG_INI || token == TOK_ETAG || token == TOK_ATT_NAME
+        || token == TOK_ATT_VALUE || token == TOK_XMLPI_INI
+        || token == TOK_EREF)
+      yylval.cad = tree_strdup(yylval.cad);
+  }
+
+  return token;
+}
+
+/*
+ * gets the tokens of the next region: from its child if it guessed
+ * the state at its start, or else by tokenizing it here
+ *
+ */
+static void next_region(void)
+{
+#ifdef HAVE_WORKING_FORK
+  region_t *r;
+  log_header_t h;
+#endif
+
+  current++;
+  tokens = &logs[current % 2];
+  tokens->len = 0;
+  feed_pos = 0;
+
+#ifdef HAVE_WORKING_FORK
+  r = &regions[current];
+  if (r->pid > 0) {
+    if (r->start.pos == done.pos && r->start.pre == done.pre
+        && !read_log(r, &h)) {
+      line_delta = done.line - r->start.line;
+      done = h.end;
+      done.line += line_delta;
+      close(r->fd);
+      waitpid(r->pid, NULL, 0);
+      r->pid = 0;
+      stats_count_region(1);
+      return;
+    }
+    stop_child(r);
+    tokens->len = 0;
+  }
+#endif
+
+  if (current > 0)
+    stats_count_region(0);
+  scan_region();
+}
+
+/*
+ * tokenizes the current region from the end of the previous one
+ *
+ */
+static void scan_region(void)
+{
+  parser_set_input_memory(input + done.pos, input_len - done.pos);
+  parser_num_bytes = done.pos;
+  parser_num_linea = done.line;
+  pre_state = done.pre;
+  lexer_tokenize(current + 1 < num_regions
+                 ? regions[current + 1].start.pos : -1, log_token);
+  done.pos = parser_num_bytes;
+  done.line = parser_num_linea;
+  done.pre = pre_state;
+  line_delta = 0;
+}
+
+static int has_text(int token)
+{
+  return token != TOK_STAG_END && token != TOK_EMPTYTAG_END
+    && token != TOK_ATT_EQ && token != TOK_XMLPI_END
+    && token != TOK_WHITESPACE;
+}
+
+/*
+ * appends the token just scanned to the log (see lexer_tokenize
+ * in html.l)
+ *
+ */
+static void log_token(int token)
+{
+  int entry[3];
+  size_t text_len = 0;
+
+  entry[0] = token;
+  entry[1] = parser_num_linea;
+  entry[2] = -1;
+  if (has_text(token)) {
+    text_len = strlen(yylval.cad);
+    entry[2] = (int) text_len;
+  }
+
+  log_reserve(sizeof(entry) + text_len + 1);
+  memcpy(tokens->data + tokens->len, entry, sizeof(entry));
+  tokens->len += sizeof(entry);
+  if (entry[2] >= 0) {
+    memcpy(tokens->data + tokens->len, yylval.cad, text_len + 1);
+    tokens->len += text_len + 1;
+  }
+}
+
+static void log_reserve(size_t n)
+{
+  char *tmp;
+  size_t size;
+
+  if (tokens->len + n <= tokens->size)
+    return;
+  size = tokens->size ? tokens->size : PARTOK_READ_SIZE;
+  while (size < tokens->len + n)
+    size *= 2;
+  tmp = (char *) realloc(tokens->data, size);
+  if (!tmp)
+    EXIT("Not enough memory for the tokens");
+  tokens->data = tmp;
+  tokens->size = size;
+}
+
+static int log_get_int(void)
+{
+  int value;
+
+  memcpy(&value, tokens->data + feed_pos, sizeof(int));
+  feed_pos += sizeof(int);
+
+  return value;
+}
+
+#ifdef HAVE_WORKING_FORK
+
+static void start_child(int k)
+{
+  region_t *r = &regions[k];
+  int fds[2];
+  pid_t pid;
+
+  if (pipe(fds)) {
+    perror("pipe");
+    return;
+  }
+
+  pid = fork();
+  if (pid == 0) {
+    close(fds[0]);
+    run_child(k, fds[1]);
+  }
+  close(fds[1]);
+  if (pid < 0) {
+    /* this region will be tokenized by the parent */
+    perror("fork");
+    close(fds[0]);
+    return;
+  }
+  r->pid = (int) pid;
+  r->fd = fds[0];
+}
+
+/*
+ * tokenizes region 'k' from its guessed start and sends the log
+ * through 'fd'. Does not return.
+ *
+ */
+static void run_child(int k, int fd)
+{
+  region_t *r = &regions[k];
+  log_header_t h;
+  int null_fd;
+
+  /* the parent gives the warnings, so that they are not repeated */
+  null_fd = open("/dev/null", O_WRONLY);
+  if (null_fd >= 0)
+    dup2(null_fd, fileno(stderr));
+
+  parser_set_input_memory(input + r->start.pos, input_len - r->start.pos);
+  parser_num_bytes = r->start.pos;
+  parser_num_linea = r->start.line;
+  pre_state = r->start.pre;
+  tokens = &logs[0];
+  lexer_tokenize(k + 1 < num_regions ? regions[k + 1].start.pos : -1,
+                 log_token);
+
+  memset(&h, 0, sizeof(h));
+  h.end.pos = parser_num_bytes;
+  h.end.line = parser_num_linea;
+  h.end.pre = pre_state;
+  h.len = tokens->len;
+  if (write_all(fd, &h, sizeof(h)) || write_all(fd, tokens->data, h.len))
+    _exit(1);
+  _exit(0);
+}
+
+static void stop_child(region_t *r)
+{
+  kill((pid_t) r->pid, SIGKILL);
+  close(r->fd);
+  waitpid((pid_t) r->pid, NULL, 0);
+  r->pid = 0;
+}
+
+/*
+ * reads the log sent by the child of region 'r'
+ *
+ * Returns 0, or -1 if the child failed
+ *
+ */
+static int read_log(region_t *r, log_header_t *h)
+{
+  if (read_all(r->fd, h, sizeof(*h))
+      || h->end.pos < r->start.pos || h->end.pos > input_len)
+    return -1;
+  log_reserve(h->len);
+  if (read_all(r->fd, tokens->data, h->len))
+    return -1;
+  tokens->len = h->len;
+
+  return 0;
+}
+
+static int read_all(int fd, void *buf, size_t len)
+{
+  ssize_t n;
+
+  while (len > 0) {
+    n = read(fd, buf, len);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return -1;
+    buf = (char *) buf + n;
+    len -= n;
+  }
+
+  return 0;
+}
+
+static int write_all(int fd, const void *buf, size_t len)
+{
+  ssize_t n;
+
+  while (len > 0) {
+    n = write(fd, buf, len);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return -1;
+    buf = (const char *) buf + n;
+    len -= n;
+  }
+
+  return 0;
+}
+
+#endif
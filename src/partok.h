@@ -0,0 +1,49 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Jesus Arias Fisteus                             *
+ *   jaf@it.uc3m.es                                                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/*
+ * partok.h
+ *
+ * Speculative parallel tokenization of large documents. The
+ * input is split in regions that are tokenized concurrently by
+ * child processes, each one starting at a guessed boundary
+ * between tokens. The parser consumes the tokens in order and
+ * checks that each region really starts where the previous one
+ * ended, in the same state of the lexer; if not, that region is
+ * tokenized again from the right state. Therefore, the output
+ * and the warnings are the same as with a sequential parse.
+ *
+ */
+
+#ifndef PARTOK_H
+#define PARTOK_H
+
+/* regions smaller than this are not worth a process */
+#define PARTOK_MIN_CHUNK (1024 * 1024)
+
+/*
+ * Reads the whole input (charset_read) and parses it, with up to
+ * 'jobs' processes tokenizing it. Replaces the call to yyparse(),
+ * whose result is returned.
+ *
+ */
+int partok_parse(int jobs);
+
+#endif
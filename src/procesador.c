@@ -61,6 +61,9 @@
 #include "charset.h"
 #include "params.h"
 #include "snprintf.h"
+#include "eventlog.h"
+#include "stats.h"
+#include "h2xbin.h"
 
 #ifdef SELLAR
 #define SELLO "translated by html2xhtml - http://www.it.uc3m.es/jaf/html2xhtml/"
@@ -84,6 +87,32 @@ static int doctype_detected= 0;
 
 static tree_node_t *actual_element= NULL;  /* elemento actual */
 
+/* 
+ * pila de elementos abiertos: actual_element y sus antecesores,
+ * desde la raz, y cuntos hay abiertos con cada elm_id. Se
+ * mantiene en set_actual_element(); los nodos de la pila
+ * tienen activada la marca NODE_OPEN
+ */
+#define NODE_OPEN 0x01
+static tree_node_t **open_stack= NULL;
+static int open_depth= 0;
+static int open_stack_size= 0;
+static int open_count[elm_data_num];
+
+/*
+ * plan de atributos de cada elemento en cada DTD, calculado la
+ * primera vez que se necesita: mapa de bits de los #REQUIRED,
+ * att_id de 'id' (o -1) y si admite xml:space
+ */
+typedef struct {
+  unsigned int requeridos[TREE_ATT_MAP_WORDS];
+  short id;
+  char xml_space;
+  char listo;
+} att_plan_t;
+
+static att_plan_t att_plans[elm_data_num][DTD_NUM];
+
 /* new place recovery mode: variables set to non-null when this 
 mode is active */
 static int new_place_recovery_on;
@@ -102,7 +131,10 @@ static int  insert_element(tree_node_t *nodo);
 static void insert_chardata(const xchar *ch, int len, node_type_t type);
 /* static void elm_meta_scan(tree_node_t *meta); */
 static int  elm_check_prohibitions(int elmid);
-static int  elm_is_father(int elmid, tree_node_t *nodo);
+static int  elm_is_open(int elmid);
+static void set_actual_element(tree_node_t *nodo);
+static void open_stack_reset(void);
+static att_plan_t *att_plan_get(int elm_id);
 static int  text_contains_special_chars(const xchar *ch, int len);
 
 #ifdef SELLAR
@@ -122,13 +154,24 @@ static int err_elm_desconocido(const xchar *nombre);
 /* auxiliares */
 static tree_node_t* err_aux_insert_elm(int elm_id, const xchar *content, int len);
 static int remove_duplicate_elm(int elmid, tree_node_t* parent, int hijos[]);
-static xchar* check_and_fix_att_value(xchar* value);
 
 /* new output functions */
+static void init_output_strings(void);
 static void write_document(document_t *doc);
 static void write_doctype(void);
+static void write_binary_document(document_t *doc);
+static void write_binary_node(tree_node_t *node, unsigned char *elm_used,
+                              unsigned char *att_used);
+static void write_binary_names(unsigned char *used, int num, int is_att);
+static void bwrite(const void *buf, size_t num);
+static void bwrite_u8(unsigned int value);
+static void bwrite_u16(unsigned int value);
+static void bwrite_u32(size_t value);
+static void bwrite_decoded(const xchar *text, size_t len);
 static int write_node(tree_node_t *node);
-static int write_element(tree_node_t *node);
+static int write_leaf(tree_node_t *node);
+static int write_element_start(tree_node_t *elm);
+static int write_element_end(tree_node_t *elm);
 static int write_chardata(tree_node_t *node);
 static int write_cdata_sec(tree_node_t *node);
 static int write_whitespace_or_newline_if_needed(int next_data_len);
@@ -139,11 +182,13 @@ static int write_end_tag(tree_node_t* nodo);
 static int write_indent(int len, int new_line);
 static int write_indent_internal(int len, int new_line, int ignore_xml_space);
 static int write_plain_data(xchar* text, int len);
+static int write_verbatim_data(const xchar* text, int len);
 static int cprintf_init(charset_t *to_charset, FILE *file);
 static int cprintf_close(void);
 static int cprintf(char *format, ...);
 static int cwrite(char *buf, size_t num);
 static int cwrite_single(const char *buf, size_t num);
+static void cwrite_raw(const char *buf, size_t num);
 static int cputc(int c);
 static void cflush(void);
 static size_t ccount_utf8_chars(const char *buf, size_t num_bytes);
@@ -169,7 +214,7 @@ static char* lt;
 static char* amp;
 static char* gt;
 static char* eol;
-static size_t eol_len; /* initialized to strlen(eol) in writeOutput */
+static size_t eol_len; /* initialized to strlen(eol) in init_output_strings */
 
 static int escape_chars;
 
@@ -197,7 +242,7 @@ void saxStartDocument(void)
     doctype= -1;
     doctype_locked= 0;
     doctype_detected= 0;
-    actual_element= NULL;
+    open_stack_reset();
     num_errores= 0;
     ins_html= NULL;
     ins_head= NULL;
@@ -231,7 +276,7 @@ void saxEndDocument(void)
   if (!document->inicio) EXIT("document without root html element");
 
   if (actual_element)
-    for ( ; actual_element; actual_element= actual_element->padre)
+    for ( ; actual_element; set_actual_element(NODE_PADRE(actual_element)))
       if (actual_element->tipo == Node_element) {
         elm_close(actual_element);
       }
@@ -281,9 +326,15 @@ void saxStartElement(const xchar *fullname, xchar **atts)
 #endif
 #endif
 
+  if (eventlog_recording) {
+    eventlog_record(EV_START_ELEMENT, fullname, -1, atts);
+    return;
+  }
+
   if (state!=ST_PARSING) {
     if (state == ST_END)
       INFORM("Element discarded after the html end tag");
+    stats_count_discarded();
     return;
   }
 
@@ -294,6 +345,7 @@ void saxStartElement(const xchar *fullname, xchar **atts)
   if ((elm_ptr= dtd_elm_search(elm_name))<0) {
     if ((elm_ptr= err_elm_desconocido(elm_name))<0) {
       INFORM("elemento no encontrado\n");
+      stats_count_discarded();
       return;
     }
   }
@@ -314,17 +366,19 @@ void saxStartElement(const xchar *fullname, xchar **atts)
 
       if (document->inicio) {
         html= document->inicio;
-        for (elm=html->cont.elemento.hijo; elm && (ELM_ID(elm)!=ELMID_BODY); 
-             elm=elm->sig);
+        for (elm=NODE_HIJO(html); elm && (ELM_ID(elm)!=ELMID_BODY); 
+             elm=NODE_SIG(elm));
       }
       /* si no existe BODY, se sita como frameset */
       if (!elm) res= doctype_set(XHTML_FRAMESET,1);
       if (elm || (res==-1)) {
         INFORM("elemento de tipo frameset no vlido en este DTD (descartado)");
+        stats_count_discarded();
         return;
       }
     } else {
       INFORM("elemento no vlido en este DTD (descartado)\n");
+      stats_count_discarded();
       return;
     }
   }
@@ -339,7 +393,7 @@ void saxStartElement(const xchar *fullname, xchar **atts)
 
   /* establece un nodo para el elemento */
   nodo= new_tree_node(Node_element);
-  nodo->cont.elemento.elm_id= elm_ptr;
+  nodo->elm_id= elm_ptr;
 
 
   /* a lo mejor no se puede insertar por haber sido insertado por
@@ -347,17 +401,17 @@ void saxStartElement(const xchar *fullname, xchar **atts)
    */ 
   if ((elm_ptr==ELMID_HTML)&&(ins_html)) {
     nodo= ins_html;
-    actual_element= nodo;
+    set_actual_element(nodo);
     ins_html= NULL;
     DEBUG("insertado previamente por el conversor");
   } else if ((elm_ptr==ELMID_HEAD)&&(ins_head)) {
     nodo= ins_head;
-    actual_element= nodo;
+    set_actual_element(nodo);
     ins_head= NULL;
     DEBUG("insertado previamente por el conversor");
   } else if ((elm_ptr==ELMID_BODY)&&(ins_body)) {
     nodo= ins_body;
-    actual_element= nodo;
+    set_actual_element(nodo);
     ins_body= NULL;
     DEBUG("insertado previamente por el conversor");
   } else 
@@ -396,6 +450,11 @@ void saxEndElement(const xchar *name)
 
   EPRINTF1("SAX.endElement(%s)\n",name);
 
+  if (eventlog_recording) {
+    eventlog_record(EV_END_ELEMENT, name, -1, NULL);
+    return;
+  }
+
   if (state!=ST_PARSING) return;
 
   xtolower(elm_name,name,ELM_NAME_LEN);
@@ -407,8 +466,12 @@ void saxEndElement(const xchar *name)
   }
 
   /* busca al antecesor que coincida */
-  for (nodo=actual_element; (nodo) && (ELM_ID(nodo)!=elm_ptr); 
-       nodo=nodo->padre);
+  nodo= NULL;
+  if (elm_is_open(elm_ptr)) {
+    int i;
+    for (i= open_depth - 1; ELM_ID(open_stack[i]) != elm_ptr; i--);
+    nodo= open_stack[i];
+  }
   /*elm_close(nodo);*/
 
   /* nodo= tree_search_elm_up(actual_element, elm_ptr); */
@@ -418,7 +481,7 @@ void saxEndElement(const xchar *name)
     tree_node_t *p;
 
     /* se cierran todos los nodos hasta llegar a este */
-    for (p=actual_element; p != nodo; p=p->padre)
+    for (p=actual_element; p != nodo; p=NODE_PADRE(p))
       if (p->tipo == Node_element) {
         elm_close(p);
       }
@@ -426,10 +489,10 @@ void saxEndElement(const xchar *name)
     /* cierra el nodo y actualiza actual_element */
     elm_close(nodo);
     if (!new_place_recovery_on || new_place_recovery_elm != actual_element) {
-      actual_element= nodo->padre;
+      set_actual_element(NODE_PADRE(nodo));
     } else {
       new_place_recovery_on = 0;
-      actual_element = new_place_recovery_father;
+      set_actual_element(new_place_recovery_father);
     }
     if (!actual_element) state= ST_END;
   }
@@ -446,6 +509,11 @@ void saxReference(const xchar *name)
 {
   EPRINTF1("SAX.reference(%s)\n",name);
 
+  if (eventlog_recording) {
+    eventlog_record(EV_REFERENCE, name, -1, NULL);
+    return;
+  }
+
   if (state!=ST_PARSING || !actual_element) return;
 
   /* si es una referencia a entidad, se comprueba que sea vlida */
@@ -477,6 +545,11 @@ void saxCharacters(const xchar *ch, int len)
 {
   EPRINTF2("SAX.characters(%d)[%s]\n",len,ch);
 
+  if (eventlog_recording) {
+    eventlog_record(EV_CHARACTERS, ch, len, NULL);
+    return;
+  }
+
   if (state!=ST_PARSING || !actual_element) return;
 
   insert_chardata(ch, len, Node_chardata);
@@ -492,6 +565,11 @@ void saxCDataSection(const xchar *ch, int len)
 
   EPRINTF2("SAX.cdatasection(%d)[%s]\n",len,ch);
 
+  if (eventlog_recording) {
+    eventlog_record(EV_CDATA_SECTION, ch, len, NULL);
+    return;
+  }
+
   if (state!=ST_PARSING || !actual_element) return;
 
   /* by default, mark as CDATA section */
@@ -511,6 +589,11 @@ void saxWhiteSpace()
 {
   EPRINTF("SAX.whitespace()\n");
 
+  if (eventlog_recording) {
+    eventlog_record(EV_WHITESPACE, NULL, 0, NULL);
+    return;
+  }
+
   if (state!=ST_PARSING) return;
 
   /* insert the whitespace only if the actual element has
@@ -535,6 +618,11 @@ void saxComment(const xchar *value)
 
   EPRINTF1("SAX.comment(%s)\n",value);
 
+  if (eventlog_recording) {
+    eventlog_record(EV_COMMENT, value, -1, NULL);
+    return;
+  }
+
   if (state!=ST_PARSING) {
     INFORM("Comment discarded");
     return;
@@ -563,6 +651,11 @@ void saxDoctype(const xchar *data)
   fprintf(stderr, "SAX.doctype(");
 #endif
 
+  if (eventlog_recording) {
+    eventlog_record(EV_DOCTYPE, data, -1, NULL);
+    return;
+  }
+
   if (state!=ST_PARSING) return;
 
   if (!doctype_detected) {
@@ -603,6 +696,11 @@ void saxXmlProcessingInstruction(const xchar *fullname, xchar **atts)
 #endif
 #endif
 
+  if (eventlog_recording) {
+    eventlog_record(EV_XML_PI, fullname, -1, atts);
+    return;
+  }
+
 /*   encoding_set = 0; */
 
 /*   /\* convert to lowercase the PI name *\/ */
@@ -664,25 +762,14 @@ int writeOutput()
   if (state != ST_END) return -1;
   if (!document) return -2;
   
-  escape_chars= param_cgi_html_output;
-  if (!param_cgi_html_output) {
-    gt= gt_normal;
-    lt= lt_normal;
-    amp= amp_normal;
-  } else {
-    gt= gt_escaped;
-    lt= lt_escaped;
-    amp= amp_escaped;
-  }
-
-  if (!param_crlf_eol)
-    eol = eol_unix;
-  else
-    eol = eol_dos;
-  eol_len = strlen(eol);
+  init_output_strings();
 
   /* vuelca la salida */
-  write_document(document);
+  if (param_binary_output)
+    write_binary_document(document);
+  else
+    write_document(document);
+  charset_end_output(param_outputf);
   return 0;
 }
 
@@ -692,6 +779,10 @@ int writeOutput()
  */
 void freeMemory()
 {
+  open_stack_reset();
+  free(open_stack);
+  open_stack= NULL;
+  open_stack_size= 0;
   tree_free();
   state = ST_END;
 }
@@ -795,8 +886,9 @@ static void set_attributes(tree_node_t *elm, xchar **atts)
   int i;
   xchar att_name[ATT_NAME_LEN];
   int att_ptr;
+  att_plan_t *plan;
 
-  elm_ptr= elm->cont.elemento.elm_id;
+  elm_ptr= elm->elm_id;
 
   /* atributos */
   if (atts) {
@@ -843,23 +935,28 @@ static void set_attributes(tree_node_t *elm, xchar **atts)
 
   /* 
    * ahora hay que comprobar que no falte ningn valor que
-   * sea #REQUIRED
+   * sea #REQUIRED; slo si el mapa del plan dice que falta
+   * alguno se recorre la lista, para tratarlos en su orden
    *
    */
-  for (i=0, att_ptr= elm_list[elm_ptr].attlist[doctype][0];
-       att_ptr>=0;
-       att_ptr= elm_list[elm_ptr].attlist[doctype][++i]) {
+  plan= att_plan_get(elm_ptr);
+  if (tree_node_att_missing(elm, plan->requeridos)) {
+    for (i=0, att_ptr= elm_list[elm_ptr].attlist[doctype][0];
+         att_ptr>=0;
+         att_ptr= elm_list[elm_ptr].attlist[doctype][++i]) {
     
-    if (att_list[att_ptr].defaultDecl== DEFDECL_REQUIRED) {
-      if (!tree_node_search_att(elm, att_ptr)) {
-        /* intenta arreglarlo */
-        if (!err_att_req(elm, att_ptr,atts)) {
-          WARNING("atributo obligatorio no especificado");
-          EPRINTF1("      \"%s\"\n",att_list[att_ptr].name);
+      if (att_list[att_ptr].defaultDecl== DEFDECL_REQUIRED) {
+        if (!tree_node_search_att(elm, att_ptr)) {
+          /* intenta arreglarlo */
+          if (!err_att_req(elm, att_ptr,atts)) {
+            WARNING_ELM(MSG_REQUIRED_ATT, elm_list[elm_ptr].name,
+                        "atributo obligatorio no especificado");
+            EPRINTF1("      \"%s\"\n",att_list[att_ptr].name);
+          }
         }
-      }
-    } /* if REQUIRED */
-  } /* for */ 
+      } /* if REQUIRED */
+    } /* for */ 
+  }
 
 
   /* rutina por defecto de deteccin y 
@@ -920,6 +1017,7 @@ int insert_element(tree_node_t *nodo)
     } else if (insertado == 0) {
       DEBUG("elemento descartado:");
       EPRINTF1("   %s\n",ELM_PTR(nodo).name);
+      stats_count_discarded();
     }
     /* if (insertado == 2) -> inserted by err_child_no_valid in another place */
 
@@ -928,7 +1026,7 @@ int insert_element(tree_node_t *nodo)
   /* si es un elemento vaco, se cierra */
   if (insertado) {
     if (elm_list[elm_ptr].contenttype[doctype]!=CONTTYPE_EMPTY) {
-      actual_element= nodo;
+      set_actual_element(nodo);
     }
     else elm_close(nodo);
   }
@@ -968,9 +1066,9 @@ static void elm_close(tree_node_t *nodo)
     int i, num;
     tree_node_t *elm;
 
-    for (i=0, num=0, elm= nodo->cont.elemento.hijo;
+    for (i=0, num=0, elm= NODE_HIJO(nodo);
          (i<16384) && elm;
-         i++, elm= elm->sig)
+         i++, elm= NODE_SIG(elm))
       if (elm->tipo==Node_element) content[num++]= ELM_ID(elm);
 
     
@@ -978,7 +1076,8 @@ static void elm_close(tree_node_t *nodo)
     if (dtd_is_child_valid(ELM_PTR(nodo).contentspec[doctype],content,num)!=1) {
       /* children no vlido: a intentar corregirlo */
       if (!err_content_invalid(nodo,content,num))
-        WARNING("invalid element content");
+        WARNING_ELM(MSG_INVALID_CONTENT, ELM_PTR(nodo).name,
+                    "invalid element content");
     }
     else DEBUG("child vlido");
   }
@@ -1005,15 +1104,16 @@ static void insert_chardata(const xchar *ch, int len, node_type_t type)
       tree_node_t *p;
 
       p= new_tree_node(Node_element);
-      p->cont.elemento.elm_id= ELMID_P;
+      p->elm_id= ELMID_P;
       link_node(p, actual_element, LINK_MODE_CHILD);
-      actual_element= p;
+      set_actual_element(p);
+      stats_count_inserted(ELMID_P);
       DEBUG("[ERR] insertado elemento <p> para contener PCDATA");
     } else 
       /* si el padre es <ul> o <ol>, se inserta <li> */ 
         if((ELM_ID(actual_element)==ELMID_UL)
            ||(ELM_ID(actual_element)==ELMID_OL)) {
-        actual_element= err_aux_insert_elm(ELMID_LI,NULL,0);
+        set_actual_element(err_aux_insert_elm(ELMID_LI,NULL,0));
         DEBUG("[ERR] insertado elemento li");
     } else {
       INFORM("intento de introducir datos en tipo no mixed");
@@ -1118,7 +1218,7 @@ static void sellar_documento(void)
   int          att_ptr;
 
   sello= new_tree_node(Node_element);
-  sello->cont.elemento.elm_id= ELMID_META;
+  sello->elm_id= ELMID_META;
 
   att_ptr=dtd_att_search_list("name",elm_list[ELMID_META].attlist[doctype]);
   set_node_att(sello,att_ptr,"filter",1);
@@ -1128,9 +1228,9 @@ static void sellar_documento(void)
   set_node_att(sello,att_ptr,SELLO,1);
 #endif
 
-  if (document->inicio && document->inicio->cont.elemento.hijo &&
-      ELM_ID(document->inicio->cont.elemento.hijo)==ELMID_HEAD)
-    link_node(sello,document->inicio->cont.elemento.hijo,LINK_MODE_CHILD);
+  if (document->inicio && NODE_HIJO(document->inicio) &&
+      ELM_ID(NODE_HIJO(document->inicio))==ELMID_HEAD)
+    link_node(sello,NODE_HIJO(document->inicio),LINK_MODE_CHILD);
 }
 #endif
 
@@ -1148,14 +1248,14 @@ static int elm_check_prohibitions(int elmid)
 {
   switch (elmid) {
   case ELMID_A:
-    return !elm_is_father(ELMID_A,actual_element);
+    return !elm_is_open(ELMID_A);
   case ELMID_IMG:
   case ELMID_OBJECT:
   case ELMID_BIG:
   case ELMID_SMALL:
   case ELMID_SUB:
   case ELMID_SUP:
-    return !elm_is_father(ELMID_PRE,actual_element);
+    return !elm_is_open(ELMID_PRE);
   case ELMID_INPUT:
   case ELMID_SELECT:
   case ELMID_TEXTAREA:
@@ -1163,13 +1263,13 @@ static int elm_check_prohibitions(int elmid)
   case ELMID_FIELDSET:
   case ELMID_IFRAME:
   case ELMID_ISINDEX:
-    return !elm_is_father(ELMID_BUTTON,actual_element);
+    return !elm_is_open(ELMID_BUTTON);
   case ELMID_LABEL:
-    return ((!elm_is_father(ELMID_LABEL,actual_element))
-            &&(!elm_is_father(ELMID_BUTTON,actual_element)));
+    return ((!elm_is_open(ELMID_LABEL))
+            &&(!elm_is_open(ELMID_BUTTON)));
   case ELMID_FORM:
-    return ((!elm_is_father(ELMID_BUTTON,actual_element))
-            &&(!elm_is_father(ELMID_FORM,actual_element)));
+    return ((!elm_is_open(ELMID_BUTTON))
+            &&(!elm_is_open(ELMID_FORM)));
   default:
       return 1;
   }
@@ -1177,18 +1277,89 @@ static int elm_check_prohibitions(int elmid)
 
 
 /*
- * comprueba si algn elemento que contenga a 'nodo', 
- * o el propio elemento 'nodo', tiene identificador 'elmid'
+ * comprueba si actual_element o alguno de sus antecesores
+ * tiene identificador 'elmid'
  *
  * devuelve 1 si es as, o 0 si no
  *
  */
-static int elm_is_father(int elmid, tree_node_t *nodo)
+static int elm_is_open(int elmid)
 {
-  for ( ; nodo ; nodo= nodo->padre)
-    if (ELM_ID(nodo)==elmid) return 1;
+  return open_count[elmid] > 0;
+}
 
-  return 0;
+
+/*
+ * cambia el elemento actual y actualiza la pila de elementos
+ * abiertos: saca los que ya no son antecesores del nuevo
+ * elemento actual y mete los que faltan
+ *
+ */
+static void set_actual_element(tree_node_t *nodo)
+{
+  tree_node_t *p;
+  int num, i;
+
+  /* antecesor ms cercano que ya est en la pila */
+  for (num= 0, p= nodo; p && !(p->marcas & NODE_OPEN); p= NODE_PADRE(p))
+    num++;
+
+  while (open_depth > 0 && open_stack[open_depth - 1] != p) {
+    open_depth--;
+    open_stack[open_depth]->marcas&= ~NODE_OPEN;
+    open_count[ELM_ID(open_stack[open_depth])]--;
+  }
+
+  if (open_depth + num > open_stack_size) {
+    while (open_depth + num > open_stack_size)
+      open_stack_size= open_stack_size ? 2 * open_stack_size : 256;
+    open_stack= realloc(open_stack, open_stack_size * sizeof(tree_node_t*));
+    if (!open_stack) EXIT("out of memory");
+  }
+
+  for (i= open_depth + num - 1, p= nodo; i >= open_depth; 
+       i--, p= NODE_PADRE(p)) {
+    open_stack[i]= p;
+    p->marcas|= NODE_OPEN;
+    open_count[ELM_ID(p)]++;
+  }
+  open_depth+= num;
+
+  actual_element= nodo;
+}
+
+static void open_stack_reset(void)
+{
+  while (open_depth > 0)
+    open_stack[--open_depth]->marcas&= ~NODE_OPEN;
+  memset(open_count, 0, sizeof(open_count));
+  actual_element= NULL;
+}
+
+
+
+/*
+ * devuelve el plan de atributos del elemento en el DTD actual,
+ * calculndolo si an no se haba hecho
+ *
+ */
+static att_plan_t *att_plan_get(int elm_id)
+{
+  att_plan_t *plan= &att_plans[elm_id][doctype];
+  int *attlist;
+  int i;
+
+  if (!plan->listo) {
+    attlist= elm_list[elm_id].attlist[doctype];
+    for (i=0; attlist[i]>=0; i++)
+      if (att_list[attlist[i]].defaultDecl== DEFDECL_REQUIRED)
+        plan->requeridos[attlist[i] >> 5]|= 1U << (attlist[i] & 31);
+    plan->id= dtd_att_search_list("id", attlist);
+    plan->xml_space= (dtd_att_search_list_id(ATTID_XML_SPACE, attlist) >= 0);
+    plan->listo= 1;
+  }
+
+  return plan;
 }
 
 
@@ -1197,10 +1368,11 @@ void set_node_att(tree_node_t *nodo, int att_id, xchar *value, int is_valid)
 {
   xchar* new_value = value;
   xchar *tmp_value;
-  int len = strlen(value);
+  int len;
 
   if (att_list[att_id].attType== ATTTYPE_ID) {
     /* si es ID, comprueba que no se repita y registra el valor */
+    len = strlen(value);
     while (id_search(new_value)) {
       len++;
       tmp_value = (xchar*) tree_malloc(len + 1);
@@ -1209,12 +1381,14 @@ void set_node_att(tree_node_t *nodo, int att_id, xchar *value, int is_valid)
       tmp_value[len] = 0;
       new_value = tmp_value;
     }
+    if (new_value != value)
+      stats_count_renamed_id();
 
     /* se aade el valor a la lista */
     if (id_list_num < ID_LIST_SIZE - 1)
       id_list[id_list_num++] = new_value;
     else
-      WARNING("lista de atributos id desbordada");
+      WARNING(MSG_ID_OVERFLOW, "lista de atributos id desbordada");
       /* jjjjjjjj */
   }
 
@@ -1303,12 +1477,12 @@ static int err_content_invalid(tree_node_t* nodo, int hijos[], int num_hijos)
         /* si est mal HTML, intenta arreglarlo */
         if (!num_hijos) {
           /* faltan HEAD y BODY */
-          actual_element= nodo;
+          set_actual_element(nodo);
           corregido= err_html_struct(document,in_body);;
         }
         else if ((num_hijos==1)&&(hijos[0]==ELMID_HEAD)) {
           /* falta BODY */
-          actual_element= nodo->cont.elemento.hijo;
+          set_actual_element(NODE_HIJO(nodo));
           corregido= err_html_struct(document,in_body);
         }
         else if ((num_hijos==1)&&
@@ -1319,14 +1493,14 @@ static int err_content_invalid(tree_node_t* nodo, int hijos[], int num_hijos)
             body= tree_search_elm_child(nodo,ELMID_FRAMESET);
           if (body) {
             tree_unlink_node(body);
-            actual_element= nodo;
+            set_actual_element(nodo);
             corregido= err_html_struct(document,ELMID_BODY);
             link_node(body,nodo,LINK_MODE_CHILD);
           }
         }
         
 
-        actual_element= actual_bak;
+        set_actual_element(actual_bak);
         break;
       }
 
@@ -1356,7 +1530,7 @@ static int err_content_invalid(tree_node_t* nodo, int hijos[], int num_hijos)
                                h, num_hijos + 1) == 1) {
           tree_node_t* title;
           title = new_tree_node(Node_element);
-          title->cont.elemento.elm_id = ELMID_TITLE;
+          title->elm_id = ELMID_TITLE;
           link_node(title, nodo, LINK_MODE_FIRST_CHILD);
           corregido = 1;
         }
@@ -1380,6 +1554,7 @@ static int err_content_invalid(tree_node_t* nodo, int hijos[], int num_hijos)
       /* se descarta, porque no contiene informacin */
       tree_unlink_node(nodo);
       INFORM("[ERR] descartado el elemento");
+      stats_count_discarded();
       corregido=1;
       break;
     }
@@ -1392,9 +1567,10 @@ static int err_content_invalid(tree_node_t* nodo, int hijos[], int num_hijos)
        */
       tree_node_t *td;
       td= new_tree_node(Node_element);
-      td->cont.elemento.elm_id= ELMID_TD;
+      td->elm_id= ELMID_TD;
       link_node(td,nodo,LINK_MODE_CHILD);
       corregido= 1;
+      stats_count_inserted(ELMID_TD);
       INFORM("insertado elemento td");
       break;
     }
@@ -1410,6 +1586,7 @@ static int err_content_invalid(tree_node_t* nodo, int hijos[], int num_hijos)
       if (!num_hijos) {
         tree_unlink_node(nodo);
         corregido= 1;
+        stats_count_discarded();
         INFORM("[ERR] descartado el elemento");
       } else {
         memcpy(hijos2,hijos,num_hijos*sizeof(int));
@@ -1418,12 +1595,14 @@ static int err_content_invalid(tree_node_t* nodo, int hijos[], int num_hijos)
                                hijos2,num_hijos+1)==1) {
           /* OK, se inserta */
           tr= new_tree_node(Node_element);
-          tr->cont.elemento.elm_id= ELMID_TR;
+          tr->elm_id= ELMID_TR;
           link_node(tr,nodo,LINK_MODE_CHILD);
           td= new_tree_node(Node_element);
-          td->cont.elemento.elm_id= ELMID_TD;
+          td->elm_id= ELMID_TD;
           link_node(td,tr,LINK_MODE_CHILD);
           corregido= 1;
+          stats_count_inserted(ELMID_TR);
+          stats_count_inserted(ELMID_TD);
           INFORM("[ERR] insertados <TR><TD></TD></TR>");
         }
       }
@@ -1459,8 +1638,8 @@ static int remove_duplicate_elm(int elmid, tree_node_t* parent, int hijos[])
 
   removed = 0;
   keep_node = 1;
-  for (i = 0, p = parent->cont.elemento.hijo; p; i++) {
-    next = p->sig;
+  for (i = 0, p = NODE_HIJO(parent); p; i++) {
+    next = NODE_SIG(p);
     if (p->tipo == Node_element && ELM_ID(p) == elmid) {
       if (!keep_node) {
         tree_unlink_node(p);
@@ -1487,7 +1666,7 @@ static int remove_duplicate_elm(int elmid, tree_node_t* parent, int hijos[])
  */ 
 static int err_child_no_valid(tree_node_t* nodo)
 {
-  int insertado;
+  int insertado, i;
   tree_node_t* actual;
 
   EPRINTF1("err_child_no_valid(%s)\n", ELM_PTR(nodo).name);
@@ -1495,7 +1674,7 @@ static int err_child_no_valid(tree_node_t* nodo)
   /* si el padre es <ul> o <ol>, se inserta <li> */
   if (((ELM_ID(actual_element)==ELMID_OL)||(ELM_ID(actual_element)==ELMID_UL))
       && (dtd_can_be_child(ELM_ID(nodo),ELMID_LI,doctype))){
-    actual_element= err_aux_insert_elm(ELMID_LI,NULL,0);
+    set_actual_element(err_aux_insert_elm(ELMID_LI,NULL,0));
     DEBUG("[ERR] insertado elemento li");
     return 1;
   } 
@@ -1507,7 +1686,7 @@ static int err_child_no_valid(tree_node_t* nodo)
        (ELM_ID(actual_element)==ELMID_THEAD)||
        (ELM_ID(actual_element)==ELMID_TBODY) ) &&
       ((ELM_ID(nodo)==ELMID_TH)||(ELM_ID(nodo)==ELMID_TD))) {
-      actual_element= err_aux_insert_elm(ELMID_TR,NULL,0);
+      set_actual_element(err_aux_insert_elm(ELMID_TR,NULL,0));
       DEBUG("[ERR] insertado elemento tr");
       return 1;
   } 
@@ -1526,8 +1705,9 @@ static int err_child_no_valid(tree_node_t* nodo)
   /* en principio, se asciende en la jerarqua hasta
    * que sea un hijo vlido
    */
-  for (insertado=0, actual= actual_element; actual; actual= actual->padre) {
-    if (dtd_can_be_child(ELM_ID(nodo),ELM_ID(actual),doctype)) {
+  for (insertado=0, i= open_depth - 1, actual= NULL; i >= 0; i--) {
+    if (dtd_can_be_child(ELM_ID(nodo),ELM_ID(open_stack[i]),doctype)) {
+      actual= open_stack[i];
       insertado= 1;
       break;
     }
@@ -1539,7 +1719,8 @@ static int err_child_no_valid(tree_node_t* nodo)
     if ((ELM_ID(nodo)==ELMID_HEAD)
         || (ELM_ID(nodo)==ELMID_BODY)
         || (ELM_ID(nodo)==ELMID_FRAMESET)) insertado=0;
-    else for ( ; actual_element != actual; actual_element= actual_element->padre)
+    else for ( ; actual_element != actual; 
+               set_actual_element(NODE_PADRE(actual_element)))
       if (actual_element->tipo == Node_element) {
         elm_close(actual_element);
       }
@@ -1553,16 +1734,17 @@ static int err_child_no_valid(tree_node_t* nodo)
       tree_node_t *p;
       
       p= new_tree_node(Node_element);
-      p->cont.elemento.elm_id= ELMID_P;
+      p->elm_id= ELMID_P;
       link_node(p, actual_element, LINK_MODE_CHILD);
-      actual_element= p;
+      set_actual_element(p);
       insertado= 1;
+      stats_count_inserted(ELMID_P);
       DEBUG("[ERR] insertado elemento p como padre");
     } else if (ELM_ID(actual_element) == ELMID_HTML
                && (actual = tree_search_elm_child(actual_element, ELMID_BODY))) {
       if (dtd_can_be_child(ELM_ID(nodo), ELMID_BODY, doctype)) {
         /* Insert the new element inside the body element */
-        actual_element = actual;
+        set_actual_element(actual);
         insertado = 1;
       } else if (dtd_can_be_child(ELM_ID(nodo), ELMID_P, doctype)) {
         /* Insert the new element inside a new p element inside the
@@ -1570,10 +1752,11 @@ static int err_child_no_valid(tree_node_t* nodo)
          */
         tree_node_t *p;
         p= new_tree_node(Node_element);
-        p->cont.elemento.elm_id= ELMID_P;
+        p->elm_id= ELMID_P;
         link_node(p, actual, LINK_MODE_CHILD);
-        actual_element = p;
+        set_actual_element(p);
         insertado = 1;
+        stats_count_inserted(ELMID_P);
       }
     }
   }
@@ -1582,7 +1765,7 @@ static int err_child_no_valid(tree_node_t* nodo)
     /* si es un elemento style, lo metemos dentro de head */
 
     /* el primer hijo de <html> es <head> */
-    tree_node_t* head = document->inicio->cont.elemento.hijo;
+    tree_node_t* head = NODE_HIJO(document->inicio);
     link_node(nodo, head, LINK_MODE_CHILD);
     insertado = 2;
     
@@ -1743,6 +1926,7 @@ static int err_att_req(tree_node_t *elm, int att_id, xchar **atts)
  */
 static void err_att_default(tree_node_t *elm, xchar **atts)
 {
+  att_plan_t *plan= att_plan_get(ELM_ID(elm));
 
   /* si posee atributo 'name', se pasa su valor a 'id' */
   switch (ELM_ID(elm)) {
@@ -1760,7 +1944,7 @@ static void err_att_default(tree_node_t *elm, xchar **atts)
       if (atts) {
         for (i=0; atts[i]; i+=2)  
           if (!strcmp(atts[i],"name")) {
-            att_ptr= dtd_att_search_list("id",ELM_PTR(elm).attlist[doctype]);
+            att_ptr= plan->id;
             if ((att_ptr != -1) && (!tree_node_search_att(elm,att_ptr))) {
               if (dtd_att_is_valid(att_ptr,atts[i+1])) {
                 set_node_att(elm, att_ptr, atts[i+1], 1);
@@ -1779,9 +1963,7 @@ static void err_att_default(tree_node_t *elm, xchar **atts)
   case ELMID_PRE:
   case ELMID_SCRIPT:
   case ELMID_STYLE:
-    if (!tree_node_search_att(elm, ATTID_XML_SPACE)
-        && dtd_att_search_list_id(ATTID_XML_SPACE, 
-                                  ELM_PTR(elm).attlist[doctype]) >= 0) {
+    if (plan->xml_space && !tree_node_search_att(elm, ATTID_XML_SPACE)) {
       set_node_att(elm,ATTID_XML_SPACE, "preserve", 1); 
     }
     break;
@@ -1827,7 +2009,7 @@ static int err_html_struct(document_t *document, int elm_id)
     if (html) break;
     /* establece un nodo para el elemento html */
     if (!html) html= err_aux_insert_elm(ELMID_HTML,NULL,0);
-    actual_element= html;
+    set_actual_element(html);
     ok= 1;
     DEBUG("err_html_struct()");
     EPRINTF("   [ERR] introducido elemento <html>\n");
@@ -1840,7 +2022,7 @@ static int err_html_struct(document_t *document, int elm_id)
     if (!html) html= err_aux_insert_elm(ELMID_HTML,NULL,0);     
     /* establece un nodo para el elemento head */
     if (!head) {
-      actual_element= html;
+      set_actual_element(html);
       head= err_aux_insert_elm(ELMID_HEAD,NULL,0);
       /* establece un nodo para el elemento title */
       nodo= err_aux_insert_elm(ELMID_TITLE,"****",4);
@@ -1848,11 +2030,11 @@ static int err_html_struct(document_t *document, int elm_id)
       elm_close(nodo);
       elm_close(head);
     }
-    for (nodo=actual_element; nodo && (nodo!=html); nodo=nodo->padre)
+    for (nodo=actual_element; nodo && (nodo!=html); nodo=NODE_PADRE(nodo))
       if (nodo->tipo == Node_element) {
         elm_close(nodo);
       }
-    actual_element= html;
+    set_actual_element(html);
     ok=1;
     DEBUG("err_html_struct()");
     EPRINTF("   [ERR] introducido <html> <head> <title> </title> </head> \n");
@@ -1886,11 +2068,11 @@ static int err_html_struct(document_t *document, int elm_id)
         elm_close(head);
       }
       
-      for(nodo=actual_element; nodo && (nodo!=html); nodo=nodo->padre)
+      for(nodo=actual_element; nodo && (nodo!=html); nodo=NODE_PADRE(nodo))
         if (nodo->tipo == Node_element) {
           elm_close(nodo);
         }
-      actual_element= html;
+      set_actual_element(html);
 
       /* establece un nodo para el elemento body */
       body= err_aux_insert_elm(ELMID_BODY,NULL,0);
@@ -1912,11 +2094,11 @@ static int err_html_struct(document_t *document, int elm_id)
         elm_close(head);
       }
       
-      for(nodo=actual_element; nodo && (nodo!=html); nodo=nodo->padre)
+      for(nodo=actual_element; nodo && (nodo!=html); nodo=NODE_PADRE(nodo))
         if (nodo->tipo == Node_element) {
           elm_close(nodo);
         }
-      actual_element= html;
+      set_actual_element(html);
 
       /* establece un nodo para el elemento body */
       body= err_aux_insert_elm(ELMID_FRAMESET,NULL,0);
@@ -1959,9 +2141,10 @@ static tree_node_t* err_aux_insert_elm(int elm_id, const xchar *content, int len
 
   /* crea e inserta el nodo de elemento */
   elm= new_tree_node(Node_element);
-  elm->cont.elemento.elm_id= elm_id;
+  elm->elm_id= elm_id;
   insert_element(elm);
   set_attributes(elm,NULL);
+  stats_count_inserted(elm_id);
   
   /* si tiene contenido, se lo inserta */
   if (content && (len>0)) {
@@ -2002,19 +2185,24 @@ static tree_node_t* err_aux_insert_elm(int elm_id, const xchar *content, int len
 xchar* check_and_fix_att_value(xchar* value)
 {
   xchar* fixed = value;
-  int i, k;
+  int i, k, n;
   int size_inc = 0;
-  xchar tmpchar;
 
   /* special marks: in values, characters with code 1 and 2 are
    * introduced for signaling, respectively, '<' or '&' that
    * need to be fixed
    */
 
+  /* fast path: most values contain neither '&' nor '<' */
+  i = strcspn(value, "&<");
+  if (!value[i])
+    return value;
+
   /* first round: detect errors and count the increment of size
-   * necessary to correct them
+   * necessary to correct them; only '&' and '<' need to be visited,
+   * so the loop jumps from one to the next with strcspn()
    */
-  for (i = 0; value[i]; i++) {
+  for (; value[i]; i += 1 + strcspn(&value[i + 1], "&<")) {
     if (value[i] == '&' && value[i+1] == '#' && value[i+2] == 'x') {
       /* character reference (hexadecimal) */
       for (k = i + 3; 
@@ -2059,9 +2247,7 @@ xchar* check_and_fix_att_value(xchar* value)
         value[i] = 2;
         i = k - 1; /* next iteration at index k */
       } else {
-        /* check the entity name */
-        tmpchar = value[k+1];
-        value[k+1] = 0;
+        /* check the entity name (the search stops at ';') */
         if (dtd_ent_search(&value[i]) == -1) {
           /* needs to be fixed insert "amp;" */
           size_inc += 4;
@@ -2070,7 +2256,6 @@ xchar* check_and_fix_att_value(xchar* value)
         } else {
           i = k; /* next iteration at index k + 1 */
         }
-        value[k+1] = tmpchar;
       }
     } else if (value[i] == '<') {
       size_inc += 3;
@@ -2083,22 +2268,26 @@ xchar* check_and_fix_att_value(xchar* value)
     fixed = (xchar*) tree_malloc(strlen(value) + 1 + size_inc);
 
     for (i = 0, k = 0; value[i]; i++, k++) {
-      /* copy the value and replace marked characters */
-      if (value[i] == 1) {
+      /* copy the unmarked run at once, then replace the mark */
+      n = strcspn(&value[i], "\001\002");
+      memcpy(&fixed[k], &value[i], n);
+      i += n;
+      k += n;
+      if (!value[i]) {
+        break;
+      } else if (value[i] == 1) {
         fixed[k    ] = '&';
         fixed[k + 1] = 'l';
         fixed[k + 2] = 't';
         fixed[k + 3] = ';';
         k += 3;
-      } else if (value[i] == 2) {
+      } else {
         fixed[k    ] = '&';
         fixed[k + 1] = 'a';
         fixed[k + 2] = 'm';
         fixed[k + 3] = 'p';
         fixed[k + 4] = ';';
         k += 4;
-      } else {
-        fixed[k] = value[i];
       }
     }
     fixed[k] = 0;
@@ -2118,6 +2307,7 @@ xchar* check_and_fix_att_value(xchar* value)
 
 /* internal variables of the output module */
 static int xml_space_on;
+static tree_node_t *xml_space_elm;  /* element that set xml_space_on */
 static int inline_on;
 static int indent;
 static int chars_in_line;
@@ -2129,6 +2319,69 @@ static char cbuffer[CBUFFER_SIZE];
 static int cbuffer_pos;
 static int cbuffer_avail;
 
+/* text and attribute values decoded for the binary output */
+static char *bdecoded = NULL;
+static size_t bdecoded_size = 0;
+
+/*
+ * Sets the strings used for markup and end of line
+ *
+ */
+static void init_output_strings(void)
+{
+  escape_chars= param_cgi_html_output;
+  if (!param_cgi_html_output) {
+    gt= gt_normal;
+    lt= lt_normal;
+    amp= amp_normal;
+  } else {
+    gt= gt_escaped;
+    lt= lt_escaped;
+    amp= amp_escaped;
+  }
+
+  if (!param_crlf_eol)
+    eol = eol_unix;
+  else
+    eol = eol_dos;
+  eol_len = strlen(eol);
+}
+
+/*
+ * Entry points to the writer for the microbenchmarks. They write
+ * data blocks to param_outputf outside of a whole document:
+ * writeBegin() opens the output, writePlainData() and
+ * writeChardata() may then be invoked any number of times, and
+ * writeEnd() flushes and closes the output.
+ *
+ */
+void writeBegin(void)
+{
+  init_output_strings();
+  xml_space_on = 0;
+  inline_on = 0;
+  inside_cdata_sec = 0;
+  indent = 0;
+  chars_in_line = 0;
+  whitespace_needed = 0;
+  cprintf_init(param_charset_out, param_outputf);
+}
+
+int writePlainData(xchar *text, int len)
+{
+  return write_plain_data(text, len);
+}
+
+int writeChardata(tree_node_t *node)
+{
+  return write_chardata(node);
+}
+
+void writeEnd(void)
+{
+  cprintf_close();
+}
+
 /*
  * Writes to output the document
  *
@@ -2139,6 +2392,7 @@ static void write_document(document_t *doc)
   tree_node_t *body;
 
   xml_space_on = 0;
+  xml_space_elm = NULL;
   inside_cdata_sec = 0;
 
   cprintf_init(param_charset_out, param_outputf);
@@ -2161,7 +2415,7 @@ static void write_document(document_t *doc)
   } else {
     body = tree_search_elm_child(doc->inicio, ELMID_BODY);
     if (body) {
-      for (p = body->cont.elemento.hijo; p; p = p->sig) {
+      for (p = NODE_HIJO(body); p; p = NODE_SIG(p)) {
         write_node(p);
       }
       cprintf(eol);
@@ -2190,16 +2444,278 @@ static void write_doctype()
   }
 }
 
+/*
+ * Writes the document in the binary format of h2xbin.h. The tree
+ * is traversed twice: first to find the elements and attributes
+ * whose names go in the header, and then to write the records.
+ * The bytes are written without charset conversion.
+ *
+ */
+static void write_binary_document(document_t *doc)
+{
+  unsigned char elm_used[elm_data_num];
+  unsigned char att_used[att_data_num];
+  tree_node_t *p;
+  tree_node_t *first;
+  const char *key;
+  int pass;
+
+  first = doc->inicio;
+  if (param_generate_snippet) {
+    first = tree_search_elm_child(doc->inicio, ELMID_BODY);
+    if (first)
+      first = NODE_HIJO(first);
+  }
+
+  cbuffer_pos = 0;
+  cbuffer_avail = CBUFFER_SIZE;
+  memset(elm_used, 0, sizeof(elm_used));
+  memset(att_used, 0, sizeof(att_used));
+
+  for (pass = 0; pass < 2; pass++) {
+    if (pass == 1) {
+      /* header */
+      key = dtd_key[doc->xhtml_doctype];
+      bwrite(H2XBIN_MAGIC, 4);
+      bwrite_u16(H2XBIN_VERSION);
+      bwrite_u16(0);
+      bwrite_u8(strlen(key));
+      bwrite(key, strlen(key));
+      write_binary_names(elm_used, elm_data_num, 0);
+      write_binary_names(att_used, att_data_num, 1);
+    }
+
+    /* in a snippet, the contents of the body, as in write_document() */
+    for (p = first; p; p = param_generate_snippet ? NODE_SIG(p) : NULL)
+      write_binary_node(p, pass ? NULL : elm_used, pass ? NULL : att_used);
+  }
+
+  bwrite_u8(H2XBIN_END_DOCUMENT);
+  charset_write_raw(param_outputf, cbuffer, cbuffer_pos);
+  cbuffer_pos = 0;
+  cbuffer_avail = CBUFFER_SIZE;
+
+  free(bdecoded);
+  bdecoded = NULL;
+  bdecoded_size = 0;
+}
+
+/*
+ * Writes the records of a node and its subtree, traversed as in
+ * write_node(). If 'elm_used' and 'att_used' are not null, nothing is
+ * written: the elements and attributes found are marked in them.
+ *
+ */
+static void write_binary_node(tree_node_t *node, unsigned char *elm_used,
+                              unsigned char *att_used)
+{
+  att_node_t *atts[att_data_num];
+  tree_node_t *n = node;
+  const char *value;
+  int num_atts;
+  int num_valid;
+  int i;
+
+  for (;;) {
+    if (n->tipo == Node_element) {
+      num_atts = tree_node_get_atts(n, atts);
+      for (i = 0, num_valid = 0; i < num_atts; i++)
+        if (atts[i]->es_valido)
+          atts[num_valid++] = atts[i];
+
+      if (elm_used) {
+        elm_used[ELM_ID(n)] = 1;
+        for (i = 0; i < num_valid; i++)
+          att_used[atts[i]->att_id] = 1;
+      } else {
+        bwrite_u8(H2XBIN_START_ELEMENT);
+        bwrite_u16(ELM_ID(n));
+        bwrite_u16(num_valid);
+        for (i = 0; i < num_valid; i++) {
+          value = (const char *) tree_index_to_ptr(atts[i]->valor);
+          bwrite_u16(atts[i]->att_id);
+          bwrite_decoded(value, strlen(value));
+        }
+      }
+      if (NODE_HIJO(n)) {
+        n = NODE_HIJO(n);
+        continue;
+      }
+      if (!elm_used) {
+        bwrite_u8(H2XBIN_END_ELEMENT);
+        bwrite_u16(ELM_ID(n));
+      }
+    } else if (!elm_used) {
+      if (n->tipo == Node_chardata) {
+        bwrite_u8(H2XBIN_TEXT);
+        bwrite_decoded(NODE_DATA(n), NODE_DATA_LEN(n));
+      } else {
+        bwrite_u8(n->tipo == Node_cdata_sec ? H2XBIN_CDATA : H2XBIN_COMMENT);
+        bwrite_u32(NODE_DATA_LEN(n));
+        bwrite(NODE_DATA(n), NODE_DATA_LEN(n));
+      }
+    }
+
+    /* go up until a node with a next sibling is found */
+    while (n != node && !n->sig) {
+      n = NODE_PADRE(n);
+      if (!elm_used) {
+        bwrite_u8(H2XBIN_END_ELEMENT);
+        bwrite_u16(ELM_ID(n));
+      }
+    }
+    if (n == node)
+      break;
+    n = NODE_SIG(n);
+  }
+}
+
+/*
+ * Writes the table of names of the header for the elements
+ * (is_att = 0) or attributes (is_att = 1) marked in 'used'
+ *
+ */
+static void write_binary_names(unsigned char *used, int num, int is_att)
+{
+  const char *name;
+  int count;
+  int i;
+
+  for (i = 0, count = 0; i < num; i++)
+    count += used[i];
+  bwrite_u16(count);
+
+  for (i = 0; i < num; i++) {
+    if (!used[i])
+      continue;
+    name = is_att ? att_list[i].name : elm_list[i].name;
+    bwrite_u16(i);
+    bwrite_u8(strlen(name));
+    bwrite(name, strlen(name));
+  }
+}
+
+/*
+ * Binary output is kept in cbuffer, like the text output, but it
+ * is written with charset_write_raw() when the buffer gets full.
+ *
+ */
+static void bwrite(const void *buf, size_t num)
+{
+  const char *p = (const char *) buf;
+  size_t to_write;
+
+  while (num > 0) {
+    if (!cbuffer_avail) {
+      charset_write_raw(param_outputf, cbuffer, cbuffer_pos);
+      cbuffer_pos = 0;
+      cbuffer_avail = CBUFFER_SIZE;
+    }
+    to_write = num < cbuffer_avail ? num : cbuffer_avail;
+    memcpy(&cbuffer[cbuffer_pos], p, to_write);
+    cbuffer_pos += to_write;
+    cbuffer_avail -= to_write;
+    p += to_write;
+    num -= to_write;
+  }
+}
+
+static void bwrite_u8(unsigned int value)
+{
+  unsigned char byte = value & 0xff;
+
+  bwrite(&byte, 1);
+}
+
+static void bwrite_u16(unsigned int value)
+{
+  unsigned char bytes[2];
+
+  bytes[0] = value & 0xff;
+  bytes[1] = (value >> 8) & 0xff;
+  bwrite(bytes, 2);
+}
+
+static void bwrite_u32(size_t value)
+{
+  unsigned char bytes[4];
+
+  bytes[0] = value & 0xff;
+  bytes[1] = (value >> 8) & 0xff;
+  bytes[2] = (value >> 16) & 0xff;
+  bytes[3] = (value >> 24) & 0xff;
+  bwrite(bytes, 4);
+}
+
+/*
+ * Writes the length and the bytes of text or of an attribute value
+ * with its character and entity references decoded
+ * (see dtd_decode_refs)
+ *
+ */
+static void bwrite_decoded(const xchar *text, size_t len)
+{
+  char *buf;
+
+  if (len > bdecoded_size) {
+    buf = (char *) realloc(bdecoded, len);
+    if (!buf)
+      EXIT("out of memory");
+    bdecoded = buf;
+    bdecoded_size = len;
+  }
+
+  len = dtd_decode_refs(text, len, bdecoded);
+  bwrite_u32(len);
+  bwrite(bdecoded, len);
+}
+
+/*
+ * Writes a node and its subtree. The tree is traversed through
+ * its parent and sibling links, without recursion, so that the
+ * nesting depth of the document does not consume stack.
+ *
+ */
 static int write_node(tree_node_t *node)
+{
+  int len = 0;
+  tree_node_t *n = node;
+
+  for (;;) {
+    if (n->tipo == Node_element) {
+      len += write_element_start(n);
+      if (NODE_HIJO(n)) {
+        n = NODE_HIJO(n);
+        continue;
+      }
+      len += write_element_end(n);
+    } else {
+      len += write_leaf(n);
+    }
+
+    /* go up until a node with a next sibling is found */
+    while (n != node && !n->sig) {
+      n = NODE_PADRE(n);
+      len += write_element_end(n);
+    }
+    if (n == node)
+      break;
+    n = NODE_SIG(n);
+  }
+
+  return len;
+}
+
+static int write_leaf(tree_node_t *node)
 {
   int len = 0;
 
   switch (node->tipo) {
-  case Node_element:
-    len = write_element(node);
-    break;
   case Node_chardata:
-    if (!xml_space_on)
+    if (param_no_reflow)
+      len = write_verbatim_data(NODE_DATA(node),
+                                NODE_DATA_LEN(node));
+    else if (!xml_space_on)
       len = write_chardata(node);
     else
       len = write_chardata_space_preserve(node);
@@ -2216,12 +2732,14 @@ static int write_node(tree_node_t *node)
 }
 
 
-static int write_element(tree_node_t *elm)
+/*
+ * Writes the start tag of an element, before its children
+ *
+ */
+static int write_element_start(tree_node_t *elm)
 {
   int len = 0;
-  tree_node_t *n;
   int is_block;
-  int xml_space_activated;
 
   is_block = dtd_elm_is_block(ELM_ID(elm));
 
@@ -2232,12 +2750,10 @@ static int write_element(tree_node_t *elm)
           || ELM_ID(elm) == ELMID_STYLE)) {
     if (ELM_ID(elm) == ELMID_STYLE)
       len += write_indent(indent, 1);
-    else if (ELM_ID(elm) != ELMID_SCRIPT && is_block)
+    else if (ELM_ID(elm) != ELMID_SCRIPT && is_block && !param_no_reflow)
       len += cprintf(eol);
-    xml_space_activated = 1;
     xml_space_on = 1;
-  } else {
-    xml_space_activated = 0;
+    xml_space_elm = elm;
   }
 
   /* write start tag */
@@ -2254,19 +2770,27 @@ static int write_element(tree_node_t *elm)
   }
   len += write_start_tag(elm);
 
-  /* process children nodes */
-  n = elm->cont.elemento.hijo;
   if (is_block)
     indent += param_tab_len;
-  while (n) {
-    len += write_node(n);
-    n = n->sig;
-  }
+
+  return len;
+}
+
+/*
+ * Writes the end tag of an element, after its children
+ *
+ */
+static int write_element_end(tree_node_t *elm)
+{
+  int len = 0;
+  int is_block;
+
+  is_block = dtd_elm_is_block(ELM_ID(elm));
   if (is_block)
     indent -= param_tab_len;
 
   /* write end tag if not empty */
-  if (elm->cont.elemento.hijo) {
+  if (NODE_HIJO(elm)) {
     if (is_block) {
       if (inline_on) {
         inline_on = 0;
@@ -2283,8 +2807,9 @@ static int write_element(tree_node_t *elm)
   }
 
   /* deactivate "xml:space preserve" if activated */
-  if (xml_space_activated) {
+  if (xml_space_elm == elm) {
     xml_space_on = 0;
+    xml_space_elm = NULL;
   }
 
   return len;
@@ -2302,8 +2827,8 @@ static int write_chardata(tree_node_t *node)
   int num;
   int printed;
 
-  data = (char*)tree_index_to_ptr(node->cont.chardata.data);
-  data_len = node->cont.chardata.data_len;
+  data = NODE_DATA(node);
+  data_len = NODE_DATA_LEN(node);
   pos = 0;
   num = 0;
 
@@ -2377,12 +2902,16 @@ static int write_cdata_sec(tree_node_t *node)
   }
 
   /* write the data node itself */
-  len += write_chardata_space_preserve(node);
+  if (!param_no_reflow)
+    len += write_chardata_space_preserve(node);
+  else
+    len += write_verbatim_data(NODE_DATA(node),
+                               NODE_DATA_LEN(node));
 
   /* write the closing markup if next node is not a CDATA
    * section 
    */
-  if (!node->sig || node->sig->tipo != Node_cdata_sec) {
+  if (!node->sig || NODE_SIG(node)->tipo != Node_cdata_sec) {
     /* write the closing markup */
     if (param_protect_cdata && xml_space_on) {
       len += cprintf("//]]%s", gt);
@@ -2405,8 +2934,8 @@ static int write_chardata_space_preserve(tree_node_t *node)
   xchar *data;
   int num;
 
-  data = (char*)tree_index_to_ptr(node->cont.chardata.data);
-  data_len = node->cont.chardata.data_len;
+  data = NODE_DATA(node);
+  data_len = NODE_DATA_LEN(node);
   num = 0;
 
   num += write_plain_data(data, data_len);
@@ -2423,6 +2952,14 @@ static int write_comment(tree_node_t *comm)
 
   write_whitespace_or_newline_if_needed(4); /* strlen("<!--") */
 
+  if (param_no_reflow) {
+    num += cprintf("%s!--", lt);
+    num += write_verbatim_data(NODE_DATA(comm),
+                               NODE_DATA_LEN(comm));
+    num += cprintf("--%s", gt);
+    return num;
+  }
+
   if (param_pre_comments) {
     num += cprintf("%s!--", lt);
     chars_in_line += 4;
@@ -2451,7 +2988,9 @@ static int write_comment(tree_node_t *comm)
 
 static int write_start_tag(tree_node_t* nodo)
 {
+  att_node_t *atts[att_data_num];
   att_node_t *att;
+  int num_atts, n;
   char limit;
   char *value;
   int num;
@@ -2467,7 +3006,7 @@ static int write_start_tag(tree_node_t* nodo)
   elm_name_len = strlen(elm_name);
   num = 0;
 
-  if (nodo->cont.elemento.hijo)
+  if (NODE_HIJO(nodo))
     num += write_whitespace_or_newline_if_needed(1 + elm_name_len);
   else
     num += write_whitespace_or_newline_if_needed(3 + elm_name_len);
@@ -2476,15 +3015,16 @@ static int write_start_tag(tree_node_t* nodo)
   num += printed;
   chars_in_line += printed;
 
-  for (att= nodo->cont.elemento.attlist; att; att= att->sig)
-    if (att->es_valido) {
+  num_atts = tree_node_get_atts(nodo, atts);
+  for (n = 0; n < num_atts; n++)
+    if ((att = atts[n])->es_valido) {
       value= (char*)tree_index_to_ptr(att->valor);
 
       if (xsearch(value,"\"")) limit= '\'';
       else limit= '\"';
 
       /* does this attribute fit in this line? */
-      if (inline_on 
+      if (inline_on && !param_no_reflow
           && (3 + strlen(att_list[att->att_id].name) 
               + strlen(value) + chars_in_line) > param_chars_per_line) {
         num += write_indent_internal(indent, 1, 1);
@@ -2570,17 +3110,17 @@ static int write_end_tag(tree_node_t* nodo)
   char *elm_name;
   int elm_name_len;
   
-/*   if (!nodo->cont.elemento.hijo) */
+/*   if (!NODE_HIJO(nodo)) */
 /*     return 0; */
 
-  elm_name = elm_list[nodo->cont.elemento.elm_id].name;
+  elm_name = elm_list[nodo->elm_id].name;
   elm_name_len = strlen(elm_name);
   num = 0;
 
   num += write_whitespace_or_newline_if_needed(3 + elm_name_len);
 
   printed = cprintf("%s/%s%s",lt,
-                    elm_list[nodo->cont.elemento.elm_id].name, gt);
+                    elm_list[nodo->elm_id].name, gt);
   num += printed;
   chars_in_line += printed;
 
@@ -2599,7 +3139,7 @@ static int write_whitespace_or_newline_if_needed(int next_data_len)
 {
   int num = 0;
 
-  if (inline_on && whitespace_needed) {
+  if (inline_on && whitespace_needed && !param_no_reflow) {
     /* does the next text fit in this line */
     if ((chars_in_line + next_data_len + 1) > param_chars_per_line) {
       /* write a new line */
@@ -2670,6 +3210,40 @@ static int write_plain_data(xchar* text, int len)
   return num;
 }
 
+/*
+ * Writes text data with no line length accounting at all. Only
+ * the escaping required by XML is applied, and ends of line are
+ * normalized to the selected style. Used when param_no_reflow is set.
+ *
+ */
+static int write_verbatim_data(const xchar* text, int len)
+{
+  int i;
+  int pos;
+
+  for (i = 0, pos = 0; i < len; i++) {
+    if (text[i] == '&' || text[i] == '<' 
+        || text[i] == 0x0a || text[i] == 0x0d) {
+      if (i > pos)
+        cwrite_raw(&text[pos], i - pos);
+      if (text[i] == '&')
+        cwrite_raw(amp, strlen(amp));
+      else if (text[i] == '<')
+        cwrite_raw(lt, strlen(lt));
+      else {
+        cwrite_raw(eol, eol_len);
+        if (text[i] == 0x0d && i + 1 < len && text[i + 1] == 0x0a)
+          i++;
+      }
+      pos = i + 1;
+    }
+  }
+  if (i > pos)
+    cwrite_raw(&text[pos], i - pos);
+
+  return len;
+}
+
 static int write_indent(int len, int new_line)
 {
   return write_indent_internal(len, new_line, 0);
@@ -2679,7 +3253,7 @@ static int write_indent_internal(int len, int new_line, int ignore_xml_space)
 {
   int i;
 
-  if (xml_space_on && !ignore_xml_space) {
+  if ((xml_space_on && !ignore_xml_space) || param_no_reflow) {
     return 0;
   }
 
@@ -2804,6 +3378,33 @@ static int cwrite_single(const char *buf, size_t num)
   return (int) chars_written;
 }
 
+/*
+ * Like cwrite(), but without counting characters (the caller
+ * does not need line length accounting).
+ *
+ */
+static void cwrite_raw(const char *buf, size_t num)
+{
+  size_t to_write;
+
+  while (num > cbuffer_avail) {
+    to_write = cbuffer_avail;
+    /* do not break a UTF-8 character in the middle */
+    while (to_write > 0 && (char)(buf[to_write] & 0xC0) == (char)0x80)
+      to_write--;
+    memcpy(&cbuffer[cbuffer_pos], buf, to_write);
+    cbuffer_pos += to_write;
+    cbuffer_avail -= to_write;
+    buf += to_write;
+    num -= to_write;
+    cflush();
+  }
+
+  memcpy(&cbuffer[cbuffer_pos], buf, num);
+  cbuffer_pos += num;
+  cbuffer_avail -= num;
+}
+
 static int cputc(int c)
 {
   if (cbuffer_avail == 0)
@@ -94,5 +94,12 @@ void saxError(xchar *data);
 int  writeOutput(void);
 void freeMemory(void);
 
+/* internal kernels, exported for the microbenchmarks (kernelbench.c) */
+xchar *check_and_fix_att_value(xchar *value);
+void writeBegin(void);
+int  writePlainData(xchar *text, int len);
+int  writeChardata(tree_node_t *node);
+void writeEnd(void);
+
 #endif
 
@@ -0,0 +1,271 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Jesus Arias Fisteus                             *
+ *   jaf@it.uc3m.es                                                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/*
+ * stats.c
+ * 
+ * Statistics about a conversion (see stats.h).
+ *
+ */
+
+/* included first to define _GNU_SOURCE if necessary */
+#include "xchar.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "stats.h"
+#include "params.h"
+#include "procesador.h"
+#include "tree.h"
+#include "dtd.h"
+#include "htmlgr.h"
+
+#define FIRST_TOKEN TOK_DOCTYPE
+#define NUM_TOKENS  (TOK_WHITESPACE - TOK_DOCTYPE + 1)
+
+static const char *token_names[NUM_TOKENS] = {
+  [TOK_DOCTYPE - FIRST_TOKEN] = "doctype",
+  [TOK_COMMENT - FIRST_TOKEN] = "comment",
+  [TOK_BAD_COMMENT - FIRST_TOKEN] = "bad_comment",
+  [TOK_STAG_INI - FIRST_TOKEN] = "stag_ini",
+  [TOK_ETAG - FIRST_TOKEN] = "etag",
+  [TOK_CDATA - FIRST_TOKEN] = "cdata",
+  [TOK_ATT_NAME - FIRST_TOKEN] = "att_name",
+  [TOK_ATT_NAMECHAR - FIRST_TOKEN] = "att_namechar",
+  [TOK_ATT_VALUE - FIRST_TOKEN] = "att_value",
+  [TOK_EREF - FIRST_TOKEN] = "eref",
+  [TOK_CREF - FIRST_TOKEN] = "cref",
+  [TOK_CDATA_SEC - FIRST_TOKEN] = "cdata_sec",
+  [TOK_XMLPI_INI - FIRST_TOKEN] = "xmlpi_ini",
+  [TOK_STAG_END - FIRST_TOKEN] = "stag_end",
+  [TOK_EMPTYTAG_END - FIRST_TOKEN] = "emptytag_end",
+  [TOK_ATT_EQ - FIRST_TOKEN] = "att_eq",
+  [TOK_XMLPI_END - FIRST_TOKEN] = "xmlpi_end",
+  [TOK_WHITESPACE - FIRST_TOKEN] = "whitespace"
+};
+
+static const char *phase_names[STATS_NUM_PHASES] = {
+  "preload", "parse", "write", "encode"
+};
+
+/* node types, in the order of tree_node_type_t */
+static const char *node_names[] = {
+  "element", "chardata", "cdata_sec", "comment"
+};
+#define NUM_NODE_TYPES (sizeof(node_names) / sizeof(node_names[0]))
+
+/* accumulated time (seconds) and beginning of the current phase */
+static double wall_time[STATS_NUM_PHASES];
+static double cpu_time[STATS_NUM_PHASES];
+static double wall_begin[STATS_NUM_PHASES];
+static double cpu_begin[STATS_NUM_PHASES];
+
+static unsigned long tokens[NUM_TOKENS];
+static unsigned long inserted[elm_data_num];
+static unsigned long discarded = 0;
+static unsigned long renamed_ids = 0;
+static unsigned long iconv_calls = 0;
+static unsigned long regions_reused = 0;
+static unsigned long regions_rescanned = 0;
+static unsigned long long bytes_in = 0;
+static unsigned long long bytes_out = 0;
+
+static double get_time(clockid_t clock);
+static void count_nodes(unsigned long *nodes);
+
+void stats_phase_begin(stats_phase_t phase)
+{
+  if (!param_stats)
+    return;
+
+  wall_begin[phase] = get_time(CLOCK_MONOTONIC);
+  cpu_begin[phase] = get_time(CLOCK_PROCESS_CPUTIME_ID);
+}
+
+void stats_phase_end(stats_phase_t phase)
+{
+  if (!param_stats)
+    return;
+
+  wall_time[phase] += get_time(CLOCK_MONOTONIC) - wall_begin[phase];
+  cpu_time[phase] += get_time(CLOCK_PROCESS_CPUTIME_ID) - cpu_begin[phase];
+}
+
+void stats_count_token(int token)
+{
+  if (token >= FIRST_TOKEN && token - FIRST_TOKEN < NUM_TOKENS)
+    tokens[token - FIRST_TOKEN]++;
+}
+
+void stats_count_inserted(int elm_id)
+{
+  if (elm_id >= 0 && elm_id < elm_data_num)
+    inserted[elm_id]++;
+}
+
+void stats_count_discarded(void)
+{
+  discarded++;
+}
+
+void stats_count_renamed_id(void)
+{
+  renamed_ids++;
+}
+
+void stats_count_iconv(void)
+{
+  iconv_calls++;
+}
+
+void stats_count_region(int reused)
+{
+  if (reused)
+    regions_reused++;
+  else
+    regions_rescanned++;
+}
+
+void stats_add_bytes_in(size_t bytes)
+{
+  bytes_in += bytes;
+}
+
+void stats_add_bytes_out(size_t bytes)
+{
+  bytes_out += bytes;
+}
+
+void stats_report(FILE *out, int json)
+{
+  unsigned long nodes[NUM_NODE_TYPES];
+  double wall, cpu;
+  const char *sep;
+  int i;
+
+  count_nodes(nodes);
+
+  fprintf(out, json ? "{\"time\":{" : "Statistics:\n");
+  for (i = 0; i < STATS_NUM_PHASES; i++) {
+    wall = wall_time[i];
+    cpu = cpu_time[i];
+    if (i == STATS_WRITE) {
+      /* the output encoding is reported separately */
+      wall -= wall_time[STATS_ENCODE];
+      cpu -= cpu_time[STATS_ENCODE];
+    }
+    if (json)
+      fprintf(out, "%s\"%s\":{\"wall\":%.6f,\"cpu\":%.6f}",
+              i ? "," : "", phase_names[i], wall, cpu);
+    else
+      fprintf(out, "  %-22s %.6f s wall, %.6f s cpu\n",
+              phase_names[i], wall, cpu);
+  }
+
+  if (json) {
+    fprintf(out, "},\"bytes_in\":%llu,\"bytes_out\":%llu,\"tokens\":{",
+            bytes_in, bytes_out);
+  } else {
+    fprintf(out, "  %-22s %llu\n", "bytes in", bytes_in);
+    fprintf(out, "  %-22s %llu\n", "bytes out", bytes_out);
+    fprintf(out, "  tokens:\n");
+  }
+  for (i = 0, sep = ""; i < NUM_TOKENS; i++) {
+    if (json) {
+      fprintf(out, "%s\"%s\":%lu", sep, token_names[i], tokens[i]);
+      sep = ",";
+    } else if (tokens[i]) {
+      fprintf(out, "    %-20s %lu\n", token_names[i], tokens[i]);
+    }
+  }
+
+  if (json)
+    fprintf(out, "},\"nodes\":{");
+  else
+    fprintf(out, "  nodes:\n");
+  for (i = 0; i < NUM_NODE_TYPES; i++) {
+    if (json)
+      fprintf(out, "%s\"%s\":%lu", i ? "," : "", node_names[i], nodes[i]);
+    else
+      fprintf(out, "    %-20s %lu\n", node_names[i], nodes[i]);
+  }
+
+  if (json)
+    fprintf(out, "},\"inserted\":{");
+  else
+    fprintf(out, "  inserted elements:\n");
+  for (i = 0, sep = ""; i < elm_data_num; i++) {
+    if (!inserted[i])
+      continue;
+    if (json) {
+      fprintf(out, "%s\"%s\":%lu", sep, elm_list[i].name, inserted[i]);
+      sep = ",";
+    } else {
+      fprintf(out, "    %-20s %lu\n", elm_list[i].name, inserted[i]);
+    }
+  }
+
+  if (json) {
+    fprintf(out, "},\"discarded\":%lu,\"renamed_ids\":%lu,"
+            "\"arena_blocks\":%d,\"iconv_calls\":%lu,"
+            "\"regions\":{\"reused\":%lu,\"rescanned\":%lu}}\n",
+            discarded, renamed_ids, tree_num_blocks(), iconv_calls,
+            regions_reused, regions_rescanned);
+  } else {
+    fprintf(out, "  %-22s %lu\n", "discarded elements", discarded);
+    fprintf(out, "  %-22s %lu\n", "renamed IDs", renamed_ids);
+    fprintf(out, "  %-22s %d\n", "arena blocks", tree_num_blocks());
+    fprintf(out, "  %-22s %lu\n", "iconv calls", iconv_calls);
+    if (regions_reused || regions_rescanned) {
+      fprintf(out, "  %-22s %lu\n", "regions reused", regions_reused);
+      fprintf(out, "  %-22s %lu\n", "regions rescanned", regions_rescanned);
+    }
+  }
+}
+
+static double get_time(clockid_t clock)
+{
+  struct timespec ts;
+
+  if (clock_gettime(clock, &ts))
+    return 0;
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * Counts the nodes of the document tree by type.
+ *
+ */
+static void count_nodes(unsigned long *nodes)
+{
+  tree_node_t *node;
+  int move = NODE_CHILD;
+
+  memset(nodes, 0, NUM_NODE_TYPES * sizeof(unsigned long));
+  node = document ? document->inicio : NULL;
+  while (node) {
+    /* nodes are counted when first visited, not when coming back */
+    if (move != NODE_FATHER && node->tipo < NUM_NODE_TYPES)
+      nodes[node->tipo]++;
+    move = tree_walk(&node, move != NODE_FATHER);
+  }
+}
@@ -0,0 +1,78 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Jesus Arias Fisteus                             *
+ *   jaf@it.uc3m.es                                                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/*
+ * stats.h
+ * 
+ * Statistics about a conversion (--stats option): time spent in
+ * every phase, bytes read and written, tokens, nodes of the
+ * resulting tree and error recovery events.
+ *
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+/* phases of a conversion */
+typedef enum {
+  STATS_PRELOAD,   /* preload and charset detection */
+  STATS_PARSE,     /* tokenization, parsing and repair */
+  STATS_WRITE,     /* serialization of the tree */
+  STATS_ENCODE,    /* conversion into the output charset */
+  STATS_NUM_PHASES
+} stats_phase_t;
+
+/*
+ * Mark the beginning and end of a phase. They do nothing
+ * unless param_stats is set. STATS_ENCODE happens inside
+ * STATS_WRITE, and its time is not counted in the latter.
+ *
+ */
+void stats_phase_begin(stats_phase_t phase);
+void stats_phase_end(stats_phase_t phase);
+
+/* counters */
+void stats_count_token(int token);
+void stats_count_inserted(int elm_id);
+void stats_count_discarded(void);
+void stats_count_renamed_id(void);
+void stats_count_iconv(void);
+
+/*
+ * A region of the input tokenized in parallel with --jobs (see
+ * partok.c): 'reused' is set if the tokens of its child process
+ * were used, or clear if the region had to be tokenized again.
+ *
+ */
+void stats_count_region(int reused);
+void stats_add_bytes_in(size_t bytes);
+void stats_add_bytes_out(size_t bytes);
+
+/*
+ * Writes the report, as text or as a JSON object in
+ * a single line. Must be invoked before the tree is freed.
+ *
+ */
+void stats_report(FILE *out, int json);
+
+#endif
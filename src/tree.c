@@ -49,6 +49,7 @@
 #include "mensajes.h"
 #include "xchar.h"
 #include "tree.h"
+#include "dtd.h"
 
   
 
@@ -64,7 +65,44 @@ static char *data_buffer[NUM_DATA_BUFFERS];
 static int num_buffer, pos_buffer;
 static int active = 0;
 
+/* bloques de nodos, de NODE_BLOCK_SIZE nodos cada uno */
+tree_node_t **tree_node_blocks = NULL;
+static unsigned int num_node_blocks;
+static unsigned int node_blocks_size;
+static node_index_t num_nodes;
+
+/* buffer de texto de los nodos de datos y comentarios */
+char *tree_text_buffer = NULL;
+static size_t text_len;
+static size_t text_size;
+
+/* ltimo nodo creado por tree_link_data_node() */
+static node_index_t ultimo_dato;
+
+/*
+ * bloque de atributos de un elemento: un mapa de bits con los
+ * atributos presentes y los atributos ordenados por att_id, de
+ * forma que la posicin de un atributo en el bloque es el
+ * nmero de bits activos anteriores al suyo en el mapa
+ *
+ */
+#define ATT_MAP_WORDS           TREE_ATT_MAP_WORDS
+#define ATT_BLOCK_MIN           2
+#define ATT_PRESENT(block, id) \
+  ((block)->presentes[(id) >> 5] & (1U << ((id) & 31)))
+
+typedef struct {
+  unsigned int presentes[ATT_MAP_WORDS];
+  unsigned short num;
+  unsigned short capacidad;
+  att_node_t atts[];
+} att_block_t;
+
 static buff_index_t get_data_buffer(int len, const char *data);
+static unsigned int get_text_buffer(int len, const char *data);
+static buff_index_t get_att_block(int capacidad);
+static int att_rank(const att_block_t *block, int att_id);
+static int count_bits(unsigned int word);
 
 
 static void *my_malloc_internal(size_t size);
@@ -95,6 +133,12 @@ void tree_init(void)
     data_buffer[0]= my_malloc_internal(DATA_BUFFER_SIZE);
     num_buffer= 0;
     pos_buffer= 0;
+
+    /* el nodo 0 no se usa: el ndice 0 indica que no hay nodo */
+    num_node_blocks= 0;
+    num_nodes= 1;
+    text_len= 0;
+    ultimo_dato= 0;
     active = 1;
   }
 }
@@ -137,22 +181,44 @@ document_t *new_tree_document(int xhtml_type, int html_vers)
 tree_node_t *new_tree_node(node_type_t tipo)
 {
   tree_node_t *nodo;
+  unsigned int block;
+
+  block= num_nodes >> NODE_BLOCK_BITS;
+  if (block >= num_node_blocks) {
+    /* nuevo bloque de nodos */
+    if (block >= node_blocks_size) {
+      node_blocks_size= node_blocks_size ? 2 * node_blocks_size : 64;
+      if (node_blocks_size > (1U << (32 - NODE_BLOCK_BITS)))
+        EXIT("new_tree_node(), too many nodes");
+      tree_node_blocks= realloc(tree_node_blocks,
+                                node_blocks_size * sizeof(tree_node_t*));
+      if (!tree_node_blocks)
+        EXIT("out of memory");
+    }
+    tree_node_blocks[block]=
+      my_malloc_internal(NODE_BLOCK_SIZE * sizeof(tree_node_t));
+    num_node_blocks++;
+  }
 
-  nodo= tree_malloc(sizeof(tree_node_t));
+  nodo= &tree_node_blocks[block][num_nodes & (NODE_BLOCK_SIZE - 1)];
   nodo->tipo= tipo;
-  nodo->padre= NULL;
-  nodo->sig= NULL;
+  nodo->marcas= 0;
+  nodo->elm_id= 0;
+  nodo->indice= num_nodes++;
+  nodo->padre= 0;
+  nodo->sig= 0;
 
 
   switch (tipo) {
   case Node_comment:
   case Node_chardata:
   case Node_cdata_sec:
-    nodo->cont.chardata.data= -1;
+    nodo->cont.chardata.data= 0;
+    nodo->cont.chardata.data_len= 0;
     break;
   case Node_element:
-    nodo->cont.elemento.attlist= NULL;
-    nodo->cont.elemento.hijo= NULL;
+    nodo->cont.elemento.attlist= -1;
+    nodo->cont.elemento.hijo= 0;
     break;
   }
 
@@ -162,42 +228,58 @@ tree_node_t *new_tree_node(node_type_t tipo)
 
 
 /*
- * enlaza un nuevo nodo de atributos en un nodo de elemento
+ * aade un nuevo atributo a un nodo de elemento
  *
  */
 void tree_set_node_att(tree_node_t *nodo, int att_id, const xchar *value,
                        int is_valid)
 {
-  att_node_t *p, *att;
-
-
-  /* busca dnde insertar el atributo */
-  if (nodo->cont.elemento.attlist) {
-    for (p=nodo->cont.elemento.attlist;
-         p->sig && (p->att_id!=att_id ); 
-         p= p->sig);
-    if (p->sig) {
-      /* atributo repetido: no lo inserta */
-      INFORM("repeated attribute");
-      return;
-    } else {
-      att= (att_node_t*) tree_malloc(sizeof(att_node_t));
-      att->sig= NULL;
-      p->sig= att;
-    }
+  att_block_t *block, *nuevo;
+  att_node_t *att;
+  buff_index_t index;
+  int capacidad, pos;
+
+  block= (att_block_t*) tree_index_to_ptr(nodo->cont.elemento.attlist);
+  if (block && ATT_PRESENT(block, att_id)) {
+    /* atributo repetido: no lo inserta */
+    INFORM("repeated attribute");
+    return;
   }
-  else {
-    att= (att_node_t*) tree_malloc(sizeof(att_node_t));
-    att->sig= NULL;
-    nodo->cont.elemento.attlist= att;
+
+  if (!block || block->num == block->capacidad) {
+    /* bloque lleno: lo copia a otro con el doble de capacidad */
+    capacidad= block ? 2 * block->capacidad : ATT_BLOCK_MIN;
+    if (capacidad > att_data_num) capacidad= att_data_num;
+    index= get_att_block(capacidad);
+    nuevo= (att_block_t*) tree_index_to_ptr(index);
+    if (!nuevo)
+      EXIT("out of memory in tree_set_node_att()");
+    if (block) 
+      memcpy(nuevo, block, 
+             sizeof(att_block_t) + block->num * sizeof(att_node_t));
+    else {
+      memset(nuevo->presentes, 0, sizeof(nuevo->presentes));
+      nuevo->num= 0;
+    }
+    nuevo->capacidad= capacidad;
+    nodo->cont.elemento.attlist= index;
+    block= nuevo;
   }
 
+  /* lo inserta en su posicin, manteniendo el orden por att_id */
+  pos= att_rank(block, att_id);
+  memmove(&block->atts[pos + 1], &block->atts[pos],
+          (block->num - pos) * sizeof(att_node_t));
+  block->presentes[att_id >> 5] |= 1U << (att_id & 31);
+
   /* rellena los campos */
+  att= &block->atts[pos];
   att->att_id= att_id;
   att->es_valido= is_valid;
+  att->orden= block->num++;
   att->valor= get_data_buffer(xstrsize(value), value);
 
-  if (att->valor < 0) WARNING("the attribute value is too big");
+  if (att->valor < 0) WARNING(MSG_ATT_TOO_BIG, "the attribute value is too big");
 }
 
 
@@ -208,44 +290,43 @@ void tree_set_node_att(tree_node_t *nodo, int att_id, const xchar *value,
  */
 void tree_set_node_data(tree_node_t *nodo, const xchar *data, int len_data)
 {
-  if (len_data > DATA_BUFFER_SIZE) 
-    WARNING("the data block is too big");
-
   nodo->cont.chardata.data_len= len_data;
-  nodo->cont.chardata.data= get_data_buffer(len_data, data);
+  nodo->cont.chardata.data= get_text_buffer(len_data, data);
 }
 
 
 /*
- * crea y enlaza uno o ms nodos de datos o comentario consecutivos.
- * si es necesario, se parte el nodo de datos en varios bloques.
- * Todos aquellos nodos con tamao posiblemente superior 
- * al tamao de bloque DATA_BUFFER_SIZE deben ser creados y enlazados
- * mediante esta funcin.
+ * crea y enlaza un nodo de datos o comentario con el texto dado.
+ * El texto se guarda en el buffer de texto, por lo que no es
+ * necesario partirlo en varios nodos, tenga el tamao que tenga.
+ *
+ * Si el ltimo hijo de actual_element es el ltimo nodo de datos
+ * creado, del mismo tipo y su texto es el ltimo del buffer de
+ * texto, el texto se aade a ese nodo en lugar de crear otro.
+ * Los comentarios nunca se unen.
  */
 void tree_link_data_node(node_type_t tipo, tree_node_t *actual_element,
                          const xchar *data, int len_data)
 {
-  int node_size;
-  int saved = 0;
-
-  if (len_data > DATA_BUFFER_SIZE - pos_buffer) {
-    node_size = DATA_BUFFER_SIZE - pos_buffer;
-  } else {
-    node_size = len_data;
+  tree_node_t *node;
+
+  if (len_data <= 0)
+    return;
+
+  node = TREE_NODE(ultimo_dato);
+  if (node && tipo != Node_comment && node->tipo == tipo
+      && node->padre == actual_element->indice && !node->sig
+      && node->cont.chardata.data + node->cont.chardata.data_len
+         == text_len) {
+    get_text_buffer(len_data, data);
+    node->cont.chardata.data_len += len_data;
+    return;
   }
 
-  while (saved < len_data) {
-    tree_node_t *node = new_tree_node(tipo);
-    link_node(node, actual_element, LINK_MODE_CHILD);
-    tree_set_node_data(node, &data[saved], node_size);
-    saved += node_size;
-    if (len_data - saved > DATA_BUFFER_SIZE - pos_buffer) {
-      node_size = DATA_BUFFER_SIZE - pos_buffer;
-    } else {
-      node_size = len_data - saved;
-    }
-  }
+  node = new_tree_node(tipo);
+  link_node(node, actual_element, LINK_MODE_CHILD);
+  tree_set_node_data(node, data, len_data);
+  ultimo_dato = node->indice;
 }
 
 
@@ -276,28 +357,29 @@ void link_node( tree_node_t *nodo, tree_node_t *to, int mode)
 {
   if (mode==LINK_MODE_CHILD) {
 
-    nodo->padre= to;
-    nodo->sig= NULL;
+    nodo->padre= to->indice;
+    nodo->sig= 0;
 
     if (to->cont.elemento.hijo) {
       tree_node_t *p;
 
       /* busca el ltimo hijo */
-      for (p= to->cont.elemento.hijo; p->sig; p= p->sig);
-      p->sig= nodo;
-    } else to->cont.elemento.hijo= nodo;
+      for (p= NODE_HIJO(to); p->sig; p= NODE_SIG(p));
+      p->sig= nodo->indice;
+    } else to->cont.elemento.hijo= nodo->indice;
   }
 
   else if (mode==LINK_MODE_BROTHER) {
     nodo->sig= to->sig;
 
-    to->sig= nodo;
+    to->sig= nodo->indice;
     nodo->padre= to->padre;
   }
 
   else if (mode==LINK_MODE_FIRST_CHILD) {
+    nodo->padre= to->indice;
     nodo->sig= to->cont.elemento.hijo;
-    to->cont.elemento.hijo= nodo;
+    to->cont.elemento.hijo= nodo->indice;
   }
 
 }
@@ -314,18 +396,20 @@ void tree_unlink_node(tree_node_t *node)
 {
   tree_node_t *padre,*hermano;
   
-  if (!(padre= node->padre)) return;
+  if (!(padre= NODE_PADRE(node))) return;
   
-  for (hermano= padre->cont.elemento.hijo; hermano && hermano->sig!=node; 
-       hermano= hermano->sig);
+  for (hermano= NODE_HIJO(padre); hermano && hermano->sig!=node->indice; 
+       hermano= NODE_SIG(hermano));
   
-  if (!hermano && (padre->cont.elemento.hijo!=node))
+  if (!hermano && (padre->cont.elemento.hijo!=node->indice))
     EXIT("error in the structure of the tree");
 
   if (!hermano) padre->cont.elemento.hijo= node->sig;
   else {
     hermano->sig= node->sig;
   }
+
+  if (node->indice == ultimo_dato) ultimo_dato= 0;
 }
 
 
@@ -343,7 +427,7 @@ tree_node_t *tree_search_elm_up(tree_node_t *src, int elm_id)
   tree_node_t *p;
 
   /* busca */
-  for (p=src; (p) && (p->cont.elemento.elm_id!=elm_id); p=p->padre); 
+  for (p=src; (p) && (ELM_ID(p)!=elm_id); p=NODE_PADRE(p)); 
 
   return p;
 }
@@ -360,9 +444,9 @@ tree_node_t *tree_search_elm_child(tree_node_t *padre, int elm_id)
   tree_node_t *p;
 
   /* busca */
-  for (p=padre->cont.elemento.hijo; 
+  for (p=NODE_HIJO(padre); 
        (p) && ((p->tipo!=Node_element) || (ELM_ID(p)!=elm_id)); 
-       p=p->sig); 
+       p=NODE_SIG(p)); 
 
   return p;
 }
@@ -396,19 +480,19 @@ int tree_walk(tree_node_t **src, int allow_child)
   /* si tiene hijos, y (allow_child==1) se va hacia ellos */
   if ((allow_child)&&((*src)->tipo==Node_element)
       &&((*src)->cont.elemento.hijo)) {
-    *src= (*src)->cont.elemento.hijo;
+    *src= NODE_HIJO(*src);
     return NODE_CHILD;
   }
 
   /* si tiene hermanos, se va hacia ellos */
   if ((*src)->sig) {
-    *src= (*src)->sig;
+    *src= NODE_SIG(*src);
     return NODE_BROTHER;
   }
 
   /* si no, al padre */
   if ((*src)->padre) {
-    *src= (*src)->padre;
+    *src= NODE_PADRE(*src);
     return NODE_FATHER;
   }
 
@@ -446,13 +530,39 @@ void *tree_index_to_ptr(buff_index_t index)
  */
 att_node_t *tree_node_search_att(tree_node_t *node, int att_id)
 {
-  att_node_t *p;
+  att_block_t *block;
 
-  for (p= node->cont.elemento.attlist;
-       p && (p->att_id!=att_id); 
-       p= p->sig);
+  block= (att_block_t*) tree_index_to_ptr(node->cont.elemento.attlist);
+  if (!block || att_id < 0 || !ATT_PRESENT(block, att_id))
+    return NULL;
 
-  return p;
+  return &block->atts[att_rank(block, att_id)];
+}
+
+int tree_node_get_atts(tree_node_t *node, att_node_t **atts)
+{
+  att_block_t *block;
+  int i;
+
+  block= (att_block_t*) tree_index_to_ptr(node->cont.elemento.attlist);
+  if (!block) return 0;
+
+  for (i= 0; i < block->num; i++)
+    atts[block->atts[i].orden]= &block->atts[i];
+
+  return block->num;
+}
+
+int tree_node_att_missing(tree_node_t *node, const unsigned int *map)
+{
+  att_block_t *block;
+  int i;
+
+  block= (att_block_t*) tree_index_to_ptr(node->cont.elemento.attlist);
+  for (i= 0; i < ATT_MAP_WORDS; i++)
+    if (map[i] & ~(block ? block->presentes[i] : 0)) return 1;
+
+  return 0;
 }
 
 /*
@@ -508,7 +618,17 @@ char *tree_strdup_n(const char *str, size_t size)
  */
 unsigned int tree_allocated_memory()
 {
-  return num_buffer * DATA_BUFFER_SIZE + pos_buffer;
+  return num_buffer * DATA_BUFFER_SIZE + pos_buffer
+    + num_node_blocks * NODE_BLOCK_SIZE * sizeof(tree_node_t) + text_size;
+}
+
+/*
+ * devuelve el nmero de bloques de memoria reservados
+ *
+ */
+int tree_num_blocks(void)
+{
+  return active ? num_buffer + 1 + num_node_blocks : 0;
 }
 
 
@@ -526,6 +646,13 @@ void tree_free(void)
     for (i = 0; i < num_buffer; i++) {
       free(data_buffer[i]);
     }
+    for (i = 0; i < num_node_blocks; i++) {
+      free(tree_node_blocks[i]);
+    }
+    num_node_blocks = 0;
+    free(tree_text_buffer);
+    tree_text_buffer = NULL;
+    text_size = 0;
     active = 0;
   }
 }
@@ -579,6 +706,78 @@ static buff_index_t get_data_buffer(int len, const char *data)
 
 
 
+/*
+ * aade 'len' bytes de 'data' al buffer de texto y devuelve
+ * su posicin en l. El buffer crece cuando es necesario,
+ * as que los punteros a su contenido (NODE_DATA) dejan
+ * de ser vlidos al aadir texto.
+ *
+ */
+static unsigned int get_text_buffer(int len, const char *data)
+{
+  size_t pos;
+  char *new_buffer;
+
+  if (text_len + len > text_size) {
+    if (!text_size)
+      text_size= DATA_BUFFER_SIZE;
+    while (text_len + len > text_size)
+      text_size*= 2;
+    if (text_size > 0xFFFFFFFFU)
+      EXIT("get_text_buffer(), the document is too big");
+    new_buffer= realloc(tree_text_buffer, text_size);
+    if (!new_buffer)
+      EXIT("out of memory");
+    tree_text_buffer= new_buffer;
+  }
+
+  pos= text_len;
+  if (data) memcpy(tree_text_buffer + pos, data, len);
+  text_len+= len;
+
+  return (unsigned int) pos;
+}
+
+
+/*
+ * reserva en el buffer de datos, alineado a 4 bytes, un
+ * bloque de atributos con espacio para 'capacidad' atributos
+ *
+ */
+static buff_index_t get_att_block(int capacidad)
+{
+  pos_buffer= (pos_buffer + 3) & ~3;
+  return get_data_buffer(sizeof(att_block_t) 
+                         + capacidad * sizeof(att_node_t), NULL);
+}
+
+/*
+ * posicin que ocupa (u ocupara) el atributo att_id en el
+ * bloque: nmero de atributos presentes con att_id menor
+ *
+ */
+static int att_rank(const att_block_t *block, int att_id)
+{
+  int i, rank;
+
+  for (i= 0, rank= 0; i < (att_id >> 5); i++)
+    rank+= count_bits(block->presentes[i]);
+
+  return rank + count_bits(block->presentes[att_id >> 5] 
+                           & ((1U << (att_id & 31)) - 1));
+}
+
+static int count_bits(unsigned int word)
+{
+#ifdef __GNUC__
+  return __builtin_popcount(word);
+#else
+  word= word - ((word >> 1) & 0x55555555U);
+  word= (word & 0x33333333U) + ((word >> 2) & 0x33333333U);
+  return (((word + (word >> 4)) & 0x0F0F0F0FU) * 0x01010101U) >> 24;
+#endif
+}
+
 static void *my_malloc_internal(size_t size)
 {
   void *p;
@@ -37,6 +37,12 @@
  * a una lista enlazada de nodos de atributo, que contienen
  * el identificador y el valor de un atributo. 
  *
+ * Los nodos se guardan en bloques de nodos de tamao fijo
+ * y se enlazan mediante ndices; el texto de los nodos de
+ * datos y comentarios se guarda en un buffer de texto
+ * contiguo. Los nodos y su texto deben leerse mediante
+ * las macros NODE_*.
+ *
  * En este fichero se encuentran las funciones necesarias
  * para acceder a este rbol (prototipos) y todos los
  * tipos de datos que representan los nodos del rbol.
@@ -53,17 +59,28 @@
 
 typedef int buff_index_t;
 
+/*
+ * los nodos se enlazan mediante ndices de 32 bits en los
+ * bloques de nodos (ver TREE_NODE), en lugar de punteros,
+ * para que ocupen la mitad de memoria. El ndice 0 indica
+ * que no hay nodo.
+ *
+ */
+typedef unsigned int node_index_t;
+
 
 
 /*
- * un nodo para la lista de
- *  atributos de un elemento
+ * un atributo de un elemento. Los atributos de cada elemento
+ * se guardan juntos, ordenados por att_id; 'orden' es la
+ * posicin del atributo en el documento, que es la que se
+ * respeta al escribirlos (ver tree_node_get_atts)
  *
  */ 
 struct att_node_{
-  int att_id;
-  int es_valido;
-  struct att_node_ *sig;
+  short att_id;
+  unsigned char es_valido;
+  unsigned char orden;
   buff_index_t valor;
 };
 
@@ -78,9 +95,8 @@ typedef struct att_node_ att_node_t;
  *
  */
 typedef struct {
-  int elm_id;
-  att_node_t *attlist;
-  struct tree_node_ *hijo;
+  node_index_t hijo;
+  buff_index_t attlist;     /* bloque de atributos, o -1 si no tiene */
 } node_element_t;
 
 
@@ -89,13 +105,13 @@ typedef struct {
 
 /*
  * datos especficos para datos 
- * de caracteres en tree_node_t
+ * de caracteres en tree_node_t: el texto est en el
+ * buffer de texto, a partir de la posicin 'data'
  *
  */
 typedef struct {
   int data_len;
-  int is_cdata_sec;
-  buff_index_t data;
+  unsigned int data;
 } node_chardata_t;
 
 
@@ -118,9 +134,12 @@ typedef enum {
  */
 struct tree_node_{
 
-  node_type_t tipo;
-  struct tree_node_ *padre;
-  struct tree_node_ *sig;   /* siguiente hermano */
+  unsigned char tipo;       /* node_type_t */
+  unsigned char marcas;     /* para uso del procesador */
+  short elm_id;             /* slo en nodos de elemento */
+  node_index_t indice;      /* ndice de este nodo */
+  node_index_t padre;
+  node_index_t sig;         /* siguiente hermano */
 
   union {
     node_element_t elemento;
@@ -130,6 +149,25 @@ struct tree_node_{
 
 typedef struct tree_node_ tree_node_t;
 
+/* bloques de nodos (uso interno de las macros de acceso) */
+#define NODE_BLOCK_BITS 12
+#define NODE_BLOCK_SIZE (1 << NODE_BLOCK_BITS)
+extern tree_node_t **tree_node_blocks;
+extern char *tree_text_buffer;
+
+/*
+ * acceso a los nodos enlazados y a los datos de un nodo
+ *
+ */
+#define TREE_NODE(index) \
+  ((index) ? &tree_node_blocks[(index) >> NODE_BLOCK_BITS] \
+                              [(index) & (NODE_BLOCK_SIZE - 1)] : NULL)
+#define NODE_PADRE(node)    TREE_NODE((node)->padre)
+#define NODE_SIG(node)      TREE_NODE((node)->sig)
+#define NODE_HIJO(node)     TREE_NODE((node)->cont.elemento.hijo)
+#define NODE_DATA(node)     (tree_text_buffer + (node)->cont.chardata.data)
+#define NODE_DATA_LEN(node) ((node)->cont.chardata.data_len)
+
 
 
 
@@ -223,11 +261,9 @@ void link_root_node(document_t *doc, tree_node_t *nodo);
 void link_node( tree_node_t *nodo, tree_node_t *to, int mode);
 
 /*
- * crea y enlaza uno o ms nodos de datos o comentario consecutivos.
- * si es necesario, se parte el nodo de datos en varios bloques.
- * Todos aquellos nodos con tamao posiblemente superior 
- * al tamao de bloque DATA_BUFFER_SIZE deben ser creados y enlazados
- * mediante esta funcin.
+ * crea y enlaza un nodo de datos o comentario como ltimo hijo
+ * de actual_element. Los datos consecutivos del mismo tipo
+ * (salvo comentarios) se unen en un solo nodo.
  */
 void tree_link_data_node(node_type_t tipo, tree_node_t *actual_element,
                          const xchar *data, int len_data);
@@ -309,7 +345,7 @@ int tree_walk(tree_node_t **src, int allow_child);
 void *tree_index_to_ptr(buff_index_t index);
 
 /*
- * busca en la lista de atributos de un nodo de elemento
+ * busca en los atributos de un nodo de elemento
  * aquel cuyo id sea att_id
  *
  * devuelve un puntero al nodo o NULL si no se encuentra
@@ -317,6 +353,32 @@ void *tree_index_to_ptr(buff_index_t index);
  */
 att_node_t *tree_node_search_att(tree_node_t *node, int att_id);
 
+/*
+ * deja en 'atts' los atributos de un nodo de elemento en el
+ * orden en que se aadieron; 'atts' debe tener espacio para
+ * att_data_num punteros
+ *
+ * devuelve el nmero de atributos
+ *
+ */
+int tree_node_get_atts(tree_node_t *node, att_node_t **atts);
+
+/*
+ * mapas de bits de att_id, como el de los atributos presentes
+ * en un nodo de elemento (requiere dtd.h)
+ *
+ */
+#define TREE_ATT_MAP_WORDS ((att_data_num + 31) / 32)
+
+/*
+ * comprueba si al nodo de elemento le falta alguno de los
+ * atributos del mapa 'map' (de TREE_ATT_MAP_WORDS palabras)
+ *
+ * devuelve 1 si falta alguno o 0 si estn todos
+ *
+ */
+int tree_node_att_missing(tree_node_t *node, const unsigned int *map);
+
 /*
  * Sustituto para malloc(size_t size)
  *
@@ -346,6 +408,13 @@ char *tree_strdup_n(const char *str, size_t size);
  */
 unsigned int tree_allocated_memory();
 
+/*
+ * devuelve el nmero de bloques de memoria reservados
+ * (returns the number of memory blocks in use)
+ *
+ */
+int tree_num_blocks(void);
+
 /*
  * libera la memoria reservada
  *
@@ -357,8 +426,8 @@ void tree_free(void);
  *
  */
 
-#define ELM_ID(tree_node)     (tree_node->cont.elemento.elm_id)
-#define ELM_PTR(tree_node)    (elm_list[tree_node->cont.elemento.elm_id])
+#define ELM_ID(tree_node)     ((tree_node)->elm_id)
+#define ELM_PTR(tree_node)    (elm_list[(tree_node)->elm_id])
 
 #define ATT_PTR(att_node)     (att_list[att_node]->att_id])
 
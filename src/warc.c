@@ -0,0 +1,576 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Jesus Arias Fisteus                             *
+ *   jaf@it.uc3m.es                                                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/*
+ * warc.c
+ *
+ * Reading and writing of WARC files (see warc.h)
+ *
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <errno.h>
+
+#include "warc.h"
+#include "compress.h"
+#include "mensajes.h"
+
+#define WARC_RAW_SIZE 65536
+#define WARC_MAX_LINE 65536
+
+struct warc_reader {
+  FILE *file;
+  compress_stream_t *z;        /* NULL if the file is not compressed */
+  int z_ended;
+  int z_pending;
+  char raw[WARC_RAW_SIZE];     /* data read from the file, if compressed */
+  const char *raw_pos;
+  size_t raw_avail;
+  char *buf;                   /* decompressed data */
+  size_t buf_size;
+  size_t buf_len;
+  size_t buf_pos;
+  char *block;
+  size_t block_size;
+};
+
+static size_t read_raw(warc_reader_t *r, char *buf, size_t max);
+static size_t fill(warc_reader_t *r);
+static char *read_line(warc_reader_t *r, size_t *len);
+static int read_bytes(warc_reader_t *r, char *dst, size_t n);
+static void set_field(char *field, size_t size, const char *value);
+static const char *header_value(const char *line, const char *name);
+static const char *http_line(char **pos, char *end, size_t *len);
+static size_t dechunk(char *body, size_t len);
+static void record_uuid(const warc_record_t *source, const char *data,
+                        size_t len, char *uuid);
+static void write_record(FILE *output, const char *data, size_t len,
+                         compress_stream_t *z);
+
+warc_reader_t *warc_open(FILE *file)
+{
+  warc_reader_t *r;
+  int format;
+
+  r = malloc(sizeof(warc_reader_t));
+  if (!r)
+    EXIT("Not enough memory to read the WARC file");
+  r->file = file;
+  r->z = NULL;
+  r->buf_size = WARC_RAW_SIZE;
+  r->buf = malloc(r->buf_size);
+  r->buf_len = 0;
+  r->buf_pos = 0;
+  r->block = NULL;
+  r->block_size = 0;
+  if (!r->buf)
+    EXIT("Not enough memory to read the WARC file");
+
+  r->raw_avail = read_raw(r, r->raw, sizeof(r->raw));
+  r->raw_pos = r->raw;
+  format = compress_detect(r->raw, r->raw_avail);
+  if (format == COMPRESS_NONE) {
+    memcpy(r->buf, r->raw, r->raw_avail);
+    r->buf_len = r->raw_avail;
+    r->raw_avail = 0;
+  } else {
+    r->z = compress_new_decoder(format);
+    r->z_ended = 0;
+    r->z_pending = 0;
+  }
+
+  return r;
+}
+
+int warc_next(warc_reader_t *r, warc_record_t *record)
+{
+  char *line;
+  size_t len;
+  const char *value;
+  long long content_length = -1;
+  int read_block;
+
+  /* version line, after the empty lines that end the previous record */
+  do {
+    line = read_line(r, &len);
+    if (!line)
+      return 0;
+  } while (len == 0);
+  if (strncmp(line, "WARC/", 5))
+    EXIT("The input is not a WARC file");
+
+  record->type[0] = 0;
+  record->record_id[0] = 0;
+  record->date[0] = 0;
+  record->content_type[0] = 0;
+  record->target_uri[0] = 0;
+  record->block = NULL;
+  record->block_len = 0;
+
+  /* header fields, up to an empty line */
+  while ((line = read_line(r, &len)) && len > 0) {
+    if ((value = header_value(line, "WARC-Type")))
+      set_field(record->type, sizeof(record->type), value);
+    else if ((value = header_value(line, "WARC-Record-ID")))
+      set_field(record->record_id, sizeof(record->record_id), value);
+    else if ((value = header_value(line, "WARC-Date")))
+      set_field(record->date, sizeof(record->date), value);
+    else if ((value = header_value(line, "Content-Type")))
+      set_field(record->content_type, sizeof(record->content_type), value);
+    else if ((value = header_value(line, "WARC-Target-URI")))
+      set_field(record->target_uri, sizeof(record->target_uri), value);
+    else if ((value = header_value(line, "Content-Length")))
+      content_length = strtoll(value, NULL, 10);
+  }
+  if (!line) {
+    WARNING(MSG_DISCARDED_BYTES, "The WARC file is truncated");
+    return 0;
+  }
+  if (content_length < 0)
+    EXIT("WARC record without a valid Content-Length");
+
+  /* the block: only that of responses is needed */
+  read_block = !strcasecmp(record->type, "response");
+  if (read_block && (size_t) content_length + 1 > r->block_size) {
+    free(r->block);
+    r->block_size = (size_t) content_length + 1;
+    r->block = malloc(r->block_size);
+    if (!r->block)
+      EXIT("Not enough memory to read the WARC record");
+  }
+  if (!read_bytes(r, read_block ? r->block : NULL, (size_t) content_length)) {
+    WARNING(MSG_DISCARDED_BYTES, "The WARC file is truncated");
+    return 0;
+  }
+  if (read_block) {
+    r->block[content_length] = 0;
+    record->block = r->block;
+    record->block_len = (size_t) content_length;
+  }
+
+  return 1;
+}
+
+void warc_close(warc_reader_t *r)
+{
+  if (r->z)
+    compress_free(r->z);
+  free(r->buf);
+  free(r->block);
+  free(r);
+}
+
+int warc_html_response(warc_record_t *record, char **body, size_t *len,
+                       char *charset, size_t charset_size)
+{
+  char *pos = record->block;
+  char *end;
+  const char *line;
+  const char *value;
+  const char *param;
+  size_t line_len;
+  size_t i;
+  int is_html = 0;
+  int chunked = 0;
+
+  if (!record->block || strcasecmp(record->type, "response")
+      || strncasecmp(record->content_type, "application/http", 16))
+    return 0;
+  end = record->block + record->block_len;
+
+  /* status line and header fields of the HTTP response */
+  line = http_line(&pos, end, &line_len);
+  if (!line || strncmp(line, "HTTP/", 5))
+    return 0;
+  charset[0] = 0;
+  while ((line = http_line(&pos, end, &line_len)) && line_len > 0) {
+    if ((value = header_value(line, "Content-Type"))) {
+      is_html = !strncasecmp(value, "text/html", 9)
+        && (!value[9] || value[9] == ';' || isspace((unsigned char) value[9]));
+      for (param = strchr(value, ';'); param; param = strchr(param + 1, ';')) {
+        while (*++param == ' ' || *param == '\t')
+          ;
+        if (strncasecmp(param, "charset=", 8))
+          continue;
+        param += 8;
+        if (*param == '"')
+          param++;
+        for (i = 0; i < charset_size - 1 && param[i] && param[i] != '"'
+               && param[i] != ';' && !isspace((unsigned char) param[i]); i++)
+          charset[i] = param[i];
+        charset[i] = 0;
+      }
+    } else if ((value = header_value(line, "Transfer-Encoding"))) {
+      chunked = strstr(value, "chunked") != NULL;
+    }
+  }
+  if (!line || !is_html)
+    return 0;
+
+  /* the body; Content-Encoding is detected when it is converted */
+  *body = pos;
+  *len = end - pos;
+  if (chunked)
+    *len = dechunk(pos, *len);
+
+  return 1;
+}
+
+void warc_write_conversion(FILE *output, const warc_record_t *source,
+                           const char *content_type, const char *date,
+                           const char *data, size_t len,
+                           int compress, int level)
+{
+  compress_stream_t *z = NULL;
+  char header[WARC_URI_SIZE + 4 * WARC_FIELD_SIZE + 256];
+  char uuid[37];
+  int n;
+
+  record_uuid(source, data, len, uuid);
+  n = snprintf(header, sizeof(header),
+               "WARC/1.0\r\n"
+               "WARC-Type: conversion\r\n"
+               "WARC-Record-ID: <urn:uuid:%s>\r\n"
+               "%s%s%s"
+               "%s%s%s"
+               "WARC-Date: %s\r\n"
+               "Content-Type: %s\r\n"
+               "Content-Length: %lu\r\n"
+               "\r\n",
+               uuid,
+               source->record_id[0] ? "WARC-Refers-To: " : "",
+               source->record_id,
+               source->record_id[0] ? "\r\n" : "",
+               source->target_uri[0] ? "WARC-Target-URI: " : "",
+               source->target_uri,
+               source->target_uri[0] ? "\r\n" : "",
+               date, content_type, (unsigned long) len);
+  if (n < 0 || (size_t) n >= sizeof(header))
+    EXIT("WARC record header too long");
+
+  if (compress != COMPRESS_NONE)
+    z = compress_new_encoder(compress, level);
+  write_record(output, header, n, z);
+  write_record(output, data, len, z);
+  write_record(output, "\r\n\r\n", 4, z);
+  if (z) {
+    write_record(output, NULL, 0, z);
+    compress_free(z);
+  }
+}
+
+/*
+ * Reads at most 'max' bytes of the file. Returns 0 at its end.
+ */
+static size_t read_raw(warc_reader_t *r, char *buf, size_t max)
+{
+  size_t n;
+
+  while (!(n = fread(buf, 1, max, r->file)) && ferror(r->file)) {
+    if (errno != EINTR) {
+      perror("read");
+      EXIT("Error reading the WARC file");
+    }
+    clearerr(r->file);
+  }
+
+  return n;
+}
+
+/*
+ * Appends more (decompressed) data to the buffer of the reader,
+ * growing it if it is full. Returns the number of bytes appended,
+ * or 0 at the end of the file.
+ */
+static size_t fill(warc_reader_t *r)
+{
+  char *out;
+  size_t out_len;
+  size_t n;
+
+  if (r->buf_pos > 0) {
+    memmove(r->buf, r->buf + r->buf_pos, r->buf_len - r->buf_pos);
+    r->buf_len -= r->buf_pos;
+    r->buf_pos = 0;
+  }
+  if (r->buf_len + 1 >= r->buf_size) {
+    r->buf_size *= 2;
+    r->buf = realloc(r->buf, r->buf_size);
+    if (!r->buf)
+      EXIT("Not enough memory to read the WARC file");
+  }
+
+  if (!r->z) {
+    n = read_raw(r, r->buf + r->buf_len, r->buf_size - r->buf_len - 1);
+    r->buf_len += n;
+    return n;
+  }
+
+  /* a byte is left for the 0 that read_line() puts after a line */
+  out = r->buf + r->buf_len;
+  out_len = r->buf_size - r->buf_len - 1;
+  while (out == r->buf + r->buf_len && out_len > 0) {
+    if (r->z_ended && r->raw_avail < 4) {
+      /* the next record may begin at the end of the buffer: its
+         magic number is needed in order to detect it */
+      memmove(r->raw, r->raw_pos, r->raw_avail);
+      r->raw_pos = r->raw;
+      n = read_raw(r, r->raw + r->raw_avail, sizeof(r->raw) - r->raw_avail);
+      r->raw_avail += n;
+      if (!r->raw_avail)
+        break;
+    } else if (!r->raw_avail && !r->z_pending) {
+      r->raw_avail = read_raw(r, r->raw, sizeof(r->raw));
+      r->raw_pos = r->raw;
+      if (!r->raw_avail) {
+        WARNING(MSG_DISCARDED_BYTES, "The compressed WARC file is truncated");
+        break;
+      }
+    }
+    if (r->z_ended && compress_detect(r->raw_pos, r->raw_avail)
+        == COMPRESS_NONE) {
+      WARNING(MSG_DISCARDED_BYTES,
+              "Some bytes discarded after the compressed WARC file");
+      r->raw_avail = 0;
+      continue;
+    }
+    r->z_ended = compress_run(r->z, &r->raw_pos, &r->raw_avail,
+                              &out, &out_len, 0);
+    r->z_pending = !out_len;
+  }
+
+  n = out - (r->buf + r->buf_len);
+  r->buf_len += n;
+  return n;
+}
+
+/*
+ * Reads a line, and returns it without its end of line and ended
+ * by 0, or NULL at the end of the file. The line is valid until
+ * the next read.
+ */
+static char *read_line(warc_reader_t *r, size_t *len)
+{
+  char *line;
+  char *eol;
+  size_t scanned = 0;
+
+  while (!(eol = memchr(r->buf + r->buf_pos + scanned, '\n',
+                        r->buf_len - r->buf_pos - scanned))) {
+    scanned = r->buf_len - r->buf_pos;
+    if (scanned > WARC_MAX_LINE)
+      EXIT("Line too long in the WARC file");
+    if (!fill(r)) {
+      if (!scanned)
+        return NULL;
+      /* last line without end of line */
+      eol = r->buf + r->buf_len;
+      break;
+    }
+  }
+
+  line = r->buf + r->buf_pos;
+  r->buf_pos = eol - r->buf + (eol < r->buf + r->buf_len);
+  if (eol > line && eol[-1] == '\r')
+    eol--;
+  *eol = 0;
+  *len = eol - line;
+  return line;
+}
+
+/*
+ * Reads 'n' bytes into 'dst', or skips them if it is NULL.
+ * Returns 0 if the file ends before.
+ */
+static int read_bytes(warc_reader_t *r, char *dst, size_t n)
+{
+  size_t m;
+
+  while (n > 0) {
+    if (r->buf_pos == r->buf_len) {
+      r->buf_pos = r->buf_len = 0;
+      if (!fill(r))
+        return 0;
+    }
+    m = r->buf_len - r->buf_pos;
+    if (m > n)
+      m = n;
+    if (dst) {
+      memcpy(dst, r->buf + r->buf_pos, m);
+      dst += m;
+    }
+    r->buf_pos += m;
+    n -= m;
+  }
+
+  return 1;
+}
+
+static void set_field(char *field, size_t size, const char *value)
+{
+  size_t len = strlen(value);
+
+  while (len > 0 && isspace((unsigned char) value[len - 1]))
+    len--;
+  if (len >= size)
+    len = size - 1;
+  memcpy(field, value, len);
+  field[len] = 0;
+}
+
+/*
+ * If 'line' is the header field 'name' (case insensitive), returns
+ * its value without the leading spaces, or NULL otherwise.
+ */
+static const char *header_value(const char *line, const char *name)
+{
+  size_t len = strlen(name);
+
+  if (strncasecmp(line, name, len) || line[len] != ':')
+    return NULL;
+  line += len + 1;
+  while (*line == ' ' || *line == '\t')
+    line++;
+  return line;
+}
+
+/*
+ * Returns the line of the HTTP message that begins at '*pos',
+ * ended by 0 instead of its end of line, and moves '*pos' to the
+ * next one. Returns NULL if there is no complete line before 'end'.
+ */
+static const char *http_line(char **pos, char *end, size_t *len)
+{
+  char *line = *pos;
+  char *eol = memchr(line, '\n', end - line);
+
+  if (!eol)
+    return NULL;
+  *pos = eol + 1;
+  if (eol > line && eol[-1] == '\r')
+    eol--;
+  *eol = 0;
+  *len = eol - line;
+  return line;
+}
+
+/*
+ * Decodes in place the chunked transfer encoding of the 'len' bytes
+ * of 'body'. Returns the length of the decoded body; if the body is
+ * truncated, what was decoded up to there.
+ */
+static size_t dechunk(char *body, size_t len)
+{
+  char *in = body;
+  char *end = body + len;
+  char *out = body;
+  char *eol;
+  unsigned long size;
+
+  while (in < end && (eol = memchr(in, '\n', end - in))) {
+    size = strtoul(in, NULL, 16);
+    in = eol + 1;
+    if (size == 0)
+      break;
+    if (size > (unsigned long) (end - in)) {
+      WARNING(MSG_DISCARDED_BYTES, "Truncated chunk in an HTTP response");
+      size = end - in;
+    }
+    memmove(out, in, size);
+    out += size;
+    in += size;
+    /* end of line after the chunk */
+    if (in < end && *in == '\r')
+      in++;
+    if (in < end && *in == '\n')
+      in++;
+  }
+
+  return out - body;
+}
+
+/*
+ * Sets 'uuid' to an identifier of the conversion of 'source' into
+ * 'data': a version 8 UUID, derived from both with 64 bit FNV-1a
+ * hashes, so that converting the same archive again gives the same
+ * identifiers.
+ */
+static void record_uuid(const warc_record_t *source, const char *data,
+                        size_t len, char *uuid)
+{
+  unsigned long long h[2] = {14695981039346656037ULL, 0x6a09e667f3bcc908ULL};
+  unsigned char b[16];
+  const char *id = source->record_id[0] ? source->record_id
+    : source->target_uri;
+  size_t i;
+  int j;
+
+  for (j = 0; j < 2; j++) {
+    for (i = 0; id[i]; i++)
+      h[j] = (h[j] ^ (unsigned char) id[i]) * 1099511628211ULL;
+    for (i = 0; i < len; i++)
+      h[j] = (h[j] ^ (unsigned char) data[i]) * 1099511628211ULL;
+  }
+  for (i = 0; i < 16; i++)
+    b[i] = (unsigned char) (h[i / 8] >> (8 * (i % 8)));
+  b[6] = (b[6] & 0x0f) | 0x80;
+  b[8] = (b[8] & 0x3f) | 0x80;
+
+  for (i = 0, j = 0; i < 16; i++) {
+    if (i == 4 || i == 6 || i == 8 || i == 10)
+      uuid[j++] = '-';
+    sprintf(uuid + j, "%02x", b[i]);
+    j += 2;
+  }
+}
+
+/*
+ * Writes 'data' to 'output', compressed with 'z' if it is not NULL.
+ * With 'data' NULL, finishes the compressed stream.
+ */
+static void write_record(FILE *output, const char *data, size_t len,
+                         compress_stream_t *z)
+{
+  char out[WARC_RAW_SIZE];
+  char *pos;
+  size_t out_len;
+  int end = data == NULL;
+  int done;
+
+  if (!z) {
+    if (len > 0 && fwrite(data, 1, len, output) != len)
+      EXIT("Error writing the WARC file");
+    return;
+  }
+
+  do {
+    pos = out;
+    out_len = sizeof(out);
+    done = compress_run(z, &data, &len, &pos, &out_len, end);
+    if (pos > out && fwrite(out, 1, pos - out, output) != (size_t) (pos - out))
+      EXIT("Error writing the WARC file");
+  } while (end ? !done : len > 0 || !out_len);
+}
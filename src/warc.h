@@ -0,0 +1,97 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Jesus Arias Fisteus                             *
+ *   jaf@it.uc3m.es                                                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/*
+ * warc.h
+ *
+ * Reading and writing of web archives in the WARC format
+ * (ISO 28500), for the batch conversion of the HTML documents that
+ * they contain (see the --warc option of html2xhtml). The reader
+ * returns the records of a WARC file, which may be compressed
+ * record by record with gzip or zstd (see compress.h); the writer
+ * writes the conversion records of the output.
+ *
+ */
+
+#ifndef WARC_H
+#define WARC_H
+
+#include <stdio.h>
+
+#define WARC_FIELD_SIZE 256
+#define WARC_URI_SIZE 4096
+
+typedef struct warc_reader warc_reader_t;
+
+/*
+ * A record: some of its header fields and its block
+ */
+typedef struct {
+  char type[WARC_FIELD_SIZE];          /* WARC-Type */
+  char record_id[WARC_FIELD_SIZE];     /* WARC-Record-ID */
+  char date[WARC_FIELD_SIZE];          /* WARC-Date */
+  char content_type[WARC_FIELD_SIZE];  /* Content-Type */
+  char target_uri[WARC_URI_SIZE];      /* WARC-Target-URI */
+  char *block;                         /* NULL if not read */
+  size_t block_len;
+} warc_record_t;
+
+/*
+ * Starts reading the WARC file 'file', whose compression is detected
+ */
+warc_reader_t *warc_open(FILE *file);
+
+/*
+ * Reads the next record into 'record'. Only the blocks of
+ * "response" records are read: the others are skipped. The block
+ * belongs to the reader and is valid until the next call.
+ * Returns 1, or 0 at the end of the file.
+ */
+int warc_next(warc_reader_t *r, warc_record_t *record);
+
+/*
+ * Frees the reader (the file is not closed)
+ */
+void warc_close(warc_reader_t *r);
+
+/*
+ * Checks whether 'record' is the HTTP response of an HTML document
+ * (Content-Type "text/html"). If so, sets 'body' and 'len' to the
+ * body of the response, decoding the chunked transfer encoding in
+ * place, and 'charset' to the charset parameter of its
+ * Content-Type, or to "" if it has none. Returns 1, or 0 if it is
+ * another kind of record.
+ */
+int warc_html_response(warc_record_t *record, char **body, size_t *len,
+                       char *charset, size_t charset_size);
+
+/*
+ * Writes to 'output' a "conversion" record of the 'source' record,
+ * whose content is the 'len' bytes of 'data', of type
+ * 'content_type', converted at 'date'. With 'compress' (see
+ * compress.h), the record is compressed on its own, as usual in
+ * WARC files.
+ */
+void warc_write_conversion(FILE *output, const warc_record_t *source,
+                           const char *content_type, const char *date,
+                           const char *data, size_t len,
+                           int compress, int level);
+
+#endif
@@ -0,0 +1,341 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Jesus Arias Fisteus                             *
+ *   jaf@it.uc3m.es                                                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/*
+ * test_binary.c
+ * 
+ * Round trip of the binary output (--binary, see h2xbin.h): some
+ * documents are converted into the binary format and read back
+ * with the reader of h2xbin.h. The records must describe the same
+ * document that the event API (h2x.h) delivers, and the reader
+ * must reject truncated data.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "h2x.h"
+#include "h2xbin.h"
+#include "params.h"
+#include "dtd_util.h"
+#include "mensajes.h"
+
+/* a description of a document, one line per event or record */
+typedef struct {
+  char *text;
+  size_t len;
+  size_t size;
+} desc_t;
+
+static int failures;
+
+static void add(desc_t *d, const char *text, size_t len)
+{
+  if (d->len + len + 1 > d->size) {
+    while (d->len + len + 1 > d->size)
+      d->size = d->size ? 2 * d->size : 4096;
+    d->text = realloc(d->text, d->size);
+    if (!d->text) {
+      fprintf(stderr, "out of memory\n");
+      exit(1);
+    }
+  }
+  memcpy(d->text + d->len, text, len);
+  d->len += len;
+  d->text[d->len] = 0;
+}
+
+static void add_str(desc_t *d, const char *str)
+{
+  add(d, str, strlen(str));
+}
+
+/* callbacks of the event API */
+
+static void on_start_document(void *user_data, const char *doctype_key)
+{
+  add_str(user_data, "doctype ");
+  add_str(user_data, doctype_key);
+  add_str(user_data, "\n");
+}
+
+static void on_start_element(void *user_data, int elm_id, const char *name,
+                             const h2x_att_t *atts, int num_atts)
+{
+  int i;
+
+  add_str(user_data, "start ");
+  add_str(user_data, name);
+  for (i = 0; i < num_atts; i++) {
+    add_str(user_data, " ");
+    add_str(user_data, atts[i].name);
+    add_str(user_data, "=[");
+    add_str(user_data, atts[i].value);
+    add_str(user_data, "]");
+  }
+  add_str(user_data, "\n");
+}
+
+static void on_end_element(void *user_data, int elm_id, const char *name)
+{
+  add_str(user_data, "end ");
+  add_str(user_data, name);
+  add_str(user_data, "\n");
+}
+
+static void add_text(desc_t *d, const char *kind, const char *text,
+                     size_t len)
+{
+  add_str(d, kind);
+  add_str(d, " [");
+  add(d, text, len);
+  add_str(d, "]\n");
+}
+
+static void on_characters(void *user_data, const char *text, size_t len)
+{
+  add_text(user_data, "text", text, len);
+}
+
+static void on_cdata_section(void *user_data, const char *text, size_t len)
+{
+  add_text(user_data, "cdata", text, len);
+}
+
+static void on_comment(void *user_data, const char *text, size_t len)
+{
+  add_text(user_data, "comment", text, len);
+}
+
+static void on_end_document(void *user_data)
+{
+  add_str(user_data, "end_document\n");
+}
+
+static const h2x_handler_t handler = {
+  on_start_document,
+  on_start_element,
+  on_end_element,
+  on_characters,
+  on_cdata_section,
+  on_comment,
+  on_end_document
+};
+
+/*
+ * Converts 'input' into the binary format, or delivers its events
+ * to 'd' if 'events' is set. Returns the binary output, which is
+ * valid until the next conversion, and sets 'len' to its length.
+ *
+ */
+static const char *convert(const char *input, int events, desc_t *d,
+                           size_t *len)
+{
+  h2x_ctx_t *ctx;
+  const char *output = NULL;
+
+  params_set_defaults();
+  param_doctype = dtd_get_dtd_index("transitional");
+  param_binary_output = !events;
+
+  ctx = h2x_new(NULL);
+  if (!ctx) {
+    fprintf(stderr, "h2x_new() failed\n");
+    exit(1);
+  }
+  if (events)
+    h2x_set_handler(ctx, &handler, d);
+  if (h2x_convert(ctx, input, strlen(input))) {
+    fprintf(stderr, "h2x_convert() failed\n");
+    exit(1);
+  }
+  if (!events)
+    output = h2x_output(ctx, len);
+  h2x_free(ctx);
+
+  return output;
+}
+
+/*
+ * Reads the binary document and describes its records in 'd'.
+ * Returns 0, or -1 if the reader finds an error.
+ *
+ */
+static int read_binary(const char *data, size_t len, desc_t *d)
+{
+  h2xbin_reader_t r;
+  h2xbin_record_t rec;
+  h2xbin_att_t att;
+  const char *name;
+  size_t name_len;
+  int result;
+
+  if (h2xbin_open(&r, data, len) < 0)
+    return -1;
+  add_str(d, "doctype ");
+  add(d, r.doctype, r.doctype_len);
+  add_str(d, "\n");
+
+  while ((result = h2xbin_next(&r, &rec)) > 0) {
+    switch (rec.kind) {
+    case H2XBIN_START_ELEMENT:
+    case H2XBIN_END_ELEMENT:
+      name = h2xbin_elm_name(&r, rec.id, &name_len);
+      if (!name)
+        return -1;
+      add_str(d, rec.kind == H2XBIN_START_ELEMENT ? "start " : "end ");
+      add(d, name, name_len);
+      while (rec.kind == H2XBIN_START_ELEMENT
+             && h2xbin_next_att(&rec, &att) > 0) {
+        name = h2xbin_att_name(&r, att.id, &name_len);
+        if (!name)
+          return -1;
+        add_str(d, " ");
+        add(d, name, name_len);
+        add_str(d, "=[");
+        add(d, att.value, att.len);
+        add_str(d, "]");
+      }
+      add_str(d, "\n");
+      break;
+    case H2XBIN_TEXT:
+      add_text(d, "text", rec.text, rec.len);
+      break;
+    case H2XBIN_CDATA:
+      add_text(d, "cdata", rec.text, rec.len);
+      break;
+    case H2XBIN_COMMENT:
+      add_text(d, "comment", rec.text, rec.len);
+      break;
+    default:
+      return -1;
+    }
+  }
+  if (result < 0)
+    return -1;
+  add_str(d, "end_document\n");
+
+  return 0;
+}
+
+/*
+ * Converts 'input' into the binary format and compares its records
+ * with the events. If 'line' is not null, it must be one of them.
+ *
+ */
+static void check(const char *name, const char *input, const char *line)
+{
+  desc_t expected = { NULL, 0, 0 };
+  desc_t got = { NULL, 0, 0 };
+  desc_t dummy = { NULL, 0, 0 };
+  const char *data;
+  size_t len;
+  size_t i;
+  int ok = 1;
+
+  convert(input, 1, &expected, NULL);
+  data = convert(input, 0, NULL, &len);
+
+  if (read_binary(data, len, &got) || strcmp(expected.text, got.text)) {
+    fprintf(stderr, "FAIL: %s\n--- expected:\n%s--- got:\n%s",
+            name, expected.text, got.text ? got.text : "");
+    ok = 0;
+  } else if (line && !strstr(got.text, line)) {
+    fprintf(stderr, "FAIL: %s\n--- no line:\n%s--- got:\n%s",
+            name, line, got.text);
+    ok = 0;
+  }
+
+  /* every truncation of the data is an error */
+  for (i = 0; ok && i < len; i++) {
+    dummy.len = 0;
+    if (!read_binary(data, i, &dummy)) {
+      fprintf(stderr, "FAIL: %s (truncated to %d bytes)\n", name, (int) i);
+      ok = 0;
+    }
+  }
+
+  if (ok)
+    printf("-OK-: %s\n", name);
+  else
+    failures++;
+
+  free(expected.text);
+  free(got.text);
+  free(dummy.text);
+}
+
+int main(void)
+{
+  char *big;
+  size_t i, pos;
+
+  check("elements and attributes",
+        "<title>T</title><p id=a class=\"x y\" title='&lt;t&gt;'>x &amp; y"
+        "<br><a href=\"u?a=1&amp;b=2\">l</a><p>second", NULL);
+
+  check("text, comments and cdata",
+        "<html><head><title>T</title><style>p {}</style></head>"
+        "<body><!-- c --><p>&nbsp;&#233;\xc3\xa9<![CDATA[a < b]]>"
+        "<pre>\n  pre\n</pre><script>if (a<b) x();</script>"
+        "<table><tr><td>1<td>2</table></body></html>", NULL);
+
+  /* references are decoded as in the events, except in comments
+     and CDATA sections */
+  check("references",
+        "<p title=\"&euro;&#x41;&amp;\">&lt;&gt;&quot;&apos;&amp;amp; "
+        "&hellip;&#8364;&#x1F600;&#1;<!-- &amp; --><![CDATA[&amp;]]>",
+        "start p title=[\xe2\x82\xac\x41&]\n"
+        "text [<>\"'&amp; \xe2\x80\xa6\xe2\x82\xac\xf0\x9f\x98\x80"
+        "\xef\xbf\xbd]\n"
+        "comment [ &amp; ]\n"
+        "cdata [&amp;]\n");
+
+  check("document type declaration",
+        "<!DOCTYPE HTML PUBLIC \"-//W3C//DTD HTML 4.01//EN\">\n"
+        "<p lang=en>only a paragraph", NULL);
+
+  /* long text and deep nesting */
+  big = malloc(300000);
+  if (!big) {
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+  pos = sprintf(big, "<title>big</title>");
+  for (i = 0; i < 200; i++)
+    pos += sprintf(big + pos, "<div class=d%d>", (int) i);
+  for (i = 0; i < 70000; i++)
+    big[pos++] = 'a' + i % 26;
+  for (i = 0; i < 200; i++)
+    pos += sprintf(big + pos, "</div>");
+  big[pos] = 0;
+  check("long text and deep nesting", big, NULL);
+  free(big);
+
+  return failures ? 1 : 0;
+}
+
+void exit_on_error(char *msg)
+{
+  fprintf(stderr, "test_binary: %s\n", msg);
+  exit(1);
+}
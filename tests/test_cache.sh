@@ -0,0 +1,62 @@
+#!/bin/bash
+
+# Test of the conversion cache (--cache-dir). A document with
+# warnings of several types is converted twice with an empty cache:
+# the second conversion takes the output from the cache, and must
+# report the same number of warnings of each type as the first one
+# in the summary and JSON messages.
+
+H2X=../src/html2xhtml
+ODIR=tmp-cache
+
+exit_code=0
+
+rm -rf $ODIR
+mkdir $ODIR
+
+printf '<html>\n<body>\n<a href="" = b>x</a>\n<a href="" = c>y</a>\n' \
+    > $ODIR/doc.html
+printf '<p>caf\xc3\xa9 \xe2\x82\xac</p>\n</body>\n</html>\n' >> $ODIR/doc.html
+
+# the number of warnings of each type in the messages of $1
+counts()
+{
+    grep -E '^Warnings of type|"count"' $1 | sed 's/,"suppressed":[0-9]*//'
+}
+
+check()
+{
+    local mode=$1
+    local name=$ODIR/$mode
+
+    rm -rf $ODIR/cache
+    mkdir $ODIR/cache
+    for run in miss hit; do
+        $H2X --ocs us-ascii --messages $mode --cache-dir $ODIR/cache \
+            $ODIR/doc.html -o $name.$run.out 2> $name.$run.err
+    done
+
+    if [ -z "$(ls $ODIR/cache)" ]; then
+        echo "FAIL: $mode: nothing stored in the cache"
+        exit_code=1
+    elif ! cmp -s $name.miss.out $name.hit.out; then
+        echo "FAIL: $mode: the cached output differs"
+        exit_code=1
+    elif [ "$(counts $name.miss.err | wc -l)" -lt 2 ]; then
+        echo "FAIL: $mode: expected warnings of two types, got:"
+        cat $name.miss.err
+        exit_code=1
+    elif [ "$(counts $name.miss.err)" != "$(counts $name.hit.err)" ]; then
+        echo "FAIL: $mode: the counts of the cached conversion differ:"
+        diff <(counts $name.miss.err) <(counts $name.hit.err)
+        exit_code=1
+    else
+        echo "OK: $mode"
+    fi
+}
+
+check summary
+check json
+
+rm -rf $ODIR
+exit $exit_code
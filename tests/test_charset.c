@@ -0,0 +1,284 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Jesus Arias Fisteus                             *
+ *   jaf@it.uc3m.es                                                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/*
+ * test_charset.c
+ * 
+ * Tests of the native UTF-16 and UTF-32 decoders of charset.c: a
+ * text with characters of every UTF-8 length is encoded in each
+ * charset and read back with charset_read() in pieces of many
+ * sizes, from memory and from a file. The input is larger than
+ * the buffer of charset.c, so that it is refilled while the
+ * pieces end at every position of it.
+ *
+ * It also writes malformed UTF-8 (overlong forms, surrogates and
+ * values above U+10FFFF) in several output charsets, where each
+ * sequence must become a single U+FFFD.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "charset.h"
+#include "params.h"
+#include "mensajes.h"
+
+#define TEXT_CHARS 40000
+
+static int failures;
+
+/* the text, in UTF-8 (what charset_read() must return) */
+static char *utf8;
+static size_t utf8_len;
+
+static unsigned int text_char(size_t i)
+{
+  static const unsigned int chars[] = {
+    'a', 'b', ' ', 0xe9, 'c', 0x20ac, '\n', 0x1f600, 'd', 0x3b1
+  };
+
+  return chars[(i * 7 + i / 13) % (sizeof(chars) / sizeof(chars[0]))];
+}
+
+static size_t put_utf8(char *out, unsigned int c)
+{
+  unsigned char *o = (unsigned char *) out;
+
+  if (c < 0x80) {
+    o[0] = c;
+    return 1;
+  } else if (c < 0x800) {
+    o[0] = 0xC0 | (c >> 6);
+    o[1] = 0x80 | (c & 0x3F);
+    return 2;
+  } else if (c < 0x10000) {
+    o[0] = 0xE0 | (c >> 12);
+    o[1] = 0x80 | ((c >> 6) & 0x3F);
+    o[2] = 0x80 | (c & 0x3F);
+    return 3;
+  }
+  o[0] = 0xF0 | (c >> 18);
+  o[1] = 0x80 | ((c >> 12) & 0x3F);
+  o[2] = 0x80 | ((c >> 6) & 0x3F);
+  o[3] = 0x80 | (c & 0x3F);
+  return 4;
+}
+
+static size_t put_unit(char *out, unsigned int u, int unit, int big_endian)
+{
+  int i;
+
+  for (i = 0; i < unit; i++, u >>= 8)
+    out[big_endian ? unit - 1 - i : i] = (char) (u & 0xff);
+  return unit;
+}
+
+/*
+ * Encodes the text in UTF-16 (unit 2) or UTF-32 (unit 4), with
+ * a BOM if 'bom' is set. Returns a buffer allocated with malloc().
+ *
+ */
+static char *encode(int unit, int big_endian, int bom, size_t *len)
+{
+  char *out = malloc(TEXT_CHARS * 4 + 4);
+  size_t o = 0;
+  size_t i;
+  unsigned int c;
+
+  if (!out) {
+    fprintf(stderr, "out of memory\n");
+    exit(1);
+  }
+  if (bom)
+    o += put_unit(out, 0xFEFF, unit, big_endian);
+  for (i = 0; i < TEXT_CHARS; i++) {
+    c = text_char(i);
+    if (unit == 2 && c >= 0x10000) {
+      c -= 0x10000;
+      o += put_unit(out + o, 0xD800 | (c >> 10), unit, big_endian);
+      o += put_unit(out + o, 0xDC00 | (c & 0x3FF), unit, big_endian);
+    } else {
+      o += put_unit(out + o, c, unit, big_endian);
+    }
+  }
+  *len = o;
+  return out;
+}
+
+/*
+ * Reads the whole input in pieces of 'size' bytes and compares
+ * it with the text. Returns 0 if they are equal.
+ *
+ */
+static int read_all(const char *charset_name, FILE *file, size_t size)
+{
+  static char result[TEXT_CHARS * 4];
+  size_t len = 0;
+  int n;
+
+  charset_init_input(charset_lookup_alias(charset_name), file);
+  while (len + size <= sizeof(result)
+         && (n = charset_read(result + len, size, 0)) > 0)
+    len += n;
+  charset_close();
+
+  return len != utf8_len || memcmp(result, utf8, len);
+}
+
+static void check(const char *charset_name, int unit, int big_endian,
+                  int bom)
+{
+  char *data;
+  size_t len;
+  size_t size;
+  FILE *file;
+
+  data = encode(unit, big_endian, bom, &len);
+  file = tmpfile();
+  if (!file || fwrite(data, 1, len, file) != len) {
+    fprintf(stderr, "cannot write a temporary file\n");
+    exit(1);
+  }
+
+  for (size = 4; size <= 130; size++) {
+    charset_set_input_memory(data, len);
+    if (read_all(charset_name, NULL, size)) {
+      fprintf(stderr, "FAIL: %s from memory, read in pieces of %d bytes\n",
+              charset_name, (int) size);
+      failures++;
+      break;
+    }
+    charset_set_input_memory(NULL, 0);
+    rewind(file);
+    if (read_all(charset_name, file, size)) {
+      fprintf(stderr, "FAIL: %s from a file, read in pieces of %d bytes\n",
+              charset_name, (int) size);
+      failures++;
+      break;
+    }
+  }
+  if (size > 130)
+    printf("-OK-: %s\n", charset_name);
+
+  charset_set_input_memory(NULL, 0);
+  fclose(file);
+  free(data);
+}
+
+/*
+ * Writes 'input' (malformed UTF-8 between "a" and "b") in the
+ * given output charset and compares the result with 'expected'.
+ *
+ */
+static void check_output(const char *charset_name, const char *input,
+                         const char *expected, size_t expected_len)
+{
+  char buf[32];
+  char *out;
+  size_t len, n;
+
+  charset_init_output(charset_lookup_alias(charset_name), NULL);
+  charset_capture_output(1);
+  len = strlen(input);
+  memcpy(buf, input, len);
+  n = charset_write(buf, len);
+  charset_close();
+  out = charset_captured_output(&len);
+  charset_capture_output(0);
+
+  if (n != strlen(input) || len != expected_len
+      || memcmp(out, expected, len)) {
+    fprintf(stderr, "FAIL: malformed UTF-8 into %s:", charset_name);
+    for (n = 0; input[n]; n++)
+      fprintf(stderr, " %02x", (unsigned char) input[n]);
+    fprintf(stderr, "\n");
+    failures++;
+  }
+}
+
+static void check_malformed(void)
+{
+  static const char *inputs[] = {
+    "a\xF4\x90\x80\x80" "b",    /* U+110000 */
+    "a\xF7\xBF\xBF\xBF" "b",    /* U+1FFFFF */
+    "a\xED\xA0\x80" "b",        /* surrogate U+D800 */
+    "a\xED\xBF\xBF" "b",        /* surrogate U+DFFF */
+    "a\xC0\xAF" "b",            /* overlong "/" */
+    "a\xE0\x80\xAF" "b",
+    "a\xF0\x80\x80\xAF" "b",
+    "a\xF0\x8F\xBF\xBF" "b",    /* overlong U+FFFF */
+    NULL
+  };
+  int i, old_failures = failures;
+
+  param_ncr_fallback = 1;
+  for (i = 0; inputs[i]; i++) {
+    check_output("us-ascii", inputs[i], "a&#65533;b", 10);
+    check_output("iso-8859-15", inputs[i], "a&#65533;b", 10);
+    check_output("utf-16le", inputs[i], "a\0\xFD\xFF" "b\0", 6);
+    check_output("utf-32le", inputs[i],
+                 "a\0\0\0\xFD\xFF\0\0" "b\0\0\0", 12);
+  }
+
+  /* the largest valid values of each length are kept */
+  check_output("us-ascii", "a\xF4\x8F\xBF\xBF" "b", "a&#1114111;b", 12);
+  check_output("us-ascii", "a\xEF\xBF\xBF" "b", "a&#65535;b", 10);
+  check_output("us-ascii", "a\xDF\xBF" "b", "a&#2047;b", 9);
+  param_ncr_fallback = 0;
+
+  if (failures == old_failures)
+    printf("-OK-: malformed UTF-8\n");
+}
+
+int main(void)
+{
+  size_t i;
+
+  params_set_defaults();
+
+  utf8 = malloc(TEXT_CHARS * 4);
+  if (!utf8) {
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+  for (i = 0; i < TEXT_CHARS; i++)
+    utf8_len += put_utf8(utf8 + utf8_len, text_char(i));
+
+  check("utf-16le", 2, 0, 0);
+  check("utf-16be", 2, 1, 0);
+  check("utf-16", 2, 1, 1);
+  check("utf-32le", 4, 0, 0);
+  check("utf-32be", 4, 1, 0);
+  check("utf-32", 4, 0, 1);
+  check("iso-10646-ucs-4", 4, 1, 0);
+
+  check_malformed();
+
+  free(utf8);
+  return failures ? 1 : 0;
+}
+
+void exit_on_error(char *msg)
+{
+  fprintf(stderr, "test_charset: %s\n", msg);
+  exit(1);
+}
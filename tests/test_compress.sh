@@ -0,0 +1,148 @@
+#!/bin/bash
+
+# Test of the compressed input and output. For each format available
+# in this build (and whose command line tool is installed), a document
+# is converted with --compress at several levels, and from compressed
+# input: as a single stream, as two streams one after the other (split
+# in the middle of a tag), and truncated. Every output, once
+# decompressed, must be the output of the plain document.
+
+H2X=../src/html2xhtml
+ODIR=tmp-compress
+
+exit_code=0
+
+rm -rf $ODIR
+mkdir $ODIR
+
+# larger than the buffers of the compressed input and output
+for ((i = 0; i < 6000; i++)); do
+    printf '<p class=c%d>Line %d, <b>bold</b> &amp; caf\xc3\xa9\n' $i $i
+done > $ODIR/body
+{ printf '<html><head><title>Compressed</title></head><body>\n';
+  cat $ODIR/body; printf '</body></html>\n'; } > $ODIR/doc.html
+rm $ODIR/body
+
+$H2X --ics utf-8 $ODIR/doc.html -o $ODIR/plain.out 2> $ODIR/plain.err
+
+pass()
+{
+    echo "OK: $1"
+}
+
+fail()
+{
+    echo "FAIL: $1"
+    exit_code=1
+}
+
+# checks that the conversion $2 (its output and messages) gives the
+# output of the plain document, once decompressed with $1
+check_output()
+{
+    local tool=$1
+    local name=$2
+
+    if ! $tool -dc < $ODIR/$name.out > $ODIR/$name.dec 2> /dev/null; then
+        fail "$name: the output cannot be decompressed"
+    elif ! cmp -s $ODIR/plain.out $ODIR/$name.dec; then
+        fail "$name: the decompressed output differs"
+    elif [ -s $ODIR/$name.err ]; then
+        fail "$name: unexpected messages:"
+        cat $ODIR/$name.err
+    else
+        pass $name
+    fi
+}
+
+# checks that the conversion $1 gives the output of the plain
+# document, with the same messages
+check_input()
+{
+    local name=$1
+
+    if ! cmp -s $ODIR/plain.out $ODIR/$name.out; then
+        fail "$name: the output differs"
+    elif ! cmp -s $ODIR/plain.err $ODIR/$name.err; then
+        fail "$name: the messages differ:"
+        cat $ODIR/$name.err
+    else
+        pass $name
+    fi
+}
+
+check_format()
+{
+    local format=$1
+    local levels=$2
+    local level
+    local len
+
+    if $H2X --compress $format $ODIR/doc.html -o /dev/null 2>&1 \
+            | grep -q "not available"; then
+        echo "SKIP: $format (not available in this build)"
+        return
+    fi
+    if ! command -v $format > /dev/null; then
+        echo "SKIP: $format (the $format program is not installed)"
+        return
+    fi
+
+    # compressed output
+    $H2X --ics utf-8 --compress $format $ODIR/doc.html \
+        -o $ODIR/$format.out 2> $ODIR/$format.err
+    check_output $format $format
+    for level in $levels; do
+        $H2X --ics utf-8 --compress $format --compress-level $level \
+            $ODIR/doc.html -o $ODIR/$format-$level.out \
+            2> $ODIR/$format-$level.err
+        check_output $format $format-$level
+    done
+
+    # compressed input
+    $format -c < $ODIR/doc.html > $ODIR/doc.$format
+    $H2X --ics utf-8 $ODIR/doc.$format -o $ODIR/$format-in.out \
+        2> $ODIR/$format-in.err
+    check_input $format-in
+
+    # two streams, split in the middle of a tag
+    len=$(( $(wc -c < $ODIR/doc.html) / 2 ))
+    len=$(( $(head -c $len $ODIR/doc.html | grep -ab -o '<b>' | tail -1 \
+              | cut -d: -f1) + 2 ))
+    { head -c $len $ODIR/doc.html | $format -c;
+      tail -c +$((len + 1)) $ODIR/doc.html | $format -c; } \
+        > $ODIR/doc2.$format
+    $H2X --ics utf-8 $ODIR/doc2.$format -o $ODIR/$format-streams.out \
+        2> $ODIR/$format-streams.err
+    check_input $format-streams
+
+    # truncated input
+    len=$(wc -c < $ODIR/doc.$format)
+    head -c $((len - 8)) $ODIR/doc.$format > $ODIR/doc3.$format
+    $H2X --ics utf-8 $ODIR/doc3.$format -o $ODIR/$format-truncated.out \
+        2> $ODIR/$format-truncated.err
+    if grep -q "The compressed input is truncated" \
+            $ODIR/$format-truncated.err; then
+        pass $format-truncated
+    else
+        fail "$format-truncated: no warning about the truncated input:"
+        cat $ODIR/$format-truncated.err
+    fi
+}
+
+check_format gzip "0 1 9"
+check_format zstd "1 19"
+
+# gzip level 0 stores the data without compressing it
+if [ -s $ODIR/gzip-0.out ] && [ -s $ODIR/gzip-9.out ]; then
+    if [ $(wc -c < $ODIR/gzip-0.out) -gt $(wc -c < $ODIR/plain.out) ] \
+        && [ $(wc -c < $ODIR/gzip-9.out) -lt $(wc -c < $ODIR/gzip-0.out) ]
+    then
+        pass "gzip level 0 is not compressed"
+    else
+        fail "gzip level 0 is compressed"
+    fi
+fi
+
+rm -rf $ODIR
+exit $exit_code
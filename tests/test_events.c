@@ -0,0 +1,307 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Jesus Arias Fisteus                             *
+ *   jaf@it.uc3m.es                                                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/*
+ * test_events.c
+ * 
+ * Tests of the event API (h2x_set_handler() in h2x.h): the events
+ * of small documents are written as one line each and compared
+ * with the expected sequence. The documents are also fed in
+ * chunks of every size, which must not change the events.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "h2x.h"
+#include "params.h"
+#include "dtd_util.h"
+#include "mensajes.h"
+
+/* the events of the current conversion, one per line */
+static char events[8192];
+static size_t events_len;
+
+static int failures;
+
+static void add_event(const char *fmt, const char *a, size_t len)
+{
+  int n;
+
+  n = snprintf(events + events_len, sizeof(events) - events_len,
+               fmt, (int) len, a);
+  if (n > 0)
+    events_len += n;
+  if (events_len >= sizeof(events))
+    events_len = sizeof(events) - 1;
+}
+
+static void on_start_document(void *user_data, const char *doctype_key)
+{
+  add_event("start_document %.*s\n", doctype_key, strlen(doctype_key));
+}
+
+static void on_start_element(void *user_data, int elm_id, const char *name,
+                             const h2x_att_t *atts, int num_atts)
+{
+  int i;
+
+  if (elm_id != dtd_elm_search(name))
+    add_event("bad elm_id %.*s\n", name, strlen(name));
+  add_event("start %.*s", name, strlen(name));
+  for (i = 0; i < num_atts; i++) {
+    add_event(" %.*s=", atts[i].name, strlen(atts[i].name));
+    add_event("\"%.*s\"", atts[i].value, strlen(atts[i].value));
+  }
+  add_event("\n", "", 0);
+}
+
+static void on_end_element(void *user_data, int elm_id, const char *name)
+{
+  add_event("end %.*s\n", name, strlen(name));
+}
+
+static void on_characters(void *user_data, const char *text, size_t len)
+{
+  add_event("characters [%.*s]\n", text, len);
+}
+
+static void on_cdata_section(void *user_data, const char *text, size_t len)
+{
+  add_event("cdata_section [%.*s]\n", text, len);
+}
+
+static void on_comment(void *user_data, const char *text, size_t len)
+{
+  add_event("comment [%.*s]\n", text, len);
+}
+
+static void on_end_document(void *user_data)
+{
+  /* the user data is passed to every callback */
+  add_event("end_document %.*s\n", (const char *) user_data,
+            strlen((const char *) user_data));
+}
+
+static const h2x_handler_t handler = {
+  on_start_document,
+  on_start_element,
+  on_end_element,
+  on_characters,
+  on_cdata_section,
+  on_comment,
+  on_end_document
+};
+
+/*
+ * Converts 'input' with the handler, in chunks of 'chunk' bytes
+ * (or with h2x_convert() if it is 0), and leaves the events in
+ * 'events'. Returns the result of the conversion.
+ *
+ */
+static int run(const char *doctype, const char *input, size_t chunk,
+               const h2x_handler_t *h)
+{
+  h2x_ctx_t *ctx;
+  size_t len = strlen(input);
+  size_t pos;
+  int result;
+
+  params_set_defaults();
+  param_doctype = dtd_get_dtd_index(doctype);
+  events_len = 0;
+  events[0] = 0;
+
+  ctx = h2x_new(NULL);
+  if (!ctx) {
+    fprintf(stderr, "h2x_new() failed\n");
+    exit(1);
+  }
+  h2x_set_handler(ctx, h, "user data");
+  if (!chunk) {
+    result = h2x_convert(ctx, input, len);
+  } else {
+    for (pos = 0; pos < len; pos += chunk)
+      h2x_feed(ctx, input + pos, len - pos < chunk ? len - pos : chunk);
+    result = h2x_finish(ctx);
+  }
+  h2x_free(ctx);
+
+  return result;
+}
+
+static void check(const char *name, const char *doctype, const char *input,
+                  const char *expected)
+{
+  size_t chunk;
+
+  if (run(doctype, input, 0, &handler) || strcmp(events, expected)) {
+    fprintf(stderr, "FAIL: %s\n--- expected:\n%s--- got:\n%s",
+            name, expected, events);
+    failures++;
+    return;
+  }
+
+  for (chunk = 1; chunk <= strlen(input); chunk++) {
+    if (run(doctype, input, chunk, &handler) || strcmp(events, expected)) {
+      fprintf(stderr, "FAIL: %s (chunks of %d bytes)\n--- expected:\n%s"
+              "--- got:\n%s", name, (int) chunk, expected, events);
+      failures++;
+      return;
+    }
+  }
+
+  printf("-OK-: %s\n", name);
+}
+
+int main(void)
+{
+  static const h2x_handler_t empty_handler;
+
+  /* missing elements are inserted, and the events are balanced */
+  check("structure", "transitional",
+        "<title>T</title><p>a<p>b",
+        "start_document transitional\n"
+        "start html xmlns=\"http://www.w3.org/1999/xhtml\"\n"
+        "start head\n"
+        "start title\n"
+        "characters [T]\n"
+        "end title\n"
+        "end head\n"
+        "start body\n"
+        "start p\n"
+        "characters [a]\n"
+        "end p\n"
+        "start p\n"
+        "characters [b]\n"
+        "end p\n"
+        "end body\n"
+        "end html\n"
+        "end_document user data\n");
+
+  /* attributes in document order, and references decoded */
+  check("attributes and text", "transitional",
+        "<html><head><title>T</title></head><body>"
+        "<p id=a class=\"x y\" title='&lt;t&gt;'>x &amp; y&nbsp;&#233;"
+        "<br><a href=\"u?a=1&amp;b=2\">l</a></p></body></html>",
+        "start_document transitional\n"
+        "start html xmlns=\"http://www.w3.org/1999/xhtml\"\n"
+        "start head\n"
+        "start title\n"
+        "characters [T]\n"
+        "end title\n"
+        "end head\n"
+        "start body\n"
+        "start p id=\"a\" class=\"x y\" title=\"<t>\"\n"
+        "characters [x & y\xc2\xa0\xc3\xa9]\n"
+        "start br\n"
+        "end br\n"
+        "start a href=\"u?a=1&b=2\"\n"
+        "characters [l]\n"
+        "end a\n"
+        "end p\n"
+        "end body\n"
+        "end html\n"
+        "end_document user data\n");
+
+  /* every kind of reference; invalid characters become U+FFFD, and
+     comments and CDATA sections are not decoded */
+  check("references", "transitional",
+        "<title>T</title><p title=\"&euro;&#x41;&#X42;\">&lt;&gt;&quot;"
+        "&apos;&amp;amp; &hellip;&#8364;&#x20AC;&#x1F600; &#1;&#xD800;"
+        "&#1114112;<!-- &amp; --><![CDATA[&amp;]]>",
+        "start_document transitional\n"
+        "start html xmlns=\"http://www.w3.org/1999/xhtml\"\n"
+        "start head\n"
+        "start title\n"
+        "characters [T]\n"
+        "end title\n"
+        "end head\n"
+        "start body\n"
+        "start p title=\"\xe2\x82\xac\x41&#X42;\"\n"
+        "characters [<>\"'&amp; \xe2\x80\xa6\xe2\x82\xac\xe2\x82\xac"
+        "\xf0\x9f\x98\x80 \xef\xbf\xbd\xef\xbf\xbd\xef\xbf\xbd]\n"
+        "comment [ &amp; ]\n"
+        "cdata_section [&amp;]\n"
+        "end p\n"
+        "end body\n"
+        "end html\n"
+        "end_document user data\n");
+
+  /* comments and CDATA sections */
+  check("comments and cdata", "transitional",
+        "<html><head><title>T</title></head><body><!-- c -->"
+        "<p><![CDATA[a < b]]></p><script>x<y</script></body></html>",
+        "start_document transitional\n"
+        "start html xmlns=\"http://www.w3.org/1999/xhtml\"\n"
+        "start head\n"
+        "start title\n"
+        "characters [T]\n"
+        "end title\n"
+        "end head\n"
+        "start body\n"
+        "comment [ c ]\n"
+        "start p\n"
+        "cdata_section [a < b]\n"
+        "end p\n"
+        "start script type=\"text/javascript\" xml:space=\"preserve\"\n"
+        "cdata_section [x<y]\n"
+        "end script\n"
+        "end body\n"
+        "end html\n"
+        "end_document user data\n");
+
+  /* attributes that are not valid in the output doctype are removed */
+  check("doctype", "strict",
+        "<title>T</title><p align=center id=x>d</p>",
+        "start_document strict\n"
+        "start html xmlns=\"http://www.w3.org/1999/xhtml\"\n"
+        "start head\n"
+        "start title\n"
+        "characters [T]\n"
+        "end title\n"
+        "end head\n"
+        "start body\n"
+        "start p id=\"x\"\n"
+        "characters [d]\n"
+        "end p\n"
+        "end body\n"
+        "end html\n"
+        "end_document user data\n");
+
+  /* every callback may be null */
+  if (run("transitional", "<p>a<!-- c --><![CDATA[d]]>", 0, &empty_handler)
+      || events_len) {
+    fprintf(stderr, "FAIL: null callbacks\n");
+    failures++;
+  } else {
+    printf("-OK-: null callbacks\n");
+  }
+
+  return failures ? 1 : 0;
+}
+
+void exit_on_error(char *msg)
+{
+  fprintf(stderr, "test_events: %s\n", msg);
+  exit(1);
+}
@@ -0,0 +1,170 @@
+#!/bin/bash
+
+# Test of the parallel tokenization (--jobs). A document of several
+# megabytes is converted with one and with four processes, and the
+# output and the messages must be the same. The input is split in
+# four regions, and each of the three boundaries between them falls
+# inside a long element. The first one is a script that begins too
+# far back for the boundary to be guessed right, so that its region
+# is tokenized again. The others begin close enough, so that the
+# regions after them are taken from the child processes: a pre
+# element, which is still open at the boundary, and a comment. The
+# statistics must show both cases.
+#
+# A second document is broken: in the middle of each of its parts
+# there is a script element whose start tag has a syntax error, with
+# markup inside (one tag with another error), and after the last part
+# an element with too many attributes, which is a fatal error. Both
+# runs must tokenize the scripts alike, and report the same warnings
+# and the fatal error at the same line.
+
+H2X=../src/html2xhtml
+ODIR=tmp-jobs
+
+# size of the text between the long elements, and of each one
+FILLER=1100000
+ELEMENT=200000
+
+rm -rf $ODIR
+mkdir $ODIR
+
+# the document of $1 (empty or "broken") into $ODIR/input$1
+make_input()
+{
+awk -v filler=$FILLER -v element=$ELEMENT -v broken=$1 '
+function text(k,    n, i, line) {
+    # in divisions of 100 lines, because elements with many
+    # children are slow to repair
+    for (n = 0; n < filler; n += length(line) + 1) {
+        i++
+        if (i % 1000 == 0)
+            line = "<p>Line " i " of part " k " <foo>unknown</foo> <p =a>"
+        else
+            line = "<p>Line " i " of part " k ", <b>bold</b> &amp; <i>it</i>"
+        if (i % 100 == 1)
+            line = "<div>" line
+        else if (i % 100 == 0)
+            line = line "</div>"
+        print line
+    }
+    if (i % 100)
+        print "</div>"
+}
+function long_element(k,    n, i, line) {
+    if (k == 1)
+        print "<script type=\"text/javascript\">"
+    else if (k == 2)
+        print "<pre>"
+    else
+        print "<!-- commented out:"
+    for (n = 0; n < element; n += length(line) + 1) {
+        i++
+        if (k == 1)
+            line = "  if (a<b && c>d) document.write(\"<p>\" + " i " + \"</p>\");"
+        else if (k == 3)
+            line = "<p>Line " i " <b>in</b> a comment, <i>x</i>"
+        else if (i % 50 == 0)
+            line = "  <b>Line " i "</b>   <i>in   a   pre   element</i>"
+        else
+            line = "  Line " i "   in   a   pre   element"
+        print line
+    }
+    if (k == 1)
+        print "</script>"
+    else if (k == 2)
+        print "</pre>"
+    else
+        print "-->"
+}
+function broken_script(k,    i) {
+    print "<p>Part " k "<script ?>"
+    for (i = 1; i <= 20; i++)
+        if (i == 10)
+            print "<p =a>Line " i " after a broken tag in part " k
+        else
+            print "<p>Line " i " <b>after</b> a broken tag in part " k
+    print "</script>"
+}
+function too_many_attributes(    i, line) {
+    line = "<p"
+    for (i = 0; i < 300; i++)
+        line = line " a" i
+    print line ">"
+}
+BEGIN {
+    print "<html><head><title>Parallel tokenization</title></head><body>"
+    for (k = 1; k <= 4; k++) {
+        if (broken) {
+            filler /= 2
+            text(k)
+            broken_script(k)
+            text(k)
+            filler *= 2
+        } else {
+            text(k)
+            if (k < 4)
+                long_element(k)
+        }
+    }
+    if (broken)
+        too_many_attributes()
+    print "</body></html>"
+}' >$ODIR/input$1
+}
+
+# converts $ODIR/input$1 with one and with four processes
+convert()
+{
+    for jobs in 1 4
+    do
+        $H2X --jobs $jobs --stats=json $ODIR/input$1 -o $ODIR/out$1-$jobs \
+	    2>$ODIR/err$1-$jobs
+        grep -v '^{"time"' $ODIR/err$1-$jobs >$ODIR/messages$1-$jobs
+    done
+}
+
+exit_code=0
+make_input
+convert
+
+if ! cmp -s $ODIR/out-1 $ODIR/out-4
+then
+    echo "FAIL: --jobs 4 - different output"
+    exit_code=1
+elif ! cmp -s $ODIR/messages-1 $ODIR/messages-4
+then
+    echo "FAIL: --jobs 4 - different messages"
+    exit_code=1
+elif ! grep -q '"regions":{"reused":2,"rescanned":1}' $ODIR/err-4
+then
+    echo "FAIL: --jobs 4 - the regions were not split as expected:"
+    grep -o '"regions":{[^}]*}' $ODIR/err-4
+    exit_code=1
+else
+    echo "-OK-: --jobs 4"
+fi
+
+make_input broken
+convert broken
+
+if ! grep -q '^Error \[line [0-9]*\]: maximum number of attributes' \
+    $ODIR/messagesbroken-1
+then
+    echo "FAIL: --jobs 1, broken document - no fatal error:"
+    cat $ODIR/messagesbroken-1
+    exit_code=1
+elif ! cmp -s $ODIR/messagesbroken-1 $ODIR/messagesbroken-4
+then
+    echo "FAIL: --jobs 4, broken document - different messages:"
+    diff $ODIR/messagesbroken-1 $ODIR/messagesbroken-4
+    exit_code=1
+elif ! cmp -s $ODIR/outbroken-1 $ODIR/outbroken-4
+then
+    echo "FAIL: --jobs 4, broken document - different output"
+    exit_code=1
+else
+    echo "-OK-: --jobs 4, broken document"
+fi
+
+rm -rf $ODIR
+exit $exit_code
@@ -0,0 +1,71 @@
+#!/bin/bash
+
+# Test of the line numbers in the messages. Long comments, CDATA
+# sections and scripts are scanned in chunks, and the text of those
+# that turn out not to be closed is scanned again; neither must
+# change the line count, even if the text has null characters. The
+# documents below are reported either at their end (they have no
+# root element, or a character that cannot be written in US-ASCII),
+# so the message must give the number of lines of the input.
+
+H2X=../src/html2xhtml
+ODIR=tmp-lines
+
+exit_code=0
+
+rm -rf $ODIR
+mkdir $ODIR
+
+# long text with newlines, null characters and parts of the
+# delimiters of comments and CDATA sections
+long_text()
+{
+    local i
+
+    for ((i = 0; i < 300; i++)); do
+        printf 'line %d - ]] -\x00 </ x\n' $i
+        if ((i % 7 == 0)); then
+            printf '\n\n'
+        fi
+    done
+}
+
+check()
+{
+    local name=$1
+    local input=$ODIR/$name.html
+    local lines
+    shift
+
+    lines=$(( $(tr -dc '\n' < $input | wc -c) + 1 ))
+    $H2X "$@" $input -o $ODIR/$name.out 2> $ODIR/$name.err
+    if grep -q "\[line $lines\]" $ODIR/$name.err; then
+        echo "OK: $name (line $lines)"
+    else
+        echo "FAIL: $name: expected line $lines, got:"
+        cat $ODIR/$name.err
+        exit_code=1
+    fi
+}
+
+printf '<!-- a\nb\nx\x00y {\n\n\n\n' > $ODIR/comment-short.html
+check comment-short
+
+{ printf '<!-- a\n'; long_text; } > $ODIR/comment-long.html
+check comment-long
+
+{ printf '<![CDATA[\n'; long_text; } > $ODIR/cdata-long.html
+check cdata-long
+
+{ printf '<html><body>\n<script>\n'; long_text; printf '<!--\n';
+  long_text; printf '</script>\n<p>\xc3\xa9\n'; long_text; } \
+    > $ODIR/script-long.html
+check script-long --ocs us-ascii
+
+{ printf '<html><body>\n<p>\n<!-- '; long_text; printf -- '-- x -->\n';
+  printf '<![CDATA[\n'; long_text; printf '<p>\xc3\xa9\n'; } \
+    > $ODIR/body-long.html
+check body-long --ocs us-ascii
+
+rm -rf $ODIR
+exit $exit_code
@@ -0,0 +1,239 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Jesus Arias Fisteus                             *
+ *   jaf@it.uc3m.es                                                        *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/*
+ * test_push.c
+ *
+ * Tests of the push API (h2x_feed() and h2x_finish() in h2x.h):
+ * documents are fed in chunks of many sizes, so that they end in
+ * the middle of tags, references, comments and multibyte
+ * characters, and also one byte at a time and with empty chunks
+ * between the others. The output must be the same as when the
+ * whole document is converted with h2x_convert().
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "h2x.h"
+#include "params.h"
+#include "dtd_util.h"
+#include "charset.h"
+#include "mensajes.h"
+
+static int failures;
+
+/* the output of the last conversion */
+static char *output;
+static size_t output_len;
+
+/*
+ * Converts 'input' feeding it in chunks whose sizes are taken in
+ * turn from 'sizes' (with h2x_convert() if 'sizes' is null), and
+ * keeps the output in 'output'. A size of 0 feeds an empty chunk.
+ * Returns the result of the conversion.
+ *
+ */
+static int run(const char *input, size_t len, const size_t *sizes,
+               int num_sizes)
+{
+  h2x_ctx_t *ctx;
+  const char *out;
+  size_t pos, chunk;
+  int result, i;
+
+  params_set_defaults();
+  param_doctype = dtd_get_dtd_index("transitional");
+  param_charset_in = charset_lookup_alias("UTF-8");
+  param_charset_out = param_charset_in;
+
+  ctx = h2x_new(NULL);
+  if (!ctx) {
+    fprintf(stderr, "h2x_new() failed\n");
+    exit(1);
+  }
+  if (h2x_new(NULL)) {
+    fprintf(stderr, "FAIL: two conversions at the same time\n");
+    failures++;
+  }
+
+  if (!sizes) {
+    result = h2x_convert(ctx, input, len);
+  } else {
+    for (pos = 0, i = 0; pos < len; pos += chunk, i++) {
+      chunk = sizes[i % num_sizes];
+      if (chunk > len - pos)
+        chunk = len - pos;
+      if (h2x_feed(ctx, input + pos, chunk)) {
+        fprintf(stderr, "FAIL: h2x_feed() at byte %d\n", (int) pos);
+        failures++;
+      }
+    }
+    /* nothing is left for h2x_finish() after an empty chunk */
+    h2x_feed(ctx, input + len, 0);
+    result = h2x_finish(ctx);
+    if (h2x_feed(ctx, "<p>", 3) != -1 || h2x_finish(ctx) != -1) {
+      fprintf(stderr, "FAIL: the conversion goes on after h2x_finish()\n");
+      failures++;
+    }
+  }
+
+  free(output);
+  output = NULL;
+  output_len = 0;
+  out = h2x_output(ctx, &output_len);
+  if (out) {
+    output = malloc(output_len + 1);
+    memcpy(output, out, output_len);
+    output[output_len] = 0;
+  }
+  h2x_free(ctx);
+
+  return result;
+}
+
+/*
+ * Feeds 'input' in chunks of 'sizes' (see run()) and compares the
+ * output with the one of h2x_convert() ('expected').
+ *
+ */
+static void check(const char *name, const char *input, size_t len,
+                  const char *expected, size_t expected_len,
+                  const size_t *sizes, int num_sizes)
+{
+  char label[64];
+  int i;
+
+  if (num_sizes == 1)
+    snprintf(label, sizeof(label), "%s (chunks of %d bytes)",
+             name, (int) sizes[0]);
+  else {
+    snprintf(label, sizeof(label), "%s (chunks of", name);
+    for (i = 0; i < num_sizes && strlen(label) < sizeof(label) - 8; i++)
+      snprintf(label + strlen(label), sizeof(label) - strlen(label),
+               " %d", (int) sizes[i]);
+    snprintf(label + strlen(label), sizeof(label) - strlen(label), ")");
+  }
+
+  if (run(input, len, sizes, num_sizes) || !output) {
+    fprintf(stderr, "FAIL: %s: no output\n", label);
+    failures++;
+  } else if (output_len != expected_len
+             || memcmp(output, expected, expected_len)) {
+    for (i = 0; i < (int) output_len && i < (int) expected_len
+           && output[i] == expected[i]; i++)
+      ;
+    fprintf(stderr, "FAIL: %s: the output differs from byte %d:\n"
+            "--- expected:\n%.80s\n--- got:\n%.80s\n", label, i,
+            expected + i, output + i);
+    failures++;
+  }
+}
+
+static void check_document(const char *name, const char *input, size_t len,
+                           const char *must_contain)
+{
+  static const size_t odd[] = {1, 7, 0, 2, 300, 0, 0, 13, 1, 64, 5};
+  static const size_t fixed[] = {1, 2, 3, 4, 5, 7, 11, 64, 255, 256,
+                                 257, 1000, 4093, 65536};
+  char *expected;
+  size_t expected_len, i;
+  int old_failures = failures;
+
+  if (run(input, len, NULL, 0) || !output) {
+    fprintf(stderr, "FAIL: %s: h2x_convert()\n", name);
+    failures++;
+    return;
+  }
+  expected = output;
+  expected_len = output_len;
+  output = NULL;
+
+  /* the reference must be right too */
+  if (!strstr(expected, must_contain)) {
+    fprintf(stderr, "FAIL: %s: \"%s\" not found in\n%s", name,
+            must_contain, expected);
+    failures++;
+  }
+
+  for (i = 0; i < sizeof(fixed) / sizeof(fixed[0]) && fixed[i] <= len; i++)
+    check(name, input, len, expected, expected_len, fixed + i, 1);
+  check(name, input, len, expected, expected_len, odd,
+        sizeof(odd) / sizeof(odd[0]));
+
+  /* small documents are also cut at every position */
+  if (len < 512) {
+    for (i = 1; i < len; i++) {
+      size_t cut[2];
+
+      cut[0] = i;
+      cut[1] = len - i;
+      check(name, input, len, expected, expected_len, cut, 2);
+    }
+  }
+
+  if (failures == old_failures)
+    printf("-OK-: %s\n", name);
+  free(expected);
+}
+
+int main(void)
+{
+  static const char small[] =
+    "<html><head><title>T\xc3\xad</title></head><body>"
+    "<p class=\"a\" id=x>caf\xc3\xa9 &amp; t\xe2\x82\xac &#233;<br>"
+    "<!-- c --><![CDATA[a < b]]></p></body></html>";
+  char *large;
+  size_t len;
+  int i;
+
+  check_document("small document", small, sizeof(small) - 1,
+                 "caf\xc3\xa9 &amp; t\xe2\x82\xac &#233;<br />");
+
+  /* long enough for the lexer to scan its long tokens in pieces
+     and for the parser to wait for more input several times */
+  large = malloc(1 << 20);
+  len = sprintf(large, "<html><head><title>L</title><script>");
+  for (i = 0; i < 2000; i++)
+    len += sprintf(large + len, "if (a<b && c>d) x[%d] = '</p>';\n", i);
+  len += sprintf(large + len, "</script></head><body><!--");
+  for (i = 0; i < 2000; i++)
+    len += sprintf(large + len, " comment %d - ", i);
+  len += sprintf(large + len, "-->\n");
+  for (i = 0; i < 3000; i++)
+    len += sprintf(large + len, "<p title='t%d'>na\xc3\xafve %d &lt; "
+                   "\xe2\x82\xac&nbsp;<b>x</b>\n", i, i);
+  len += sprintf(large + len, "</body></html>\n");
+
+  check_document("large document", large, len,
+                 "<p title=\"t2999\">");
+
+  free(large);
+  free(output);
+  return failures ? 1 : 0;
+}
+
+void exit_on_error(char *msg)
+{
+  fprintf(stderr, "test_push: %s\n", msg);
+  exit(1);
+}
@@ -0,0 +1,84 @@
+#!/bin/bash
+
+# Tests of the WARC mode (--warc). test-warc-1.warc has a response
+# with the chunked transfer encoding, one compressed with gzip, one
+# with an unknown charset, one that cannot be converted, records
+# that are not HTML documents and several small documents;
+# test-warc-1.warc.gz has the same records, each one compressed on
+# its own. Both are converted with one and with several jobs, and
+# the output WARC and the messages must match the references in
+# input order. The date of the conversion records is not compared.
+
+SRCDIR=${srcdir:-.}
+H2X=../src/html2xhtml
+ODIR=tmp-warc
+REF=$SRCDIR/test-warc-1.warc.ref
+REF_ERR=$SRCDIR/test-warc-1.warc.err
+
+exit_code=0
+
+rm -rf $ODIR
+mkdir $ODIR
+
+normalize()
+{
+    sed -e 's/^\(WARC-Date: \)[0-9TZ:-]*/\1-/' "$@"
+}
+
+# the compressed cases need html2xhtml to be built with zlib
+inputs=test-warc-1.warc
+if $H2X --warc $SRCDIR/test-warc-1.warc.gz --jobs 1 -o $ODIR/out.warc \
+    2>&1 | grep -q "without gzip support"
+then
+    echo "SKIP: gzip-compressed WARC files (built without zlib)"
+    gzip=no
+else
+    inputs="$inputs test-warc-1.warc.gz"
+    gzip=yes
+fi
+
+for input in $inputs
+do
+    for jobs in 1 3
+    do
+	test="$input / --jobs $jobs"
+	$H2X --warc $SRCDIR/$input --jobs $jobs -o $ODIR/out.warc \
+	    2>$ODIR/err
+	status=$?
+	normalize $ODIR/out.warc >$ODIR/out.norm
+	if [ $status -ne 1 ]
+	then
+	    # a record could not be converted
+	    echo "FAIL: $test - exit status $status instead of 1"
+	    exit_code=1
+	elif ! cmp -s $REF $ODIR/out.norm
+	then
+	    echo "FAIL: $test - different output"
+	    exit_code=1
+	elif ! cmp -s $REF_ERR $ODIR/err
+	then
+	    echo "FAIL: $test - different messages"
+	    exit_code=1
+	else
+	    echo "-OK-: $test"
+	fi
+    done
+done
+
+# the output is compressed record by record
+test="test-warc-1.warc / --compress gzip --jobs 3"
+if [ $gzip == yes ]
+then
+    $H2X --warc $SRCDIR/test-warc-1.warc --jobs 3 --compress gzip \
+	-o $ODIR/out.warc.gz 2>/dev/null
+    if ! gzip -dc $ODIR/out.warc.gz | normalize | cmp -s $REF -
+    then
+	echo "FAIL: $test - different output"
+	exit_code=1
+    else
+	echo "-OK-: $test"
+    fi
+fi
+
+rm -rf $ODIR
+exit $exit_code